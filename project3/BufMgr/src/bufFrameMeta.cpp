@@ -0,0 +1,107 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bufFrameMeta.h"
+
+namespace badgerdb {
+
+BufFrameMeta::BufFrameMeta(const std::uint32_t frames)
+  : numFrames(frames), numWords((frames + 63) / 64)
+{
+  validBits = new std::uint64_t[numWords];
+  refBits = new std::uint64_t[numWords];
+  pinnedBits = new std::uint64_t[numWords];
+  pinCounts = new std::uint32_t[numFrames];
+
+  for (std::uint32_t w = 0; w < numWords; w++)
+    validBits[w] = refBits[w] = pinnedBits[w] = 0;
+  for (std::uint32_t f = 0; f < numFrames; f++)
+    pinCounts[f] = 0;
+}
+
+BufFrameMeta::~BufFrameMeta()
+{
+  delete [] validBits;
+  delete [] refBits;
+  delete [] pinnedBits;
+  delete [] pinCounts;
+}
+
+void BufFrameMeta::load(const std::uint32_t f)
+{
+  validBits[word(f)] |= bit(f);
+  refBits[word(f)] |= bit(f);
+  pinnedBits[word(f)] |= bit(f);
+  pinCounts[f] = 1;
+}
+
+void BufFrameMeta::clear(const std::uint32_t f)
+{
+  validBits[word(f)] &= ~bit(f);
+  refBits[word(f)] &= ~bit(f);
+  pinnedBits[word(f)] &= ~bit(f);
+  pinCounts[f] = 0;
+}
+
+void BufFrameMeta::restore(const std::uint32_t f, const std::uint32_t pins, const bool referenced)
+{
+  pinCounts[f] = pins;
+  if (pins == 0)
+    pinnedBits[word(f)] &= ~bit(f);
+  if (!referenced)
+    refBits[word(f)] &= ~bit(f);
+}
+
+void BufFrameMeta::pin(const std::uint32_t f)
+{
+  if (pinCounts[f]++ == 0)
+    pinnedBits[word(f)] |= bit(f);
+}
+
+void BufFrameMeta::unpin(const std::uint32_t f)
+{
+  if (--pinCounts[f] == 0)
+    pinnedBits[word(f)] &= ~bit(f);
+}
+
+bool BufFrameMeta::sweep(const std::uint32_t start, std::uint32_t& victim)
+{
+  std::uint64_t remaining = 2 * (std::uint64_t) numFrames;
+  std::uint32_t f = start;
+
+  while (remaining > 0)
+  {
+    // frames f up to the end of its word, the partition or the sweep, whichever is first
+    std::uint32_t w = word(f);
+    std::uint32_t shift = f & 63;
+    std::uint64_t span = 64 - shift;
+    if (span > numFrames - f)
+      span = numFrames - f;
+    if (span > remaining)
+      span = remaining;
+    std::uint64_t range = (span == 64 ? ~0ULL : (1ULL << span) - 1) << shift;
+
+    std::uint64_t usable = (~validBits[w] | ~(refBits[w] | pinnedBits[w])) & range;
+    if (usable)
+    {
+      // frames before the first usable one have been passed over
+      std::uint64_t first = usable & (~usable + 1);
+      refBits[w] &= ~(range & (first - 1));
+      victim = (w << 6) + __builtin_ctzll(usable);
+      return true;
+    }
+
+    refBits[w] &= ~range;
+    remaining -= span;
+    f += (std::uint32_t) span;
+    if (f == numFrames)
+      f = 0;
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,125 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+* @brief Per-frame state the clock sweep looks at, for the frames of one buffer partition,
+* kept as dense parallel arrays instead of inside BufDesc
+*
+* Whether a frame is valid, recently referenced or pinned is stored as one bit per frame,
+* and pin counts as a compact array next to them. The sweep then decides on 64 frames per
+* word operation, skipping referenced and pinned frames without touching their BufDesc.
+* Frames are addressed relative to the partition's first frame.
+*
+* @warning This class is not threadsafe.
+*/
+class BufFrameMeta
+{
+ private:
+	/**
+   * Number of frames described
+	 */
+  std::uint32_t numFrames;
+
+	/**
+   * Number of 64 bit words in each bitset
+	 */
+  std::uint32_t numWords;
+
+	/**
+   * Bit set for every frame holding a page
+	 */
+  std::uint64_t* validBits;
+
+	/**
+   * Bit set for every frame referenced since the clock last passed it
+	 */
+  std::uint64_t* refBits;
+
+	/**
+   * Bit set for every frame with a pin count above zero
+	 */
+  std::uint64_t* pinnedBits;
+
+	/**
+   * Pin count of every frame
+	 */
+  std::uint32_t* pinCounts;
+
+  static std::uint32_t word(const std::uint32_t f) { return f >> 6; }
+  static std::uint64_t bit(const std::uint32_t f) { return 1ULL << (f & 63); }
+
+  BufFrameMeta(const BufFrameMeta&);
+  BufFrameMeta& operator=(const BufFrameMeta&);
+
+ public:
+	/**
+   * Constructor of BufFrameMeta class. All frames start out invalid and unpinned.
+	 *
+	 * @param frames  Number of frames in the partition
+	 */
+  BufFrameMeta(const std::uint32_t frames);
+
+	/**
+   * Destructor of BufFrameMeta class
+	 */
+  ~BufFrameMeta();
+
+  bool valid(const std::uint32_t f) const { return (validBits[word(f)] & bit(f)) != 0; }
+  bool referenced(const std::uint32_t f) const { return (refBits[word(f)] & bit(f)) != 0; }
+  std::uint32_t pinCount(const std::uint32_t f) const { return pinCounts[f]; }
+
+	/**
+   * Mark frame f as recently referenced
+	 */
+  void reference(const std::uint32_t f) { refBits[word(f)] |= bit(f); }
+
+	/**
+   * Page placed in frame f: valid, referenced and pinned once
+	 */
+  void load(const std::uint32_t f);
+
+	/**
+   * Frame f emptied: invalid, unreferenced and unpinned
+	 */
+  void clear(const std::uint32_t f);
+
+	/**
+   * Frame f takes over a page moved from another frame, with its pin count and
+	 * reference bit. The frame must have been load()ed.
+	 */
+  void restore(const std::uint32_t f, const std::uint32_t pins, const bool referenced);
+
+	/**
+   * Increment the pin count of frame f
+	 */
+  void pin(const std::uint32_t f);
+
+	/**
+   * Decrement the pin count of frame f, which must be pinned
+	 */
+  void unpin(const std::uint32_t f);
+
+	/**
+	 * Run the clock from frame start to the first frame that is invalid, or valid and
+	 * neither referenced nor pinned, clearing the reference bit of every frame passed
+	 * over. Gives up after two full turns, by which time every reference bit has been
+	 * cleared, so it only fails if all frames are pinned.
+	 *
+	 * @param start   	Frame the sweep starts at
+	 * @param victim  	Frame found returned via this variable
+	 * @return  			False if every frame is pinned
+	 */
+  bool sweep(const std::uint32_t start, std::uint32_t& victim);
+};
+
+}
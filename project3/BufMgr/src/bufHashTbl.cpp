@@ -17,10 +17,10 @@ namespace badgerdb {
 
 int BufHashTbl::hash(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
+  unsigned long tmp, value;
+  tmp = (unsigned long)file;  // cast of pointer to the file object to an integer
   value = (tmp + pageNo) % HTSIZE;
-  return value;
+  return (int) value;
 }
 
 BufHashTbl::BufHashTbl(int htSize)
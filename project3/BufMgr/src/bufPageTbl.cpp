@@ -0,0 +1,113 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <memory>
+#include <iostream>
+#include "bufPageTbl.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/hash_table_exception.h"
+
+namespace badgerdb {
+
+std::uint32_t BufPageTbl::hash(const File* file, const PageId pageNo) const
+{
+  // combine both halves of the key, then run the 64 bit finalizer of MurmurHash3 so that
+  // consecutive pages of the same file land far apart
+  std::uint64_t key = (std::uint64_t) reinterpret_cast<std::uintptr_t>(file);
+  key ^= ((std::uint64_t) pageNo << 32) | pageNo;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return (std::uint32_t) key & mask;
+}
+
+BufPageTbl::BufPageTbl(const std::uint32_t entries)
+  : maxEntries(entries), numEntries(0)
+{
+  // keep the table at most half full
+  capacity = 2;
+  while (capacity < 2 * entries)
+    capacity <<= 1;
+  mask = capacity - 1;
+
+  slots = new pageTblSlot[capacity];
+  for (std::uint32_t i = 0; i < capacity; i++)
+    slots[i].file = NULL;
+}
+
+BufPageTbl::~BufPageTbl()
+{
+  delete [] slots;
+}
+
+std::uint32_t BufPageTbl::find(const File* file, const PageId pageNo) const
+{
+  std::uint32_t index = hash(file, pageNo);
+  while (slots[index].file) {
+    if (slots[index].file == file && slots[index].pageNo == pageNo)
+      return index;
+    index = (index + 1) & mask;
+  }
+  return capacity;
+}
+
+void BufPageTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  std::uint32_t index = hash(file, pageNo);
+  while (slots[index].file) {
+    if (slots[index].file == file && slots[index].pageNo == pageNo)
+      throw HashAlreadyPresentException(file->filename(), pageNo, slots[index].frameNo);
+    index = (index + 1) & mask;
+  }
+
+  if (numEntries >= maxEntries)
+    throw HashTableException();
+
+  slots[index].file = file;
+  slots[index].pageNo = pageNo;
+  slots[index].frameNo = frameNo;
+  numEntries++;
+}
+
+bool BufPageTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) const
+{
+  std::uint32_t index = find(file, pageNo);
+  if (index == capacity)
+    return false;
+
+  frameNo = slots[index].frameNo; // return frameNo by reference
+  return true;
+}
+
+void BufPageTbl::remove(const File* file, const PageId pageNo)
+{
+  std::uint32_t hole = find(file, pageNo);
+  if (hole == capacity)
+    throw HashNotFoundException(file->filename(), pageNo);
+
+  // shift later entries of the probe run back into the hole, as long as that does not
+  // move an entry in front of its home slot
+  std::uint32_t index = hole;
+  while (true) {
+    index = (index + 1) & mask;
+    if (!slots[index].file)
+      break;
+    std::uint32_t home = hash(slots[index].file, slots[index].pageNo);
+    // distance from home must cover the distance to the hole
+    if (((index - home) & mask) >= ((index - hole) & mask)) {
+      slots[hole] = slots[index];
+      hole = index;
+    }
+  }
+  slots[hole].file = NULL;
+  numEntries--;
+}
+
+}
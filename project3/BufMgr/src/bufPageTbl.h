@@ -0,0 +1,138 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+* @brief One slot of the open-addressing page table. A slot is empty when file is NULL.
+*/
+struct pageTblSlot {
+	/**
+	 * pointer a file object, NULL for an empty slot
+	 */
+	const File *file;
+
+	/**
+	 * page number within a file
+	 */
+	PageId pageNo;
+
+	/**
+	 * frame number of page in the buffer pool
+	 */
+	FrameId frameNo;
+};
+
+
+/**
+* @brief Flat hash table mapping (File, page) to frame for pages in the buffer pool
+*
+* All slots are allocated up front from the number of frames the table has to map, so
+* insert, lookup and remove never allocate. Collisions are resolved by linear probing
+* and removal shifts the following entries back instead of leaving tombstones, which
+* keeps probe sequences short no matter how many pages have passed through the pool.
+* With the table at most half full a lookup normally touches one or two cache lines.
+*
+* @warning This class is not threadsafe.
+*/
+class BufPageTbl
+{
+ private:
+	/**
+	 * Number of slots, always a power of two
+	 */
+  std::uint32_t capacity;
+
+	/**
+	 * capacity - 1, used to wrap slot indexes
+	 */
+  std::uint32_t mask;
+
+	/**
+	 * Maximum number of entries the table was sized for
+	 */
+  std::uint32_t maxEntries;
+
+	/**
+	 * Number of entries currently in the table
+	 */
+  std::uint32_t numEntries;
+
+	/**
+	 * Slot array
+	 */
+  pageTblSlot* slots;
+
+	/**
+	 * returns the home slot of (file, pageNo), between 0 and capacity-1
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  			Slot index.
+	 */
+  std::uint32_t hash(const File* file, const PageId pageNo) const;
+
+	/**
+	 * returns the slot holding (file, pageNo) or capacity if it is not in the table
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  std::uint32_t find(const File* file, const PageId pageNo) const;
+
+ public:
+	/**
+   * Constructor of BufPageTbl class
+	 *
+	 * @param entries Maximum number of pages that will be mapped at once (the number of frames)
+	 */
+	BufPageTbl(const std::uint32_t entries);
+
+	/**
+   * Destructor of BufPageTbl class
+	 */
+  ~BufPageTbl();
+
+	/**
+   * Insert entry into hash table mapping (file, pageNo) to frameNo.
+	 *
+	 * @param file   	File object
+	 * @param pageNo 	Page number in the file
+	 * @param frameNo Frame number assigned to that page of the file
+   * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
+   * @throws  HashTableException if the table already holds as many entries as it was sized for
+	 */
+  void insert(const File* file, const PageId pageNo, const FrameId frameNo);
+
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table). A miss is an ordinary outcome and is reported through the
+   * return value rather than an exception.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, only set if the page was found
+	 * @return  			True if the page entry was found in the hash table
+	 */
+  bool lookup(const File* file, const PageId pageNo, FrameId &frameNo) const;
+
+	/**
+   * Delete entry (file,pageNo) from hash table.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+   * @throws HashNotFoundException if the page entry is not found in the hash table
+	 */
+  void remove(const File* file, const PageId pageNo);
+};
+
+}
@@ -0,0 +1,417 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <memory>
+#include <iostream>
+#include "buffer.h"
+#include "bufReplacer.h"
+
+namespace badgerdb {
+
+const char* policyName(ReplacementPolicy policy)
+{
+	switch (policy) {
+		case CLOCK: return "CLOCK";
+		case LRU_K: return "LRU-2";
+		case TWO_Q: return "2Q";
+		case ARC: return "ARC";
+	}
+	return "UNKNOWN";
+}
+
+//----------------------------------------
+// GhostList
+//----------------------------------------
+
+void GhostList::push(const PageKey& key, std::uint64_t value)
+{
+	std::uint64_t old;
+	take(key, old);
+	if (capacity > 0 && order.size() >= capacity)
+		popOldest();
+	order.push_back(key);
+	index[key] = std::make_pair(--order.end(), value);
+}
+
+bool GhostList::take(const PageKey& key, std::uint64_t& value)
+{
+	KeyMap::iterator it = index.find(key);
+	if (it == index.end())
+		return false;
+	value = it->second.second;
+	order.erase(it->second.first);
+	index.erase(it);
+	return true;
+}
+
+void GhostList::popOldest()
+{
+	if (order.empty())
+		return;
+	index.erase(order.front());
+	order.pop_front();
+}
+
+//----------------------------------------
+// FrameList
+//----------------------------------------
+
+const std::uint32_t FrameList::NIL;
+
+void FrameList::pushBack(std::uint32_t f)
+{
+	prev[f] = tail;
+	next[f] = NIL;
+	if (tail != NIL)
+		next[tail] = f;
+	else
+		head = f;
+	tail = f;
+	count++;
+}
+
+void FrameList::remove(std::uint32_t f)
+{
+	if (prev[f] != NIL)
+		next[prev[f]] = next[f];
+	else
+		head = next[f];
+	if (next[f] != NIL)
+		prev[next[f]] = prev[f];
+	else
+		tail = prev[f];
+	prev[f] = next[f] = NIL;
+	count--;
+}
+
+//----------------------------------------
+// BufReplacer
+//----------------------------------------
+
+BufReplacer* BufReplacer::create(ReplacementPolicy policy, BufDesc* descs,
+		BufFrameMeta* meta, FrameId first, std::uint32_t num)
+{
+	switch (policy) {
+		case LRU_K: return new LruKReplacer(descs, first, num);
+		case TWO_Q: return new TwoQReplacer(descs, first, num);
+		case ARC: return new ArcReplacer(descs, first, num);
+		case CLOCK: break;
+	}
+	return new ClockReplacer(descs, meta, first, num);
+}
+
+BufReplacer::BufReplacer(BufDesc* descs, FrameId first, std::uint32_t num)
+	: bufDescTable(descs), firstFrame(first), numFrames(num)
+{
+}
+
+bool BufReplacer::isPinned(FrameId frame) const
+{
+	return bufDescTable[frame].pinCnt() > 0;
+}
+
+PageKey BufReplacer::keyOf(FrameId frame) const
+{
+	return PageKey(bufDescTable[frame].file, bufDescTable[frame].pageNo);
+}
+
+//----------------------------------------
+// ClockReplacer
+//----------------------------------------
+
+ClockReplacer::ClockReplacer(BufDesc* descs, BufFrameMeta* meta, FrameId first, std::uint32_t num)
+	: BufReplacer(descs, first, num), frameMeta(meta), clockHand(num - 1)
+{
+}
+
+bool ClockReplacer::pickVictim(const File* file, const PageId pageNo, FrameId& frame)
+{
+	// the sweep clears reference bits and skips pinned frames a word of frames at a time
+	std::uint32_t victim;
+	if (!frameMeta->sweep((clockHand + 1) % numFrames, victim))
+		return false;
+	clockHand = victim;
+	frame = firstFrame + victim;
+	return true;
+}
+
+void ClockReplacer::pageAccessed(FrameId frame)
+{
+	frameMeta->reference(frame - firstFrame);
+}
+
+//----------------------------------------
+// ListReplacer
+//----------------------------------------
+
+ListReplacer::ListReplacer(BufDesc* descs, FrameId first, std::uint32_t num)
+	: BufReplacer(descs, first, num)
+{
+	// lowest frame on top of the stack
+	for (std::uint32_t f = num; f > 0; f--)
+		freeFrames.push_back(f - 1);
+}
+
+bool ListReplacer::takeFree(FrameId& frame)
+{
+	if (freeFrames.empty())
+		return false;
+	frame = firstFrame + freeFrames.back();
+	freeFrames.pop_back();
+	return true;
+}
+
+std::uint32_t ListReplacer::oldestUnpinned(const FrameList& list) const
+{
+	std::uint32_t f = list.front();
+	while (f != list.end() && isPinned(firstFrame + f))
+		f = list.after(f);
+	return f;
+}
+
+//----------------------------------------
+// LruKReplacer
+//----------------------------------------
+
+LruKReplacer::LruKReplacer(BufDesc* descs, FrameId first, std::uint32_t num)
+	: ListReplacer(descs, first, num), now(0), history(num * K, 0), retained(num)
+{
+}
+
+bool LruKReplacer::pickVictim(const File* file, const PageId pageNo, FrameId& frame)
+{
+	if (takeFree(frame))
+		return true;
+
+	// the victim has the oldest K-th access, with pages lacking one (time 0) first;
+	// ties go to the least recently used
+	std::uint32_t victim = numFrames;
+	for (std::uint32_t f = 0; f < numFrames; f++) {
+		if (isPinned(firstFrame + f))
+			continue;
+		if (victim == numFrames ||
+				history[f * K + K - 1] < history[victim * K + K - 1] ||
+				(history[f * K + K - 1] == history[victim * K + K - 1] &&
+				 history[f * K] < history[victim * K])) {
+			victim = f;
+		}
+	}
+	if (victim == numFrames)
+		return false;
+
+	retained.push(keyOf(firstFrame + victim), history[victim * K]);
+	for (int i = 0; i < K; i++)
+		history[victim * K + i] = 0;
+	frame = firstFrame + victim;
+	return true;
+}
+
+void LruKReplacer::pageLoaded(FrameId frame, const File* file, const PageId pageNo)
+{
+	std::uint32_t f = frame - firstFrame;
+	std::uint64_t last;
+	if (retained.take(PageKey(file, pageNo), last))
+		history[f * K + 1] = last;
+	history[f * K] = ++now;
+}
+
+void LruKReplacer::pageAccessed(FrameId frame)
+{
+	std::uint32_t f = frame - firstFrame;
+	for (int i = K - 1; i > 0; i--)
+		history[f * K + i] = history[f * K + i - 1];
+	history[f * K] = ++now;
+}
+
+void LruKReplacer::pageRemoved(FrameId frame)
+{
+	std::uint32_t f = frame - firstFrame;
+	for (int i = 0; i < K; i++)
+		history[f * K + i] = 0;
+	freeFrames.push_back(f);
+}
+
+//----------------------------------------
+// TwoQReplacer
+//----------------------------------------
+
+TwoQReplacer::TwoQReplacer(BufDesc* descs, FrameId first, std::uint32_t num)
+	: ListReplacer(descs, first, num),
+		kIn(num / 4 > 0 ? num / 4 : 1),
+		a1in(num), am(num), a1out(num / 2 > 0 ? num / 2 : 1),
+		queueOf(num, NONE)
+{
+}
+
+bool TwoQReplacer::pickVictim(const File* file, const PageId pageNo, FrameId& frame)
+{
+	if (takeFree(frame))
+		return true;
+
+	std::uint32_t f;
+	// reclaim from A1in while it is over its share, then from Am, and from A1in as a
+	// last resort when every page on Am is pinned
+	if (a1in.size() > kIn && (f = oldestUnpinned(a1in)) != a1in.end()) {
+		a1out.push(keyOf(firstFrame + f));
+		a1in.remove(f);
+	}
+	else if ((f = oldestUnpinned(am)) != am.end()) {
+		am.remove(f);
+	}
+	else if ((f = oldestUnpinned(a1in)) != a1in.end()) {
+		a1out.push(keyOf(firstFrame + f));
+		a1in.remove(f);
+	}
+	else {
+		return false;
+	}
+	queueOf[f] = NONE;
+	frame = firstFrame + f;
+	return true;
+}
+
+void TwoQReplacer::pageLoaded(FrameId frame, const File* file, const PageId pageNo)
+{
+	std::uint32_t f = frame - firstFrame;
+	std::uint64_t unused;
+	if (a1out.take(PageKey(file, pageNo), unused)) {
+		am.pushBack(f);
+		queueOf[f] = AM;
+	}
+	else {
+		a1in.pushBack(f);
+		queueOf[f] = A1IN;
+	}
+}
+
+void TwoQReplacer::pageAccessed(FrameId frame)
+{
+	// hits on A1in are deliberately ignored: a page has to come back after leaving
+	// the FIFO to prove it is hot
+	std::uint32_t f = frame - firstFrame;
+	if (queueOf[f] == AM) {
+		am.remove(f);
+		am.pushBack(f);
+	}
+}
+
+void TwoQReplacer::pageRemoved(FrameId frame)
+{
+	std::uint32_t f = frame - firstFrame;
+	if (queueOf[f] == A1IN)
+		a1in.remove(f);
+	else if (queueOf[f] == AM)
+		am.remove(f);
+	queueOf[f] = NONE;
+	freeFrames.push_back(f);
+}
+
+//----------------------------------------
+// ArcReplacer
+//----------------------------------------
+
+ArcReplacer::ArcReplacer(BufDesc* descs, FrameId first, std::uint32_t num)
+	: ListReplacer(descs, first, num), p(0),
+		t1(num), t2(num), b1(num), b2(num),
+		queueOf(num, NONE), loadIntoT2(false)
+{
+}
+
+bool ArcReplacer::evictFrom(FrameList& list, GhostList* ghost, FrameId& frame)
+{
+	std::uint32_t f = oldestUnpinned(list);
+	if (f == list.end())
+		return false;
+	if (ghost)
+		ghost->push(keyOf(firstFrame + f));
+	list.remove(f);
+	queueOf[f] = NONE;
+	frame = firstFrame + f;
+	return true;
+}
+
+bool ArcReplacer::replace(bool inB2, FrameId& frame)
+{
+	if (t1.size() > 0 && (t1.size() > p || (inB2 && t1.size() == p))) {
+		return evictFrom(t1, &b1, frame) || evictFrom(t2, &b2, frame);
+	}
+	return evictFrom(t2, &b2, frame) || evictFrom(t1, &b1, frame);
+}
+
+bool ArcReplacer::pickVictim(const File* file, const PageId pageNo, FrameId& frame)
+{
+	const PageKey key(file, pageNo);
+	std::uint64_t unused;
+
+	loadIntoT2 = false;
+	if (b1.contains(key)) {
+		// recency would have kept this page: grow T1's target
+		std::uint32_t delta = b2.size() > b1.size() ? b2.size() / b1.size() : 1;
+		p = (p + delta < numFrames) ? p + delta : numFrames;
+		b1.take(key, unused);
+		loadIntoT2 = true;
+		return takeFree(frame) || replace(false, frame);
+	}
+	if (b2.contains(key)) {
+		// frequency would have kept this page: shrink T1's target
+		std::uint32_t delta = b1.size() > b2.size() ? b1.size() / b2.size() : 1;
+		p = (p > delta) ? p - delta : 0;
+		b2.take(key, unused);
+		loadIntoT2 = true;
+		return takeFree(frame) || replace(true, frame);
+	}
+
+	// a page not seen recently: keep the directory within 2c entries
+	if (t1.size() + b1.size() >= numFrames) {
+		if (t1.size() < numFrames) {
+			b1.popOldest();
+			return takeFree(frame) || replace(false, frame);
+		}
+		return evictFrom(t1, NULL, frame) || evictFrom(t2, &b2, frame);
+	}
+	if (t1.size() + b1.size() + t2.size() + b2.size() >= 2 * numFrames)
+		b2.popOldest();
+	return takeFree(frame) || replace(false, frame);
+}
+
+void ArcReplacer::pageLoaded(FrameId frame, const File* file, const PageId pageNo)
+{
+	std::uint32_t f = frame - firstFrame;
+	if (loadIntoT2) {
+		t2.pushBack(f);
+		queueOf[f] = T2;
+	}
+	else {
+		t1.pushBack(f);
+		queueOf[f] = T1;
+	}
+	loadIntoT2 = false;
+}
+
+void ArcReplacer::pageAccessed(FrameId frame)
+{
+	std::uint32_t f = frame - firstFrame;
+	if (queueOf[f] == T1)
+		t1.remove(f);
+	else if (queueOf[f] == T2)
+		t2.remove(f);
+	t2.pushBack(f);
+	queueOf[f] = T2;
+}
+
+void ArcReplacer::pageRemoved(FrameId frame)
+{
+	std::uint32_t f = frame - firstFrame;
+	if (queueOf[f] == T1)
+		t1.remove(f);
+	else if (queueOf[f] == T2)
+		t2.remove(f);
+	queueOf[f] = NONE;
+	freeFrames.push_back(f);
+}
+
+}
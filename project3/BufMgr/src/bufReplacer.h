@@ -0,0 +1,429 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+#include "file.h"
+
+namespace badgerdb {
+
+class BufDesc;
+class BufFrameMeta;
+
+/**
+* @brief Page replacement algorithms the buffer manager can run with
+*/
+enum ReplacementPolicy {
+	/**
+	 * Single reference bit clock (second chance)
+	 */
+	CLOCK,
+
+	/**
+	 * LRU-2: evict the page whose second most recent access is oldest
+	 */
+	LRU_K,
+
+	/**
+	 * 2Q: pages seen once live in a small FIFO and only graduate to the LRU queue when re-referenced
+	 */
+	TWO_Q,
+
+	/**
+	 * ARC: adapts the split between recency and frequency lists using ghost hits
+	 */
+	ARC
+};
+
+/**
+* @brief Returns a printable name for the replacement policy
+*/
+const char* policyName(ReplacementPolicy policy);
+
+
+/**
+* @brief Identifies a page that is, or recently was, in the buffer pool
+*/
+typedef std::pair<const File*, PageId> PageKey;
+
+
+/**
+* @brief Bounded list of page keys, oldest first, with lookup by key. Used for the
+* history of recently evicted pages that LRU-K, 2Q and ARC keep.
+*/
+class GhostList
+{
+ private:
+	typedef std::list<PageKey> KeyList;
+	typedef std::map<PageKey, std::pair<KeyList::iterator, std::uint64_t> > KeyMap;
+
+	/**
+	 * Keys from oldest to newest
+	 */
+	KeyList order;
+
+	/**
+	 * Position in order and payload of every key
+	 */
+	KeyMap index;
+
+	/**
+	 * Maximum number of keys kept, 0 for unbounded
+	 */
+	std::size_t capacity;
+
+ public:
+	/**
+   * Constructor of GhostList class
+	 */
+	GhostList(std::size_t cap) : capacity(cap) {}
+
+	/**
+   * Append a key as the newest entry, dropping the oldest one if the list is full
+	 */
+	void push(const PageKey& key, std::uint64_t value = 0);
+
+	/**
+   * Remove key from the list. Returns true and its payload if it was present.
+	 */
+	bool take(const PageKey& key, std::uint64_t& value);
+
+	/**
+   * Returns true if key is in the list
+	 */
+	bool contains(const PageKey& key) const { return index.find(key) != index.end(); }
+
+	/**
+   * Drop the oldest key
+	 */
+	void popOldest();
+
+	/**
+   * Number of keys in the list
+	 */
+	std::size_t size() const { return order.size(); }
+};
+
+
+/**
+* @brief Intrusive doubly linked list over the frames of one partition, least recently
+* queued first. Frames are addressed relative to the partition's first frame.
+*/
+class FrameList
+{
+ private:
+	static const std::uint32_t NIL = 0xffffffff;
+
+	std::vector<std::uint32_t> prev;
+	std::vector<std::uint32_t> next;
+	std::uint32_t head;
+	std::uint32_t tail;
+	std::uint32_t count;
+
+ public:
+	FrameList(std::uint32_t frames)
+		: prev(frames, NIL), next(frames, NIL), head(NIL), tail(NIL), count(0) {}
+
+	/**
+   * Append frame f as the most recently queued entry
+	 */
+	void pushBack(std::uint32_t f);
+
+	/**
+   * Unlink frame f, which must be on this list
+	 */
+	void remove(std::uint32_t f);
+
+	/**
+   * Least recently queued frame, or end() if the list is empty
+	 */
+	std::uint32_t front() const { return head; }
+
+	/**
+   * Frame queued after f, or end()
+	 */
+	std::uint32_t after(std::uint32_t f) const { return next[f]; }
+
+	/**
+   * Marker returned past the last frame
+	 */
+	std::uint32_t end() const { return NIL; }
+
+	/**
+   * Number of frames on the list
+	 */
+	std::uint32_t size() const { return count; }
+};
+
+
+/**
+* @brief Strategy object deciding which frame of a buffer partition to reuse
+*
+* BufMgr owns one replacer per partition and calls it with the partition latch held.
+* It reports every hit through pageAccessed(), every page placed in a frame through
+* pageLoaded() and every frame emptied outside of replacement (disposePage, flushFile)
+* through pageRemoved(). Before a page is loaded, pickVictim() chooses its frame: either
+* a free one or a valid, unpinned one that BufMgr then writes back and clears.
+*
+* @warning This class is not threadsafe.
+*/
+class BufReplacer
+{
+ public:
+	/**
+   * Creates the replacer implementing policy for frames [first, first + num) of descs,
+	 * whose valid, referenced and pinned state is kept in meta
+	 */
+	static BufReplacer* create(ReplacementPolicy policy, BufDesc* descs,
+			BufFrameMeta* meta, FrameId first, std::uint32_t num);
+
+	virtual ~BufReplacer() {}
+
+	/**
+   * Policy implemented by this replacer
+	 */
+	virtual ReplacementPolicy policy() const = 0;
+
+	/**
+	 * Choose the frame the page (file, pageNo) will be loaded into.
+	 *
+	 * @param file   	File of the page about to be loaded
+	 * @param pageNo  Page number of the page about to be loaded
+	 * @param frame   Frame ID of the chosen frame returned via this variable
+	 * @return  			False if every frame of the partition is pinned
+	 */
+	virtual bool pickVictim(const File* file, const PageId pageNo, FrameId& frame) = 0;
+
+	/**
+	 * Page (file, pageNo) has been placed in frame, which pickVictim() returned
+	 */
+	virtual void pageLoaded(FrameId frame, const File* file, const PageId pageNo) = 0;
+
+	/**
+	 * The page in frame was requested again
+	 */
+	virtual void pageAccessed(FrameId frame) = 0;
+
+	/**
+	 * The page in frame has been dropped from the pool and the frame is free
+	 */
+	virtual void pageRemoved(FrameId frame) = 0;
+
+	/**
+	 * Frame at which the next search for a victim will start looking. The background
+	 * writer cleans frames from here on so eviction tends to find them clean.
+	 */
+	virtual FrameId sweepStart() const { return firstFrame; }
+
+ protected:
+	BufReplacer(BufDesc* descs, FrameId first, std::uint32_t num);
+
+	/**
+	 * True if the page in frame is pinned
+	 */
+	bool isPinned(FrameId frame) const;
+
+	/**
+	 * Key of the page held in frame
+	 */
+	PageKey keyOf(FrameId frame) const;
+
+	/**
+	 * Frame descriptors of the whole pool
+	 */
+	BufDesc* bufDescTable;
+
+	/**
+	 * First frame of the partition
+	 */
+	FrameId firstFrame;
+
+	/**
+	 * Number of frames in the partition
+	 */
+	std::uint32_t numFrames;
+};
+
+
+/**
+* @brief Clock replacement over the reference bits, the buffer manager's original algorithm
+*/
+class ClockReplacer : public BufReplacer
+{
+ private:
+	/**
+   * Reference, valid and pin bits of the partition, swept a word at a time
+	 */
+	BufFrameMeta* frameMeta;
+
+	/**
+   * Current position of clockhand, relative to the first frame
+	 */
+	std::uint32_t clockHand;
+
+ public:
+	ClockReplacer(BufDesc* descs, BufFrameMeta* meta, FrameId first, std::uint32_t num);
+	ReplacementPolicy policy() const { return CLOCK; }
+	bool pickVictim(const File* file, const PageId pageNo, FrameId& frame);
+	void pageLoaded(FrameId frame, const File* file, const PageId pageNo) {}
+	void pageAccessed(FrameId frame);
+	void pageRemoved(FrameId frame) {}
+	FrameId sweepStart() const { return firstFrame + (clockHand + 1) % numFrames; }
+};
+
+
+/**
+* @brief Base for replacers that keep free frames on a stack and resident pages on lists
+*/
+class ListReplacer : public BufReplacer
+{
+ protected:
+	/**
+   * Frames not holding a page, relative to the first frame
+	 */
+	std::vector<std::uint32_t> freeFrames;
+
+	ListReplacer(BufDesc* descs, FrameId first, std::uint32_t num);
+
+	/**
+   * Pop a free frame if there is one
+	 */
+	bool takeFree(FrameId& frame);
+
+	/**
+   * Oldest unpinned frame on list, or list.end()
+	 */
+	std::uint32_t oldestUnpinned(const FrameList& list) const;
+};
+
+
+/**
+* @brief LRU-K with K = 2 (O'Neil, O'Neil, Weikum). Evicts the page whose K-th most recent
+* access lies furthest back; pages seen fewer than K times go first, oldest first. The
+* last access time of evicted pages is remembered so a page that returns soon keeps its
+* history.
+*/
+class LruKReplacer : public ListReplacer
+{
+ private:
+	static const int K = 2;
+
+	/**
+   * Logical clock, advanced on every access
+	 */
+	std::uint64_t now;
+
+	/**
+   * Access times per frame, most recent first; 0 means no such access
+	 */
+	std::vector<std::uint64_t> history;
+
+	/**
+   * Last access time of recently evicted pages
+	 */
+	GhostList retained;
+
+ public:
+	LruKReplacer(BufDesc* descs, FrameId first, std::uint32_t num);
+	ReplacementPolicy policy() const { return LRU_K; }
+	bool pickVictim(const File* file, const PageId pageNo, FrameId& frame);
+	void pageLoaded(FrameId frame, const File* file, const PageId pageNo);
+	void pageAccessed(FrameId frame);
+	void pageRemoved(FrameId frame);
+};
+
+
+/**
+* @brief Full 2Q (Johnson and Shasha). First-time pages enter the FIFO A1in; when they
+* are evicted their key moves to the ghost FIFO A1out, and only pages found there on a
+* later miss are admitted to the LRU queue Am.
+*/
+class TwoQReplacer : public ListReplacer
+{
+ private:
+	enum Queue { NONE, A1IN, AM };
+
+	/**
+   * Target size of A1in
+	 */
+	std::uint32_t kIn;
+
+	FrameList a1in;
+	FrameList am;
+	GhostList a1out;
+
+	/**
+   * Queue each frame is on
+	 */
+	std::vector<Queue> queueOf;
+
+ public:
+	TwoQReplacer(BufDesc* descs, FrameId first, std::uint32_t num);
+	ReplacementPolicy policy() const { return TWO_Q; }
+	bool pickVictim(const File* file, const PageId pageNo, FrameId& frame);
+	void pageLoaded(FrameId frame, const File* file, const PageId pageNo);
+	void pageAccessed(FrameId frame);
+	void pageRemoved(FrameId frame);
+};
+
+
+/**
+* @brief Adaptive Replacement Cache (Megiddo and Modha). T1 holds pages seen once
+* recently, T2 pages seen at least twice; ghost lists B1 and B2 remember what each
+* evicted, and hits on them move the target size p of T1.
+*/
+class ArcReplacer : public ListReplacer
+{
+ private:
+	enum Queue { NONE, T1, T2 };
+
+	/**
+   * Target size of T1
+	 */
+	std::uint32_t p;
+
+	FrameList t1;
+	FrameList t2;
+	GhostList b1;
+	GhostList b2;
+
+	/**
+   * List each frame is on
+	 */
+	std::vector<Queue> queueOf;
+
+	/**
+   * Whether the page being loaded was found on a ghost list and goes to T2
+	 */
+	bool loadIntoT2;
+
+	/**
+   * Evict from T1 or T2 as ARC's REPLACE, falling back to the other list if every frame
+	 * on the preferred one is pinned
+	 */
+	bool replace(bool inB2, FrameId& frame);
+
+	/**
+   * Evict the oldest unpinned frame of list, remembering its key on ghost if given
+	 */
+	bool evictFrom(FrameList& list, GhostList* ghost, FrameId& frame);
+
+ public:
+	ArcReplacer(BufDesc* descs, FrameId first, std::uint32_t num);
+	ReplacementPolicy policy() const { return ARC; }
+	bool pickVictim(const File* file, const PageId pageNo, FrameId& frame);
+	void pageLoaded(FrameId frame, const File* file, const PageId pageNo);
+	void pageAccessed(FrameId frame);
+	void pageRemoved(FrameId frame);
+};
+
+}
@@ -7,181 +7,327 @@
 
 #include <memory>
 #include <iostream>
+#include <cstdint>
+#include <chrono>
+#include <utility>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/badgerdb_exception.h"
 
 using namespace std;
 namespace badgerdb { 
 
-	BufMgr::BufMgr(std::uint32_t bufs)
-		: numBufs(bufs) {
+	/**
+	 * First word of a buffer manifest
+	 */
+	static const std::uint32_t MANIFEST_MAGIC = 0x4d424442;
+
+	/**
+	 * Most pages preload() reads in one sequential pass
+	 */
+	static const std::uint32_t MAX_PRELOAD_RUN = 64;
+
+	/**
+	 * Most unwanted pages preload() reads through to keep a run going; reading a few
+	 * pages more is cheaper than another seek
+	 */
+	static const std::uint32_t MAX_PRELOAD_GAP = 4;
+
+	/**
+	 * A page listed in a manifest, for a file preload() was given
+	 */
+	struct ManifestEntry
+	{
+		File* file;
+		PageId pageNo;
+		std::uint32_t accessCnt;
+	};
+
+	static bool moreAccessed(const ManifestEntry& a, const ManifestEntry& b)
+	{
+		return a.accessCnt > b.accessCnt;
+	}
+
+	static bool beforeOnDisk(const ManifestEntry& a, const ManifestEntry& b)
+	{
+		if (a.file != b.file)
+			return a.file < b.file;
+		return a.pageNo < b.pageNo;
+	}
+
+	static void writeWord(std::ostream& out, const std::uint32_t word)
+	{
+		out.write(reinterpret_cast<const char*>(&word), sizeof(word));
+	}
+
+	static bool readWord(std::istream& in, std::uint32_t& word)
+	{
+		return (bool) in.read(reinterpret_cast<char*>(&word), sizeof(word));
+	}
+
+	/**
+	 * Nanoseconds elapsed since start
+	 */
+	static std::uint64_t nanosSince(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	BufMgr::BufMgr(std::uint32_t bufs, std::uint32_t parts, ReplacementPolicy policy)
+		: numBufs(bufs), writerRunning(false), lowWater(0), highWater(0), writerInterval(0) {
 			bufDescTable = new BufDesc[bufs];
 
+			bufPool = new Page*[bufs];
 			for (FrameId i = 0; i < bufs; i++) 
 			{
-				bufDescTable[i].frameNo = i;
-				bufDescTable[i].valid = false;
+				bufPool[i] = new Page();
 			}
+			bufStats.policy = policy;
 
-			bufPool = new Page[bufs];
+			// every partition needs at least one frame
+			numPartitions = (parts == 0) ? 1 : parts;
+			if (numPartitions > bufs)
+				numPartitions = bufs;
+			partitions = new BufPartition[numPartitions];
+			for (std::uint32_t p = 0; p < numPartitions; p++)
+				partitions[p].stats.policy = policy;
 
-			int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-			hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+			layoutPartitions();
+		}
 
-			clockHand = bufs - 1;
+	std::uint32_t BufMgr::partitionSize(const std::uint32_t bufs, const std::uint32_t p) const
+	{
+		// consecutive frame ranges, spreading the remainder over the first partitions
+		return bufs / numPartitions + (p < bufs % numPartitions ? 1 : 0);
+	}
+
+	void BufMgr::layoutPartitions()
+	{
+		FrameId first = 0;
+		for (std::uint32_t p = 0; p < numPartitions; p++)
+		{
+			BufPartition& part = partitions[p];
+			part.firstFrame = first;
+			part.numFrames = partitionSize(numBufs, p);
+
+			delete part.replacer;
+			delete part.frameMeta;
+			delete part.hashTable;
+
+			part.frameMeta = new BufFrameMeta(part.numFrames);
+			for (std::uint32_t k = 0; k < part.numFrames; k++)
+			{
+				bufDescTable[first + k].frameNo = first + k;
+				bufDescTable[first + k].meta = part.frameMeta;
+				bufDescTable[first + k].slot = k;
+				bufDescTable[first + k].Clear();
+			}
+			part.replacer = BufReplacer::create(bufStats.policy, bufDescTable, part.frameMeta, first, part.numFrames);
+
+			part.hashTable = new BufPageTbl (part.numFrames);  // allocate the partition's hash table
+
+			first += part.numFrames;
 		}
+	}
 
 
 	BufMgr::~BufMgr() {
+		stopBackgroundWriter();
+		if (!manifestPath.empty()) {
+			try {
+				saveManifest(manifestPath);
+			}
+			catch (BadgerDbException e) {
+				// the next start is merely cold
+			}
+		}
 		for(uint32_t i = 0; i < numBufs; i++){
-			BufDesc b = bufDescTable[i];
-			if (b.dirty && b.valid) {
-				b.file->writePage(bufPool[b.frameNo]);
+			BufDesc& b = bufDescTable[i];
+			if (b.dirty && b.valid()) {
+				b.file->writePage(*bufPool[b.frameNo]);
 			}
 		}	
+		for (uint32_t i = 0; i < numBufs; i++)
+			delete bufPool[i];
 		delete [] bufPool;
 		delete [] bufDescTable;
-		delete hashTable;
+		delete [] partitions;
 	}
 
-	void BufMgr::advanceClock()
+	BufPartition& BufMgr::partitionOf(const File* file, const PageId pageNo)
 	{
-		clockHand = (clockHand+1)%numBufs;	
+		// mix both halves of the key so that consecutive pages of one file spread over all partitions
+		std::uint64_t key = (std::uint64_t) reinterpret_cast<std::uintptr_t>(file);
+		key ^= (std::uint64_t) pageNo * 0x9E3779B97F4A7C15ULL;
+		key ^= key >> 32;
+		return partitions[key % numPartitions];
 	}
 
-	void BufMgr::allocBuf(FrameId & frame) 
+	std::unique_lock<std::mutex> BufMgr::lockPartition(BufPartition& part)
 	{
-		uint32_t num_pinned = 0;
-		uint32_t orig_clockHand = clockHand;
-		bool found = false;
-		BufDesc b;
+		std::unique_lock<std::mutex> guard(part.latch, std::try_to_lock);
+		if (!guard.owns_lock()) {
+			guard.lock();
+			part.stats.latchwaits++;
+		}
+		return guard;
+	}
 
-		advanceClock();
+	FileStats& BufMgr::fileStatsOf(BufPartition& part, const File* file)
+	{
+		FileStats& fileStats = part.stats.files[file->id()];
+		if (fileStats.name.empty())
+			fileStats.name = file->filename();
+		return fileStats;
+	}
 
-		// exit the loop if we found a good frame to use
-		// or all frames are already pinned
-		while (num_pinned < numBufs && !found) {
-			// need to clear pinned counter if we cycle back to origin
-			if (clockHand == orig_clockHand) {
-				num_pinned = 0;
-			}
-			b = bufDescTable[clockHand];
-			// if the frame is invalid, just use it
-			if (!b.valid) {
-				frame = b.frameNo;
-				found = true;
-			}
-			// if the frame is valid, but the refbit is set
-			// clear refbit and advance clock hand
-			else if (b.refbit) {
-				bufDescTable[clockHand].refbit = false;
-				advanceClock();
-			}
-			// if the frame is valid and refbit is not set, but the pin count is not 0
-			// the frame is currently pinned so cannot be used, advance clock hand
-			// also increment counter for total # of pinned frames
-			else if (b.pinCnt > 0) {
-				advanceClock();
-				num_pinned++;
+	void BufMgr::allocBuf(BufPartition& part, const File* file, const PageId pageNo, FrameId & frame) 
+	{
+		// not found means every frame of the partition is pinned
+		if (!part.replacer->pickVictim(file, pageNo, frame)) {
+			part.stats.fullpool++;
+			throw BufferExceededException();
+		}
+
+		BufDesc& b = bufDescTable[frame];
+		// a valid victim is written to disk if dirty, then cleared for our use
+		if (b.valid()) {
+			if (b.dirty) {
+				// flush page to disk
+				std::lock_guard<std::mutex> io(ioLatch);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				b.file->writePage(*bufPool[frame]);
+				part.stats.writeLatency.record(nanosSince(start));
+				part.stats.diskwrites++;
+				part.stats.fgwrites++;
+				part.stats.dirtyevictions++;
+				// the writer is falling behind, don't wait for its next pass
+				writerWakeup.notify_one();
 			}
-			// the frame is valid, and neither referenced nor pinned
-			// use this frame, write it to disk if dirty bit is set, then clear the frame for our use
 			else {
-				if (b.dirty) {
-					// flush page to disk
-					bufDescTable[clockHand].file->writePage(bufPool[b.frameNo]);
-				}
-				// remove the frame from hash table
-				hashTable->remove(b.file, b.pageNo);
-				// clear the frame in buffer
-				bufDescTable[clockHand].Clear();
-				// return the frame number
-				frame = b.frameNo;
-				found = true;
+				part.stats.cleanevictions++;
 			}
+			// remove the frame from hash table
+			part.hashTable->remove(b.file, b.pageNo);
+			// clear the frame in buffer
+			b.Clear();
 		}
-		// not found means the buffer is full
-		if (!found)
-			throw BufferExceededException();
 	}
 
 
 	void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 	{
 		FrameId frameNo;
-		try {
-			// look up the desired page in hashtable
-			hashTable->lookup(file, pageNo, frameNo);
-			// found the page in hash table, set refbit to true
-			bufDescTable[frameNo].refbit = true;
+		BufPartition& part = partitionOf(file, pageNo);
+		std::unique_lock<std::mutex> guard = lockPartition(part);
+		part.stats.accesses++;
+		// look up the desired page in hashtable
+		if (part.hashTable->lookup(file, pageNo, frameNo)) {
+			part.stats.hits++;
+			BufDesc& frame = bufDescTable[frameNo];
+			if (frame.fileStats == NULL)
+				frame.fileStats = &fileStatsOf(part, file);
+			frame.fileStats->hits++;
+			bufDescTable[frameNo].accessCnt++;
+			// found the page in hash table, let the replacer know it was referenced
+			part.replacer->pageAccessed(frameNo);
 			// increment pin count
-			bufDescTable[frameNo].pinCnt++;
+			bufDescTable[frameNo].meta->pin(bufDescTable[frameNo].slot);
 			// return the page by reference     
-			page = &bufPool[frameNo];
-		}
-		catch (HashNotFoundException h) {
-			// the page is not in hashtable, which indicates a buffer miss
-			// so we need to read from the disk
-			Page p = file->readPage(pageNo);
-			// allocate a buffer frame to place the page
-			// ATTENTION: this line may throw BufferExceededException
-			allocBuf(frameNo);
-			// add the page to buffer pool
-			bufPool[frameNo] = p;
-			// insert a record in hash table
-			hashTable->insert(file, pageNo, frameNo);
-			// set the appropriate frame attributes (pinCnt=1, valid=1, refbit=1, dirty=0)
-			bufDescTable[frameNo].Set(file, pageNo);
-			// return the page by reference
-			page = &bufPool[frameNo];
-		}
-							
+			page = bufPool[frameNo];
+			return;
+		}
+
+		// the page is not in hashtable, which indicates a buffer miss
+		// allocate a buffer frame to place the page
+		// ATTENTION: this line may throw BufferExceededException
+		allocBuf(part, file, pageNo, frameNo);
+		// read the page from disk straight into the frame
+		try {
+			std::lock_guard<std::mutex> io(ioLatch);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			file->readPage(pageNo, *bufPool[frameNo]);
+			part.stats.readLatency.record(nanosSince(start));
+		}
+		catch (InvalidPageException e) {
+			// the frame was emptied for nothing, hand it back to the replacer
+			part.replacer->pageRemoved(frameNo);
+			throw;
+		}
+		part.stats.diskreads++;
+		part.stats.misses++;
+		// insert a record in hash table
+		part.hashTable->insert(file, pageNo, frameNo);
+		// set the appropriate frame attributes (pinCnt=1, valid=1, refbit=1, dirty=0)
+		bufDescTable[frameNo].Set(file, pageNo);
+		bufDescTable[frameNo].fileStats = &fileStatsOf(part, file);
+		bufDescTable[frameNo].fileStats->misses++;
+		part.replacer->pageLoaded(frameNo, file, pageNo);
+		// return the page by reference
+		page = bufPool[frameNo];
 	}
 
 	void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
 		FrameId frameNo;
-		// look up hashtable
-		// ATTENTION: this line might throw BufferExceededException
-		hashTable->lookup(file, pageNo, frameNo);
+		BufPartition& part = partitionOf(file, pageNo);
+		std::unique_lock<std::mutex> guard = lockPartition(part);
+		// look up hashtable, unpinning a page that is not in the pool is an error
+		if (!part.hashTable->lookup(file, pageNo, frameNo))
+			throw HashNotFoundException(file->filename(), pageNo);
 		// find this frame in bufDescTable
-		BufDesc frame = bufDescTable[frameNo];
+		BufDesc& frame = bufDescTable[frameNo];
 		// if this page is already unpinned, throw exception
-		if (frame.pinCnt <= 0) 
+		if (frame.pinCnt() == 0) 
 			throw PageNotPinnedException(file->filename(), pageNo, frameNo);
 		// set the dirty bit if we need to
 		if (dirty) 
-			bufDescTable[frameNo].dirty = true;
+			frame.dirty = true;
 		// decrement pin count
-		bufDescTable[frameNo].pinCnt--;	
+		frame.meta->unpin(frame.slot);
 	}
 
 	void BufMgr::flushFile(const File* file){
-		// traverse the buffer
-		for(uint32_t i = 0; i < numBufs; i++){
-			BufDesc frame = bufDescTable[i];
-			// if the current frame belongs to the desired file
-			if (frame.file == file ) {
-				// if the frame is not valid, throw BadBufferException
-				if (!frame.valid) 
-					throw BadBufferException(frame.frameNo, frame.dirty, frame.valid, frame.refbit);
-				// if the frame is pinned, throw PagePinnedException
-				if (frame.pinCnt > 0) 
-					throw PagePinnedException(file->filename(), frame.pageNo, frame.frameNo);
-				// if the frame is dirty, write it to disk, then set dirty to false
-				if (frame.dirty) {
-					Page p = bufPool[frame.frameNo];
-					bufDescTable[i].file->writePage(p);
-					bufDescTable[i].dirty = false;
-				}
-				// remove the page from hashtable
-				hashTable->remove(file, frame.pageNo);
-				// clear the buffer frame
-				bufDescTable[i].Clear();
-			} 
+		// traverse the buffer one partition at a time
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			BufPartition& part = partitions[p];
+			std::lock_guard<std::mutex> guard(part.latch);
+			for (FrameId i = part.firstFrame; i < part.firstFrame + part.numFrames; i++) {
+				BufDesc& frame = bufDescTable[i];
+				// if the current frame belongs to the desired file
+				if (frame.file == file ) {
+					// if the frame is not valid, throw BadBufferException
+					if (!frame.valid()) 
+						throw BadBufferException(frame.frameNo, frame.dirty, frame.valid(), frame.refbit());
+					// if the frame is pinned, throw PagePinnedException
+					if (frame.pinCnt() > 0) 
+						throw PagePinnedException(file->filename(), frame.pageNo, frame.frameNo);
+					// if the frame is dirty, write it to disk, then set dirty to false
+					if (frame.dirty) {
+						std::lock_guard<std::mutex> io(ioLatch);
+						std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+						bufDescTable[i].file->writePage(*bufPool[frame.frameNo]);
+						part.stats.writeLatency.record(nanosSince(start));
+						bufDescTable[i].dirty = false;
+						part.stats.diskwrites++;
+					}
+					// remove the page from hashtable
+					part.hashTable->remove(file, frame.pageNo);
+					part.replacer->pageRemoved(i);
+					// clear the buffer frame
+					bufDescTable[i].Clear();
+				} 
+			}
 		}
 
 	}
@@ -190,35 +336,529 @@ namespace badgerdb {
 	{	
 		FrameId frameNo;
 		// allocate a new page in file
-		Page p = file->allocatePage();
+		Page p;
+		{
+			std::lock_guard<std::mutex> io(ioLatch);
+			p = file->allocatePage();
+		}
+		// p is moved from below, keep its number
+		const PageId newPageNo = p.page_number();
+		BufPartition& part = partitionOf(file, newPageNo);
+		std::unique_lock<std::mutex> guard = lockPartition(part);
+		part.stats.accesses++;
+		part.stats.diskreads++;
+		part.stats.allocs++;
 		// allocate a buffer frame
 		// ATTENTION: this line might throw BufferExceededException
-		allocBuf(frameNo);
-		// put the new page in buffer
-		bufPool[frameNo] = p;
+		allocBuf(part, file, newPageNo, frameNo);
+		// put the new page in buffer, taking over its storage instead of copying it
+		*bufPool[frameNo] = std::move(p);
 		// insert a new entry in hashtable
-		hashTable->insert(file, p.page_number(), frameNo);
+		part.hashTable->insert(file, newPageNo, frameNo);
 		// call Set()
-		bufDescTable[frameNo].Set(file, p.page_number());
+		bufDescTable[frameNo].Set(file, newPageNo);
+		part.replacer->pageLoaded(frameNo, file, newPageNo);
 		// set return values
-		pageNo = p.page_number();
-		page = &bufPool[frameNo];
+		pageNo = newPageNo;
+		page = bufPool[frameNo];
 	}
 
 	void BufMgr::disposePage(File* file, const PageId PageNo)
 	{
 		FrameId frameNo;
-		// try to find the page in hash table
-		// ATTENTION: this line might throw HashNotFoundException
-		hashTable->lookup(file,PageNo,frameNo);
-		// remove the hash table record
-		hashTable->remove(file,PageNo);
-		// clear the corresponding buffer frame
-		bufDescTable[frameNo].Clear();
+		{
+			BufPartition& part = partitionOf(file, PageNo);
+			std::unique_lock<std::mutex> guard = lockPartition(part);
+			// try to find the page in hash table, disposing a page that is not in the pool is an error
+			if (!part.hashTable->lookup(file,PageNo,frameNo))
+				throw HashNotFoundException(file->filename(), PageNo);
+			// remove the hash table record
+			part.hashTable->remove(file,PageNo);
+			part.replacer->pageRemoved(frameNo);
+			// clear the corresponding buffer frame
+			bufDescTable[frameNo].Clear();
+		}
 		// delete this page on disk
+		std::lock_guard<std::mutex> io(ioLatch);
 		file->deletePage(PageNo);
 	}
 
+	void BufMgr::startBackgroundWriter(double low, double high, std::uint32_t interval)
+	{
+		std::lock_guard<std::mutex> guard(writerLatch);
+		if (writerRunning)
+			return;
+		lowWater = low;
+		highWater = high;
+		writerInterval = interval;
+		writerRunning = true;
+		writer = std::thread(&BufMgr::writerLoop, this);
+	}
+
+	void BufMgr::stopBackgroundWriter()
+	{
+		{
+			std::lock_guard<std::mutex> guard(writerLatch);
+			if (!writerRunning)
+				return;
+			writerRunning = false;
+		}
+		writerWakeup.notify_one();
+		writer.join();
+	}
+
+	void BufMgr::writerLoop()
+	{
+		std::unique_lock<std::mutex> lock(writerLatch);
+		while (writerRunning) {
+			writerWakeup.wait_for(lock, std::chrono::milliseconds(writerInterval));
+			if (!writerRunning)
+				break;
+			// don't hold up stopBackgroundWriter() while writing
+			lock.unlock();
+			for (std::uint32_t p = 0; p < numPartitions; p++)
+				cleanPartition(partitions[p]);
+			lock.lock();
+		}
+	}
+
+	void BufMgr::cleanPartition(BufPartition& part)
+	{
+		std::unique_lock<std::mutex> guard(part.latch);
+		std::uint32_t dirty = 0;
+		for (FrameId i = part.firstFrame; i < part.firstFrame + part.numFrames; i++)
+			if (bufDescTable[i].valid() && bufDescTable[i].dirty)
+				dirty++;
+		if (dirty <= highWater * part.numFrames)
+			return;
+
+		// walk the frames in the order the replacer is going to reach them
+		FrameId start = part.replacer->sweepStart() - part.firstFrame;
+		for (std::uint32_t k = 0; k < part.numFrames && dirty > lowWater * part.numFrames; k++) {
+			FrameId i = part.firstFrame + (start + k) % part.numFrames;
+			BufDesc& frame = bufDescTable[i];
+			// pinned pages may be changing under us, leave them to their owner
+			if (!frame.valid() || !frame.dirty || frame.pinCnt() > 0)
+				continue;
+			{
+				std::lock_guard<std::mutex> io(ioLatch);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				frame.file->writePage(*bufPool[i]);
+				part.stats.writeLatency.record(nanosSince(start));
+			}
+			frame.dirty = false;
+			dirty--;
+			part.stats.diskwrites++;
+			part.stats.bgwrites++;
+			// let foreground threads into the partition between writes
+			guard.unlock();
+			guard.lock();
+		}
+	}
+
+	void BufMgr::resize(std::uint32_t newBufs)
+	{
+		// every partition keeps at least one frame
+		if (newBufs < numPartitions)
+			newBufs = numPartitions;
+
+		// nobody may look at a frame while pages move; the background writer waits too
+		std::vector<std::unique_lock<std::mutex> > locks;
+		for (std::uint32_t p = 0; p < numPartitions; p++)
+			locks.push_back(std::unique_lock<std::mutex>(partitions[p].latch));
+
+		// decide what each partition keeps before changing anything, so a pool that cannot
+		// hold the pinned pages is left as it was
+		std::vector<bool> evict(numBufs, false);
+		std::vector<std::vector<FrameId> > resident(numPartitions);
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			BufPartition& part = partitions[p];
+			std::uint32_t newNum = partitionSize(newBufs, p);
+			std::uint32_t pinned = 0;
+
+			// resident pages in the order the replacer is going to reach them
+			FrameId start = part.replacer->sweepStart() - part.firstFrame;
+			for (std::uint32_t k = 0; k < part.numFrames; k++) {
+				FrameId i = part.firstFrame + (start + k) % part.numFrames;
+				if (!bufDescTable[i].valid())
+					continue;
+				resident[p].push_back(i);
+				if (bufDescTable[i].pinCnt() > 0)
+					pinned++;
+			}
+			if (pinned > newNum) {
+				part.stats.fullpool++;
+				throw BufferExceededException();
+			}
+
+			// shed the unpinned pages that were not referenced lately first, then any unpinned
+			std::uint32_t excess = resident[p].size() > newNum ? resident[p].size() - newNum : 0;
+			for (int pass = 0; pass < 2 && excess > 0; pass++) {
+				for (std::size_t k = 0; k < resident[p].size() && excess > 0; k++) {
+					BufDesc& frame = bufDescTable[resident[p][k]];
+					if (evict[frame.frameNo] || frame.pinCnt() > 0 || (pass == 0 && frame.refbit()))
+						continue;
+					evict[frame.frameNo] = true;
+					excess--;
+				}
+			}
+		}
+
+		// write back what is evicted
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			for (std::size_t k = 0; k < resident[p].size(); k++) {
+				BufDesc& frame = bufDescTable[resident[p][k]];
+				if (!evict[frame.frameNo])
+					continue;
+				if (!frame.dirty) {
+					partitions[p].stats.cleanevictions++;
+					continue;
+				}
+				{
+					std::lock_guard<std::mutex> io(ioLatch);
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					frame.file->writePage(*bufPool[frame.frameNo]);
+					partitions[p].stats.writeLatency.record(nanosSince(start));
+				}
+				frame.dirty = false;
+				partitions[p].stats.diskwrites++;
+				partitions[p].stats.dirtyevictions++;
+			}
+		}
+
+		// remember the state of the pages that stay, their metadata goes with the old layout
+		struct MovedPage {
+			File* file;
+			PageId pageNo;
+			bool dirty;
+			std::uint32_t accessCnt;
+			std::uint32_t pins;
+			bool referenced;
+			Page* page;
+		};
+		std::vector<std::vector<MovedPage> > moved(numPartitions);
+		std::vector<bool> carried(numBufs, false);
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			for (std::size_t k = 0; k < resident[p].size(); k++) {
+				FrameId i = resident[p][k];
+				if (evict[i])
+					continue;
+				BufDesc& frame = bufDescTable[i];
+				MovedPage m = {frame.file, frame.pageNo, frame.dirty, frame.accessCnt, frame.pinCnt(), frame.refbit(), bufPool[i]};
+				moved[p].push_back(m);
+				carried[i] = true;
+			}
+		}
+
+		// page buffers of evicted and empty frames are handed to the new empty frames
+		std::vector<Page*> spare;
+		for (FrameId i = 0; i < numBufs; i++)
+			if (!carried[i])
+				spare.push_back(bufPool[i]);
+
+		BufDesc* oldDescs = bufDescTable;
+		Page** oldPool = bufPool;
+		bufDescTable = new BufDesc[newBufs];
+		bufPool = new Page*[newBufs];
+		for (FrameId i = 0; i < newBufs; i++)
+			bufPool[i] = NULL;
+		numBufs = newBufs;
+		layoutPartitions();
+		delete [] oldDescs;
+		delete [] oldPool;
+
+		// load the pages that stay through the new replacers, in the order the old ones
+		// would have evicted them. Pinned pages keep their Page, and with it their address.
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			BufPartition& part = partitions[p];
+			for (std::size_t k = 0; k < moved[p].size(); k++) {
+				const MovedPage& m = moved[p][k];
+				FrameId frameNo;
+				part.replacer->pickVictim(m.file, m.pageNo, frameNo);
+				bufPool[frameNo] = m.page;
+				part.hashTable->insert(m.file, m.pageNo, frameNo);
+				bufDescTable[frameNo].Set(m.file, m.pageNo);
+				bufDescTable[frameNo].dirty = m.dirty;
+				bufDescTable[frameNo].accessCnt = m.accessCnt;
+				part.frameMeta->restore(bufDescTable[frameNo].slot, m.pins, m.referenced);
+				part.replacer->pageLoaded(frameNo, m.file, m.pageNo);
+			}
+		}
+
+		for (FrameId i = 0; i < numBufs; i++) {
+			if (bufPool[i] != NULL)
+				continue;
+			if (!spare.empty()) {
+				bufPool[i] = spare.back();
+				spare.pop_back();
+			}
+			else {
+				bufPool[i] = new Page();
+			}
+		}
+		for (std::size_t k = 0; k < spare.size(); k++)
+			delete spare[k];
+	}
+
+	void BufMgr::saveManifest(const std::string& path)
+	{
+		// resident pages grouped by file name, each file's pages in page order
+		std::map<std::string, std::map<PageId, std::uint32_t> > resident;
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			BufPartition& part = partitions[p];
+			std::lock_guard<std::mutex> guard(part.latch);
+			for (FrameId i = part.firstFrame; i < part.firstFrame + part.numFrames; i++) {
+				BufDesc& frame = bufDescTable[i];
+				if (frame.valid())
+					resident[frame.file->filename()][frame.pageNo] = frame.accessCnt;
+			}
+		}
+
+		std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+		writeWord(out, MANIFEST_MAGIC);
+		writeWord(out, resident.size());
+		std::map<std::string, std::map<PageId, std::uint32_t> >::const_iterator f;
+		for (f = resident.begin(); f != resident.end(); ++f) {
+			writeWord(out, f->first.size());
+			out.write(f->first.data(), f->first.size());
+			writeWord(out, f->second.size());
+			std::map<PageId, std::uint32_t>::const_iterator e;
+			for (e = f->second.begin(); e != f->second.end(); ++e) {
+				writeWord(out, e->first);
+				writeWord(out, e->second);
+			}
+		}
+		out.close();
+		if (!out)
+			throw BadgerDbException("Cannot write buffer manifest " + path);
+	}
+
+	std::uint32_t BufMgr::preload(const std::string& path, const std::vector<File*>& files)
+	{
+		std::ifstream in(path.c_str(), std::ios::binary);
+		std::uint32_t magic, numFiles;
+		if (!readWord(in, magic) || magic != MANIFEST_MAGIC || !readWord(in, numFiles))
+			return 0;
+
+		std::vector<ManifestEntry> entries;
+		for (std::uint32_t f = 0; f < numFiles; f++) {
+			std::uint32_t nameLen, numPages;
+			if (!readWord(in, nameLen))
+				return 0;
+			std::string name(nameLen, '\0');
+			if (!in.read(&name[0], nameLen) || !readWord(in, numPages))
+				return 0;
+			File* file = NULL;
+			for (std::size_t k = 0; k < files.size(); k++)
+				if (files[k]->filename() == name)
+					file = files[k];
+			for (std::uint32_t k = 0; k < numPages; k++) {
+				ManifestEntry entry = {file, 0, 0};
+				if (!readWord(in, entry.pageNo) || !readWord(in, entry.accessCnt))
+					return 0;
+				if (file != NULL)
+					entries.push_back(entry);
+			}
+		}
+
+		// the most accessed pages first, as many as each partition has free frames for
+		std::vector<std::uint32_t> room(numPartitions, 0);
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			BufPartition& part = partitions[p];
+			std::lock_guard<std::mutex> guard(part.latch);
+			for (FrameId i = part.firstFrame; i < part.firstFrame + part.numFrames; i++)
+				if (!bufDescTable[i].valid())
+					room[p]++;
+		}
+		std::stable_sort(entries.begin(), entries.end(), moreAccessed);
+		std::vector<ManifestEntry> chosen;
+		for (std::size_t k = 0; k < entries.size(); k++) {
+			std::uint32_t p = &partitionOf(entries[k].file, entries[k].pageNo) - partitions;
+			if (room[p] > 0) {
+				room[p]--;
+				chosen.push_back(entries[k]);
+			}
+		}
+
+		// then read them in file order, a run of nearby pages per sequential read
+		std::sort(chosen.begin(), chosen.end(), beforeOnDisk);
+		std::vector<Page> run(MAX_PRELOAD_RUN);
+		std::uint32_t loaded = 0;
+		std::size_t i = 0;
+		while (i < chosen.size()) {
+			const ManifestEntry& first = chosen[i];
+			std::size_t j = i + 1;
+			while (j < chosen.size() && chosen[j].file == first.file &&
+					chosen[j].pageNo - chosen[j - 1].pageNo <= MAX_PRELOAD_GAP + 1 &&
+					chosen[j].pageNo - first.pageNo < MAX_PRELOAD_RUN)
+				j++;
+
+			try {
+				std::lock_guard<std::mutex> io(ioLatch);
+				first.file->readPages(first.pageNo, chosen[j - 1].pageNo - first.pageNo + 1, &run[0]);
+			}
+			catch (InvalidPageException e) {
+				// the file has shrunk since the manifest was written
+				i = j;
+				continue;
+			}
+
+			for (std::size_t k = i; k < j; k++) {
+				Page& page = run[chosen[k].pageNo - first.pageNo];
+				// skip pages disposed of since the manifest was written
+				if (page.page_number() != chosen[k].pageNo)
+					continue;
+				BufPartition& part = partitionOf(chosen[k].file, chosen[k].pageNo);
+				std::lock_guard<std::mutex> guard(part.latch);
+				FrameId frameNo;
+				if (part.hashTable->lookup(chosen[k].file, chosen[k].pageNo, frameNo))
+					continue;
+				try {
+					allocBuf(part, chosen[k].file, chosen[k].pageNo, frameNo);
+				}
+				catch (BufferExceededException e) {
+					continue;
+				}
+				*bufPool[frameNo] = std::move(page);
+				part.stats.diskreads++;
+				part.hashTable->insert(chosen[k].file, chosen[k].pageNo, frameNo);
+				BufDesc& frame = bufDescTable[frameNo];
+				frame.Set(chosen[k].file, chosen[k].pageNo);
+				frame.accessCnt = chosen[k].accessCnt;
+				part.replacer->pageLoaded(frameNo, chosen[k].file, chosen[k].pageNo);
+				frame.meta->unpin(frame.slot);
+				loaded++;
+			}
+			i = j;
+		}
+		return loaded;
+	}
+
+	BufStats& BufMgr::getBufStats()
+	{
+		bufStats.clear();
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			std::lock_guard<std::mutex> guard(partitions[p].latch);
+			bufStats.add(partitions[p].stats);
+		}
+		return bufStats;
+	}
+
+	void BufMgr::clearBufStats()
+	{
+		for (std::uint32_t p = 0; p < numPartitions; p++) {
+			BufPartition& part = partitions[p];
+			std::lock_guard<std::mutex> guard(part.latch);
+			part.stats.clear();
+			// the frames pointed into the per-file statistics just dropped
+			for (FrameId i = part.firstFrame; i < part.firstFrame + part.numFrames; i++)
+				bufDescTable[i].fileStats = NULL;
+		}
+		bufStats.clear();
+	}
+
+	void BufStats::add(const BufStats& other)
+	{
+		accesses += other.accesses;
+		diskreads += other.diskreads;
+		diskwrites += other.diskwrites;
+		fgwrites += other.fgwrites;
+		bgwrites += other.bgwrites;
+		hits += other.hits;
+		misses += other.misses;
+		allocs += other.allocs;
+		cleanevictions += other.cleanevictions;
+		dirtyevictions += other.dirtyevictions;
+		fullpool += other.fullpool;
+		latchwaits += other.latchwaits;
+		readLatency.add(other.readLatency);
+		writeLatency.add(other.writeLatency);
+		for (std::map<std::uint32_t, FileStats>::const_iterator it = other.files.begin(); it != other.files.end(); ++it) {
+			FileStats& f = files[it->first];
+			f.name = it->second.name;
+			f.hits += it->second.hits;
+			f.misses += it->second.misses;
+		}
+	}
+
+	/**
+	 * Write s to out as a JSON string
+	 */
+	static void writeJsonString(std::ostream& out, const std::string& s)
+	{
+		out << '"';
+		for (std::size_t i = 0; i < s.size(); i++) {
+			unsigned char c = s[i];
+			if (c == '"' || c == '\\')
+				out << '\\' << c;
+			else if (c < 0x20)
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c << std::dec << std::setfill(' ');
+			else
+				out << c;
+		}
+		out << '"';
+	}
+
+	/**
+	 * Write h to out as a JSON object
+	 */
+	static void writeJsonHistogram(std::ostream& out, const LatencyHistogram& h)
+	{
+		out << "{\"count\":" << h.count
+			<< ",\"meanNs\":" << (h.count == 0 ? 0 : h.totalNs / h.count)
+			<< ",\"p50Ns\":" << h.percentile(0.5)
+			<< ",\"p99Ns\":" << h.percentile(0.99)
+			<< ",\"buckets\":[";
+		// trailing empty buckets are left out
+		int last = LatencyHistogram::NUM_BUCKETS;
+		while (last > 0 && h.buckets[last - 1] == 0)
+			last--;
+		for (int k = 0; k < last; k++)
+			out << (k > 0 ? "," : "") << h.buckets[k];
+		out << "]}";
+	}
+
+	std::string BufStats::toJson() const
+	{
+		// File objects that were reopened under the same name count as one file
+		std::map<std::string, FileStats> byName;
+		for (std::map<std::uint32_t, FileStats>::const_iterator it = files.begin(); it != files.end(); ++it) {
+			FileStats& f = byName[it->second.name];
+			f.hits += it->second.hits;
+			f.misses += it->second.misses;
+		}
+
+		std::ostringstream out;
+		out << "{\"policy\":";
+		writeJsonString(out, policyName(policy));
+		out << ",\"accesses\":" << accesses
+			<< ",\"hits\":" << hits
+			<< ",\"misses\":" << misses
+			<< ",\"hitRate\":" << hitRate()
+			<< ",\"diskreads\":" << diskreads
+			<< ",\"allocs\":" << allocs
+			<< ",\"diskwrites\":" << diskwrites
+			<< ",\"fgwrites\":" << fgwrites
+			<< ",\"bgwrites\":" << bgwrites
+			<< ",\"evictions\":{\"clean\":" << cleanevictions << ",\"dirty\":" << dirtyevictions << "}"
+			<< ",\"fullpool\":" << fullpool
+			<< ",\"latchwaits\":" << latchwaits
+			<< ",\"files\":[";
+		for (std::map<std::string, FileStats>::const_iterator it = byName.begin(); it != byName.end(); ++it) {
+			out << (it == byName.begin() ? "" : ",") << "{\"name\":";
+			writeJsonString(out, it->first);
+			out << ",\"hits\":" << it->second.hits
+				<< ",\"misses\":" << it->second.misses
+				<< ",\"hitRate\":" << it->second.hitRate() << "}";
+		}
+		out << "],\"readLatency\":";
+		writeJsonHistogram(out, readLatency);
+		out << ",\"writeLatency\":";
+		writeJsonHistogram(out, writeLatency);
+		out << "}";
+		return out.str();
+	}
+
 	void BufMgr::printSelf(void) 
 	{
 		BufDesc* tmpbuf;
@@ -230,7 +870,7 @@ namespace badgerdb {
 			std::cout << "FrameNo:" << i << " ";
 			tmpbuf->Print();
 
-			if (tmpbuf->valid == true)
+			if (tmpbuf->valid() == true)
 				validFrames++;
 		}
 
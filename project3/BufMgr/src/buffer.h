@@ -7,8 +7,16 @@
 
 #pragma once
 
+#include <mutex>
+#include <thread>
+#include <map>
+#include <condition_variable>
+#include <string>
+#include <vector>
 #include "file.h"
-#include "bufHashTbl.h"
+#include "bufPageTbl.h"
+#include "bufReplacer.h"
+#include "bufFrameMeta.h"
 
 namespace badgerdb {
 
@@ -17,12 +25,19 @@ namespace badgerdb {
 */
 class BufMgr;
 
+/**
+* forward declaration of FileStats struct
+*/
+struct FileStats;
+
 /**
 * @brief Class for maintaining information about buffer pool frames
 */
 class BufDesc {
 
 	friend class BufMgr;
+	friend class BufReplacer;
+	friend class ClockReplacer;
 
  private:
 	/**
@@ -41,36 +56,58 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * True if page is dirty;  false otherwise
 	 */
-  int pinCnt;
+  bool dirty;
 
 	/**
-   * True if page is dirty;  false otherwise
+   * Number of times the page was requested since it was loaded
 	 */
-  bool dirty;
+  std::uint32_t accessCnt;
+
+	/**
+   * Per-file statistics of the page's file in its partition, NULL until the first
+	 * readPage() finds them; saves a lookup on every hit
+	 */
+  FileStats* fileStats;
+
+	/**
+   * Clock state of the frame (valid, refbit, pin count), kept densely by the frame's
+	 * partition so the clock can sweep it without touching BufDesc
+	 */
+  BufFrameMeta* meta;
+
+	/**
+   * Position of the frame in meta, relative to the partition's first frame
+	 */
+  std::uint32_t slot;
+
+	/**
+   * Number of times this page has been pinned
+	 */
+  std::uint32_t pinCnt() const { return meta->pinCount(slot); }
 
 	/**
    * True if page is valid
 	 */
-  bool valid;
+  bool valid() const { return meta->valid(slot); }
 
 	/**
    * Has this buffer frame been reference recently
 	 */
-  bool refbit;
+  bool refbit() const { return meta->referenced(slot); }
 
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
-    pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
-    refbit = false;
-		valid = false;
+    accessCnt = 0;
+    fileStats = NULL;
+    meta->clear(slot);
   };
 
 	/**
@@ -84,10 +121,10 @@ class BufDesc {
 	{ 
 		file = filePtr;
     pageNo = pageNum;
-    pinCnt = 1;
     dirty = false;
-    valid = true;
-    refbit = true;
+    accessCnt = 1;
+    fileStats = NULL;
+    meta->load(slot);
   }
 
   void Print()
@@ -100,18 +137,145 @@ class BufDesc {
 		else
 			std::cout << "file:NULL ";
 
-		std::cout << "valid:" << valid << " ";
-		std::cout << "pinCnt:" << pinCnt << " ";
+		std::cout << "valid:" << valid() << " ";
+		std::cout << "pinCnt:" << pinCnt() << " ";
 		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "refbit:" << refbit() << "\n";
   }
 
 	/**
-   * Constructor of BufDesc class 
+   * Constructor of BufDesc class. The frame is attached to its partition's metadata
+	 * by BufMgr, which then clears it.
 	 */
   BufDesc()
+		: file(NULL), pageNo(Page::INVALID_NUMBER), frameNo(0), dirty(false), accessCnt(0), fileStats(NULL),
+		  meta(NULL), slot(0)
 	{
-  	Clear();
+  }
+};
+
+
+/**
+* @brief Log-scale histogram of disk operation latencies
+*
+* Bucket k counts operations that took between 2^k and 2^(k+1) nanoseconds; the last
+* bucket also takes everything slower.
+*/
+struct LatencyHistogram
+{
+	/**
+   * Number of buckets, the last one starting at about two seconds
+	 */
+  static const int NUM_BUCKETS = 32;
+
+	/**
+   * Number of operations per bucket
+	 */
+  std::uint64_t buckets[NUM_BUCKETS];
+
+	/**
+   * Number of operations recorded
+	 */
+  std::uint64_t count;
+
+	/**
+   * Sum of the recorded latencies in nanoseconds
+	 */
+  std::uint64_t totalNs;
+
+	/**
+   * Record an operation that took ns nanoseconds
+	 */
+  void record(std::uint64_t ns)
+  {
+		int k = 0;
+		for (std::uint64_t rest = ns >> 1; rest != 0 && k < NUM_BUCKETS - 1; rest >>= 1)
+			k++;
+		buckets[k]++;
+		count++;
+		totalNs += ns;
+  }
+
+	/**
+   * Add the operations recorded by other
+	 */
+  void add(const LatencyHistogram& other)
+  {
+		for (int k = 0; k < NUM_BUCKETS; k++)
+			buckets[k] += other.buckets[k];
+		count += other.count;
+		totalNs += other.totalNs;
+  }
+
+	/**
+   * Upper bound in nanoseconds of the bucket holding the q-th quantile, 0 if empty
+	 */
+  std::uint64_t percentile(double q) const
+  {
+		std::uint64_t seen = 0;
+		for (int k = 0; k < NUM_BUCKETS; k++) {
+			seen += buckets[k];
+			if (seen > 0 && seen >= q * count)
+				return (std::uint64_t) 2 << k;
+		}
+		return 0;
+  }
+
+	/**
+   * Clear all values
+	 */
+  void clear()
+  {
+		for (int k = 0; k < NUM_BUCKETS; k++)
+			buckets[k] = 0;
+		count = totalNs = 0;
+  }
+
+	/**
+   * Constructor of LatencyHistogram class
+	 */
+  LatencyHistogram()
+  {
+		clear();
+  }
+};
+
+
+/**
+* @brief readPage statistics of one file
+*/
+struct FileStats
+{
+	/**
+   * Name of the file when it was first seen
+	 */
+  std::string name;
+
+	/**
+   * Number of readPage calls on the file that found the page in the buffer pool
+	 */
+  int hits;
+
+	/**
+   * Number of readPage calls on the file that went to disk
+	 */
+  int misses;
+
+	/**
+   * Fraction of readPage calls on the file served without a disk read
+	 */
+  double hitRate() const
+  {
+		int lookups = hits + misses;
+		return lookups == 0 ? 0.0 : (double) hits / lookups;
+  }
+
+	/**
+   * Constructor of FileStats class
+	 */
+  FileStats()
+		: hits(0), misses(0)
+  {
   }
 };
 
@@ -136,44 +300,209 @@ struct BufStats
 	 */
   int diskwrites;
 
+	/**
+   * Number of dirty victims written back by the thread that needed their frame
+	 */
+  int fgwrites;
+
+	/**
+   * Number of dirty frames cleaned ahead of eviction by the background writer
+	 */
+  int bgwrites;
+
+	/**
+   * Number of readPage calls that found the page already in the buffer pool
+	 */
+  int hits;
+
+	/**
+   * Number of readPage calls that had to read the page from disk
+	 */
+  int misses;
+
+	/**
+   * Number of pages allocated by allocPage, which count as disk reads too
+	 */
+  int allocs;
+
+	/**
+   * Number of clean pages evicted to make room for another page
+	 */
+  int cleanevictions;
+
+	/**
+   * Number of dirty pages evicted to make room for another page, after writing them back
+	 */
+  int dirtyevictions;
+
+	/**
+   * Number of calls that failed with BufferExceededException because every frame was pinned
+	 */
+  int fullpool;
+
+	/**
+   * Number of readPage, allocPage, unPinPage and disposePage calls that found their
+	 * partition latched by another thread and had to wait for it
+	 */
+  int latchwaits;
+
+	/**
+   * Latency of the disk reads of readPage misses
+	 */
+  LatencyHistogram readLatency;
+
+	/**
+   * Latency of page write backs, by eviction, flushFile, resize or the background writer
+	 */
+  LatencyHistogram writeLatency;
+
+	/**
+   * readPage hits and misses per file object, by File::id()
+	 */
+  std::map<std::uint32_t, FileStats> files;
+
+	/**
+   * Replacement policy the buffer pool runs with
+	 */
+  ReplacementPolicy policy;
+
+	/**
+   * Fraction of readPage calls served without a disk read
+	 */
+  double hitRate() const
+  {
+		int lookups = hits + misses;
+		return lookups == 0 ? 0.0 : (double) hits / lookups;
+  }
+
 	/**
    * Clear all values 
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = diskreads = diskwrites = fgwrites = bgwrites = hits = misses = allocs = 0;
+		cleanevictions = dirtyevictions = fullpool = latchwaits = 0;
+		readLatency.clear();
+		writeLatency.clear();
+		files.clear();
   }
+
+	/**
+   * Add the counts of other, as when summing up partitions
+	 */
+  void add(const BufStats& other);
+
+	/**
+   * Snapshot of all values as a JSON object. Files of the same name are reported together.
+	 */
+  std::string toJson() const;
       
 	/**
    * Constructor of BufStats class 
 	 */
   BufStats()
+		: policy(CLOCK)
   {
 		clear();
   }
 };
 
 
+/**
+* @brief A slice of the buffer pool with its own latch, replacer and hash table.
+*
+* Pages are assigned to a partition by hashing (File*, PageId); a partition only ever
+* places its pages in, and evicts from, the frames it owns.  All fields except the
+* frame range are protected by latch.
+*/
+class BufPartition {
+
+	friend class BufMgr;
+
+ private:
+	/**
+   * First frame of the buffer pool owned by this partition
+	 */
+  FrameId firstFrame;
+
+	/**
+   * Number of consecutive frames owned by this partition
+	 */
+  std::uint32_t numFrames;
+
+	/**
+   * Replacement policy choosing which of this partition's frames to reuse
+	 */
+  BufReplacer *replacer;
+
+	/**
+   * Valid, referenced and pinned state of this partition's frames
+	 */
+  BufFrameMeta *frameMeta;
+
+	/**
+   * Hash table mapping (File, page) to frame for pages of this partition
+	 */
+  BufPageTbl *hashTable;
+
+	/**
+   * Usage statistics of this partition, summed up by BufMgr::getBufStats()
+	 */
+  BufStats stats;
+
+	/**
+   * Latch protecting the frames, replacer, hash table and statistics of this partition
+	 */
+  std::mutex latch;
+
+	/**
+   * Constructor of BufPartition class
+	 */
+  BufPartition()
+		: firstFrame(0), numFrames(0), replacer(NULL), frameMeta(NULL), hashTable(NULL)
+	{
+  }
+
+	/**
+   * Destructor of BufPartition class
+	 */
+  ~BufPartition()
+	{
+		delete replacer;
+		delete frameMeta;
+		delete hashTable;
+  }
+};
+
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* readPage(), unPinPage(), allocPage(), disposePage() and flushFile() may be called from several threads at once;
+* each call only latches the partition its page hashes to.
 */
 class BufMgr 
 {
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Number of frames in the buffer pool
 	 */
-  FrameId clockHand;
+  std::uint32_t numBufs;
 
 	/**
-   * Number of frames in the buffer pool
+   * Number of independently latched partitions the pool is split into
 	 */
-  std::uint32_t numBufs;
-	
+  std::uint32_t numPartitions;
+
+	/**
+   * Array of partitions, each owning a contiguous range of frames
+	 */
+  BufPartition *partitions;
+
 	/**
-   * Hash table mapping (File, page) to frame
+   * Serializes calls into File, whose shared stream is not threadsafe
 	 */
-  BufHashTbl *hashTable;
+  std::mutex ioLatch;
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -181,33 +510,114 @@ class BufMgr
   BufDesc *bufDescTable;
 
 	/**
-   * Maintains Buffer pool usage statistics 
+   * Buffer pool usage statistics, refreshed from the partitions by getBufStats()
 	 */
   BufStats bufStats;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Background writer thread, if started
+	 */
+  std::thread writer;
+
+	/**
+   * Protects the writer settings below and wakes the writer up
 	 */
-  void advanceClock();
+  std::mutex writerLatch;
+  std::condition_variable writerWakeup;
 
 	/**
-	 * Allocate a free frame.  
+   * True while the background writer should keep running
+	 */
+  bool writerRunning;
+
+	/**
+   * Fractions of a partition's frames that may be dirty: above highWater the writer
+	 * starts cleaning, and it stops once no more than lowWater are left dirty
+	 */
+  double lowWater;
+  double highWater;
+
+	/**
+   * Milliseconds the writer sleeps between passes unless woken by a foreground write
+	 */
+  std::uint32_t writerInterval;
+
+	/**
+   * Main loop of the background writer thread
+	 */
+  void writerLoop();
+
+	/**
+   * Write back dirty, unpinned frames of the partition, starting where its replacer will
+	 * look for the next victim, if more than highWater of its frames are dirty
+	 */
+  void cleanPartition(BufPartition& part);
+
+	/**
+   * Number of frames partition p gets out of a pool of bufs frames
+	 */
+  std::uint32_t partitionSize(const std::uint32_t bufs, const std::uint32_t p) const;
+
+	/**
+   * Give every partition its range of the current bufDescTable with an empty replacer,
+	 * frame metadata and hash table, replacing any it had
+	 */
+  void layoutPartitions();
+
+	/**
+   * Returns the partition responsible for the given page of the file
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  BufPartition& partitionOf(const File* file, const PageId pageNo);
+
+	/**
+   * Latch part, counting a latch wait in its statistics if another thread holds it
+	 */
+  std::unique_lock<std::mutex> lockPartition(BufPartition& part);
+
+	/**
+   * Returns the per-file statistics of file in part, adding them if they are new.
+	 * Caller holds the partition latch.
+	 */
+  FileStats& fileStatsOf(BufPartition& part, const File* file);
+
+	/**
+	 * Allocate a free frame from the given partition for the page (file, pageNo), evicting
+	 * the page the partition's replacer picks. Caller holds the partition latch.
 	 *
+	 * @param part    	Partition to allocate the frame from
+	 * @param file   	File of the page the frame is for
+	 * @param pageNo  Page number of the page the frame is for
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void allocBuf(FrameId & frame);
+  void allocBuf(BufPartition& part, const File* file, const PageId pageNo, FrameId & frame);
+
+	/**
+   * Manifest the destructor saves the resident page set to, empty for none
+	 */
+  std::string manifestPath;
 
  public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Actual buffer pool from which frames are allocated: the page buffer of every frame.
+	 * Buffers are allocated one by one so resize() can hand a page to a new frame
+	 * without moving it.
 	 */
-  Page* bufPool;
+  Page** bufPool;
 
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs    	Number of frames in the buffer pool
+	 * @param parts   	Number of latched partitions. With the default of 1 the pool behaves as a
+	 *                	single clock; with more, every partition replaces pages only among its own
+	 *                	bufs/parts frames, so threads touching different pages rarely contend.
+	 * @param policy  	Replacement policy every partition runs
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, std::uint32_t parts = 1, ReplacementPolicy policy = CLOCK);
 	
 	/**
    * Destructor of BufMgr class
@@ -266,25 +676,89 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
+	 * Grow or shrink the buffer pool to newBufs frames while it is in use. Every partition
+	 * gets its share of the new frames. Resident pages move to new frames and stay
+	 * buffered, dirty or not, unless a partition shrinks below the number of pages it
+	 * holds: then unpinned pages that were not referenced lately are evicted first,
+	 * written back if dirty. Pinned pages are never evicted and keep their address, so
+	 * Page pointers handed out by readPage() and allocPage() stay valid.
+	 *
+	 * @param newBufs 	New number of frames, at least one per partition
+	 * @throws BufferExceededException If a partition has more pages pinned than it would have
+	 *                  frames; the pool is left unchanged
+	 */
+  void resize(std::uint32_t newBufs);
+
+	/**
+	 * Write a manifest of the resident pages to path: for every file, the numbers of its
+	 * pages in the pool and how often each was requested since it was loaded. A later
+	 * BufMgr can preload() the same pages after a restart instead of faulting them in
+	 * one random read at a time. Files of resident pages must still be open.
+	 *
+	 * @param path   	Name of the manifest file, replaced if it exists
+	 * @throws BadgerDbException If the manifest cannot be written
+	 */
+  void saveManifest(const std::string& path);
+
+	/**
+	 * Have the destructor save a manifest to path on shutdown, as saveManifest() does.
+	 * An empty path turns this off again.
+	 */
+  void setManifest(const std::string& path) { manifestPath = path; }
+
+	/**
+	 * Read the pages listed in the manifest at path into free frames before the pool
+	 * serves traffic. The most frequently requested pages are chosen first, as many as
+	 * fit in each partition without evicting anything, and are then read sorted by page
+	 * number with one sequential read per run of consecutive pages. Preloaded pages are
+	 * unpinned and keep their access count. Entries of files not passed in, and pages no
+	 * longer in use or already resident, are skipped.
+	 *
+	 * @param path   	Name of the manifest file; a missing or damaged manifest loads nothing
+	 * @param files  	Open files the manifest may name, matched by file name
+	 * @return       	Number of pages read
+	 */
+  std::uint32_t preload(const std::string& path, const std::vector<File*>& files);
+
+	/**
+	 * Start a thread that writes back dirty, unpinned pages ahead of eviction, so that
+	 * readPage() and allocPage() rarely have to write a victim themselves. Pages stay in
+	 * the pool; only their dirty bit is cleared. Does nothing if the writer is running.
+	 *
+	 * @param low     	Fraction of a partition's frames left dirty after a cleaning pass
+	 * @param high    	Fraction of a partition's frames that must be dirty before it is cleaned
+	 * @param interval	Milliseconds between passes; a foreground write wakes the writer early
+	 */
+  void startBackgroundWriter(double low = 0.05, double high = 0.2, std::uint32_t interval = 10);
+
+	/**
+	 * Stop the background writer and wait for it to finish its current pass.
+	 * Called by the destructor.
+	 */
+  void stopBackgroundWriter();
+
+	/**
    * Print member variable values. 
 	 */
   void  printSelf();
 
 	/**
-   * Get buffer pool usage statistics
+   * Get the number of latched partitions in the buffer pool
 	 */
-  BufStats & getBufStats()
+  std::uint32_t getNumPartitions() const
   {
-		return bufStats;
+		return numPartitions;
   }
 
+	/**
+   * Get buffer pool usage statistics, summed over all partitions
+	 */
+  BufStats & getBufStats();
+
 	/**
    * Clear buffer pool usage statistics
 	 */
-  void clearBufStats() 
-  {
-		bufStats.clear();
-  }
+  void clearBufStats();
 };
 
 }
@@ -25,6 +25,7 @@ namespace badgerdb {
 
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+std::atomic<std::uint32_t> File::last_id_(0);
 
 File File::create(const std::string& filename) {
   return File(filename, true /* create_new */);
@@ -64,6 +65,7 @@ bool File::exists(const std::string& filename) {
 
 File::File(const File& other)
   : filename_(other.filename_),
+    id_(++last_id_),
     stream_(open_streams_[filename_]) {
   ++open_counts_[filename_];
 }
@@ -73,6 +75,7 @@ File& File::operator=(const File& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
+  id_ = ++last_id_;
   openIfNeeded(false /* create_new */);
   return *this;
 }
@@ -154,16 +157,49 @@ Page File::readPage(const PageId page_number) const {
   return readPage(page_number, false /* allow_free */);
 }
 
+void File::readPage(const PageId page_number, Page& page) const {
+  FileHeader header = readHeader();
+  if (page_number >= header.num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  readPage(page_number, false /* allow_free */, page);
+}
+
+void File::readPages(const PageId first, const std::uint32_t count,
+                     Page* pages) const {
+  FileHeader header = readHeader();
+  if (count == 0) {
+    return;
+  }
+  if (first + count - 1 >= header.num_pages) {
+    throw InvalidPageException(first + count - 1, filename_);
+  }
+  // pages are stored back to back, so after one seek the stream just reads on
+  stream_->seekg(pagePosition(first), std::ios::beg);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    Page& page = pages[i];
+    page.data_.resize(Page::DATA_SIZE);
+    stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
+    stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  }
+}
+
 Page File::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
+  readPage(page_number, allow_free, page);
+  return page;
+}
+
+void File::readPage(const PageId page_number, const bool allow_free,
+                    Page& page) const {
+  // every page holds exactly DATA_SIZE bytes, so this normally does nothing
+  page.data_.resize(Page::DATA_SIZE);
   stream_->seekg(pagePosition(page_number), std::ios::beg);
   stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
   stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void File::writePage(const Page& new_page) {
@@ -220,7 +256,8 @@ FileIterator File::end() {
   return FileIterator(this, Page::INVALID_NUMBER);
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
+File::File(const std::string& name, const bool create_new)
+    : filename_(name), id_(++last_id_) {
   openIfNeeded(create_new);
 
   if (create_new) {
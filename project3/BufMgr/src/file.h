@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <fstream>
 #include <string>
 #include <map>
@@ -155,6 +157,33 @@ class File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file straight into the given page, such as
+   * a frame of the buffer pool, without building a temporary Page first.  The
+   * previous contents of page are overwritten even if the read fails.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const;
+
+  /**
+   * Reads count consecutive pages starting at first with one seek and one
+   * sequential pass over the file.  Unlike readPage(), pages that are not
+   * currently used are not an error: they come back with an invalid page
+   * number, so callers reading a range can skip them.
+   *
+   * @param first   Number of the first page to read.
+   * @param count   Number of pages to read.
+   * @param pages   Array of at least count pages to read into.
+   * @throws  InvalidPageException  If the range extends past the end of the
+   *                                file.
+   */
+  void readPages(const PageId first, const std::uint32_t count,
+                 Page* pages) const;
+
   /**
    * Writes a page into the file, replacing any existing contents.  The page
    * must have been already allocated in this file by a call to allocatePage().
@@ -178,6 +207,15 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns the number identifying this file object.  Every object gets its
+   * own, never given to another one, so it stays meaningful after the object
+   * is gone, unlike its address.
+   *
+   * @return Id of this file object.
+   */
+  std::uint32_t id() const { return id_; }
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -256,6 +294,18 @@ class File {
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Reads a page from the file into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param allow_free    Whether to allow reading a free (unused) page.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page is free (unused) and
+   *                                allow_free is false.
+   */
+  void readPage(const PageId page_number, const bool allow_free,
+                Page& page) const;
+
   /**
    * Writes a page into the file at the given page number.  This does not
    * update ensure that the number in the header equals the position on disk.
@@ -315,11 +365,21 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * Id handed to the last file object created.
+   */
+  static std::atomic<std::uint32_t> last_id_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
+  /**
+   * See id().
+   */
+  std::uint32_t id_;
+
   /**
    * Stream for underlying filesystem object.
    */
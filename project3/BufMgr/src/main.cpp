@@ -3,8 +3,15 @@
 //#include <stdio.h>
 #include <cstring>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include "page.h"
 #include "buffer.h"
+#include "bufHashTbl.h"
+#include "bufPageTbl.h"
+#include "bufFrameMeta.h"
 #include "file_iterator.h"
 #include "page_iterator.h"
 #include "exceptions/file_not_found_exception.h"
@@ -12,6 +19,8 @@
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/hash_not_found_exception.h"
 
 #define PRINT_ERROR(str) \
 { \
@@ -40,6 +49,17 @@ void test7();
 void test8();
 void test9();
 void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
 void testBufMgr();
 
 int main() 
@@ -79,11 +99,13 @@ int main()
          iter != new_file.end();
          ++iter) {
       // Iterate through all records on the page.
-      for (PageIterator page_iter = (*iter).begin();
-           page_iter != (*iter).end();
+      // Keep the page alive while its records are iterated over.
+      Page curr_page = *iter;
+      for (PageIterator page_iter = curr_page.begin();
+           page_iter != curr_page.end();
            ++page_iter) {
         std::cout << "Found record: " << *page_iter
-            << " on page " << (*iter).page_number() << "\n";
+            << " on page " << curr_page.page_number() << "\n";
       }
     }
 
@@ -154,6 +176,17 @@ void testBufMgr()
 	test8();
 	test9();
 	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
 	
 
 	//Close files before deleting them
@@ -454,3 +487,1122 @@ void test10()
 
 }
 
+
+void test11()
+{
+	// Hammer a partitioned buffer manager from several threads at once. Every thread
+	// reads shared pages and also allocates, dirties and re-reads pages of its own,
+	// so the pool keeps evicting (and writing back) frames under contention.
+	const std::string& filename = "test.6";
+	const int numThreads = 4;
+	const int numShared = num;
+	const int numOwned = num / 2;
+	const int numRounds = 2000;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		File* file6ptr = &file6;
+		BufMgr* mtBufMgr = new BufMgr(num, 4);
+		PageId sharedPid[numShared];
+		RecordId sharedRid[numShared];
+
+		for (int k = 0; k < numShared; k++)
+		{
+			Page* p;
+			char buf[100];
+			mtBufMgr->allocPage(file6ptr, sharedPid[k], p);
+			sprintf(buf, "test.6 Page %d %7.1f", sharedPid[k], (float)sharedPid[k]);
+			sharedRid[k] = p->insertRecord(buf);
+			mtBufMgr->unPinPage(file6ptr, sharedPid[k], true);
+		}
+
+		std::atomic<int> failures(0);
+		std::vector<std::thread> workers;
+		for (int t = 0; t < numThreads; t++)
+		{
+			workers.push_back(std::thread([&, t]() {
+				try
+				{
+					PageId ownPid[numOwned];
+					RecordId ownRid[numOwned];
+					char buf[100];
+					unsigned int seed = t + 1;
+					Page* p;
+
+					for (int k = 0; k < numOwned; k++)
+					{
+						mtBufMgr->allocPage(file6ptr, ownPid[k], p);
+						sprintf(buf, "thread %d page %d", t, ownPid[k]);
+						ownRid[k] = p->insertRecord(buf);
+						mtBufMgr->unPinPage(file6ptr, ownPid[k], true);
+					}
+
+					for (int r = 0; r < numRounds; r++)
+					{
+						int k = rand_r(&seed) % numShared;
+						mtBufMgr->readPage(file6ptr, sharedPid[k], p);
+						sprintf(buf, "test.6 Page %d %7.1f", sharedPid[k], (float)sharedPid[k]);
+						if (strncmp(p->getRecord(sharedRid[k]).c_str(), buf, strlen(buf)) != 0)
+							failures++;
+						mtBufMgr->unPinPage(file6ptr, sharedPid[k], false);
+
+						k = rand_r(&seed) % numOwned;
+						mtBufMgr->readPage(file6ptr, ownPid[k], p);
+						sprintf(buf, "thread %d page %d", t, ownPid[k]);
+						if (strncmp(p->getRecord(ownRid[k]).c_str(), buf, strlen(buf)) != 0)
+							failures++;
+						mtBufMgr->unPinPage(file6ptr, ownPid[k], false);
+					}
+				}
+				catch(BadgerDbException e)
+				{
+					std::cerr << e.message() << "\n";
+					failures++;
+				}
+			}));
+		}
+		for (std::size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+
+		if (failures > 0)
+		{
+			PRINT_ERROR("ERROR :: CONCURRENT ACCESS RETURNED WRONG CONTENTS OR FAILED");
+		}
+
+		mtBufMgr->flushFile(file6ptr);
+		delete mtBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 11 passed" << "\n";
+}
+
+void test12()
+{
+	// Throughput of the hit path (readPage + unPinPage of resident pages) for a
+	// growing number of threads, with a single latch and with a partitioned pool.
+	const std::string& filename = "test.6";
+	const int numPages = num;
+	const int opsPerThread = 200000;
+	const std::uint32_t partitionCounts[] = {1, 16};
+	const int threadCounts[] = {1, 2, 4, 8};
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		File* file6ptr = &file6;
+
+		for (std::uint32_t pc = 0; pc < sizeof(partitionCounts) / sizeof(partitionCounts[0]); pc++)
+		{
+			// generous pool so that every page stays resident in its partition
+			BufMgr* mtBufMgr = new BufMgr(8 * numPages, partitionCounts[pc]);
+			std::vector<PageId> pages(numPages);
+			Page* p;
+
+			for (int k = 0; k < numPages; k++)
+			{
+				if (pc == 0)
+				{
+					mtBufMgr->allocPage(file6ptr, pages[k], p);
+				}
+				else
+				{
+					pages[k] = k + 1;
+					mtBufMgr->readPage(file6ptr, pages[k], p);
+				}
+				mtBufMgr->unPinPage(file6ptr, pages[k], pc == 0);
+			}
+
+			for (std::size_t tc = 0; tc < sizeof(threadCounts) / sizeof(threadCounts[0]); tc++)
+			{
+				std::vector<std::thread> workers;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int t = 0; t < threadCounts[tc]; t++)
+				{
+					workers.push_back(std::thread([&, t]() {
+						unsigned int seed = t + 1;
+						Page* tp;
+						for (int r = 0; r < opsPerThread; r++)
+						{
+							PageId pageNo = pages[rand_r(&seed) % numPages];
+							mtBufMgr->readPage(file6ptr, pageNo, tp);
+							mtBufMgr->unPinPage(file6ptr, pageNo, false);
+						}
+					}));
+				}
+				for (std::size_t t = 0; t < workers.size(); t++)
+					workers[t].join();
+				double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				std::cout << "  partitions:" << partitionCounts[pc]
+					<< " threads:" << threadCounts[tc]
+					<< " ops/sec:" << (long)(threadCounts[tc] * opsPerThread / secs) << "\n";
+			}
+
+			mtBufMgr->flushFile(file6ptr);
+			delete mtBufMgr;
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 12 passed" << "\n";
+}
+
+void test13()
+{
+	// Churn the open-addressing page table, then compare its hit-path latency against
+	// the chained BufHashTbl on the same keys (runs of consecutive pages per file).
+	const std::uint32_t entries = 1000;
+	const int numLookups = 2000000;
+	File* files[] = {file1ptr, file2ptr, file3ptr, file4ptr, file5ptr};
+	const int numFiles = sizeof(files) / sizeof(files[0]);
+	std::vector<const File*> keyFile(entries);
+	std::vector<PageId> keyPage(entries);
+	std::vector<bool> present(entries, true);
+	FrameId frameNo;
+
+	for (std::uint32_t k = 0; k < entries; k++)
+	{
+		keyFile[k] = files[k % numFiles];
+		keyPage[k] = k / numFiles + 1;
+	}
+
+	BufPageTbl pageTbl(entries);
+	for (std::uint32_t k = 0; k < entries; k++)
+		pageTbl.insert(keyFile[k], keyPage[k], k);
+
+	// remove and reinsert entries in random order; every remaining key must still be found
+	for (int r = 0; r < 10 * (int) entries; r++)
+	{
+		std::uint32_t k = random() % entries;
+		if (present[k])
+			pageTbl.remove(keyFile[k], keyPage[k]);
+		else
+			pageTbl.insert(keyFile[k], keyPage[k], k);
+		present[k] = !present[k];
+	}
+	for (std::uint32_t k = 0; k < entries; k++)
+	{
+		if (pageTbl.lookup(keyFile[k], keyPage[k], frameNo) != present[k])
+		{
+			PRINT_ERROR("ERROR :: PAGE TABLE LOST OR KEPT AN ENTRY");
+		}
+		if (present[k] && frameNo != k)
+		{
+			PRINT_ERROR("ERROR :: PAGE TABLE RETURNED A WRONG FRAME");
+		}
+	}
+	for (std::uint32_t k = 0; k < entries; k++)
+	{
+		if (!present[k])
+			pageTbl.insert(keyFile[k], keyPage[k], k);
+	}
+
+	int htsize = ((((int) (entries * 1.2))*2)/2)+1;
+	BufHashTbl hashTbl(htsize);
+	for (std::uint32_t k = 0; k < entries; k++)
+		hashTbl.insert(keyFile[k], keyPage[k], k);
+
+	std::vector<std::uint32_t> order(numLookups);
+	for (int r = 0; r < numLookups; r++)
+		order[r] = random() % entries;
+
+	FrameId sum = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int r = 0; r < numLookups; r++)
+	{
+		hashTbl.lookup(keyFile[order[r]], keyPage[order[r]], frameNo);
+		sum += frameNo;
+	}
+	double chainedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / numLookups;
+
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < numLookups; r++)
+	{
+		pageTbl.lookup(keyFile[order[r]], keyPage[order[r]], frameNo);
+		sum -= frameNo;
+	}
+	double flatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / numLookups;
+
+	if (sum != 0)
+	{
+		PRINT_ERROR("ERROR :: PAGE TABLES DISAGREE");
+	}
+
+	std::cout << "  chained BufHashTbl hit: " << chainedNs << " ns/lookup\n";
+	std::cout << "  open-addressing BufPageTbl hit: " << flatNs << " ns/lookup\n";
+	std::cout << "Test 13 passed" << "\n";
+}
+
+void test14()
+{
+	// Miss throughput on a pool smaller than the file. Scanning the file over and over
+	// with 10 frames makes every readPage a miss. The cost of detecting those misses by
+	// catching HashNotFoundException (the old readPage) is measured next to the
+	// found/not-found lookup readPage uses now.
+	const std::string& filename = "test.6";
+	const int numPages = num;
+	const int numScans = 20;
+	const int numMisses = 200000;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		File* file6ptr = &file6;
+		BufMgr* smallBufMgr = new BufMgr(10);
+		PageId pageNo;
+
+		for (int k = 0; k < numPages; k++)
+		{
+			smallBufMgr->allocPage(file6ptr, pageNo, page);
+			smallBufMgr->unPinPage(file6ptr, pageNo, true);
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int r = 0; r < numScans; r++)
+		{
+			for (pageNo = 1; pageNo <= (PageId) numPages; pageNo++)
+			{
+				smallBufMgr->readPage(file6ptr, pageNo, page);
+				smallBufMgr->unPinPage(file6ptr, pageNo, false);
+			}
+		}
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "  readPage misses/sec: " << (long)(numScans * numPages / secs) << "\n";
+
+		smallBufMgr->flushFile(file6ptr);
+		delete smallBufMgr;
+
+		// miss detection alone, on tables holding the 10 resident frames
+		int htsize = ((((int) (10 * 1.2))*2)/2)+1;
+		BufHashTbl hashTbl(htsize);
+		BufPageTbl pageTbl(10);
+		FrameId frameNo;
+		int found = 0;
+		for (FrameId f = 0; f < 10; f++)
+		{
+			hashTbl.insert(file6ptr, f + 1, f);
+			pageTbl.insert(file6ptr, f + 1, f);
+		}
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < numMisses; r++)
+		{
+			try
+			{
+				hashTbl.lookup(file6ptr, numPages + r, frameNo);
+				found++;
+			}
+			catch(HashNotFoundException e)
+			{
+			}
+		}
+		double throwSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < numMisses; r++)
+		{
+			if (pageTbl.lookup(file6ptr, numPages + r, frameNo))
+				found++;
+		}
+		double returnSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (found != 0)
+		{
+			PRINT_ERROR("ERROR :: LOOKUP FOUND A PAGE THAT IS NOT IN THE TABLE");
+		}
+		std::cout << "  miss detection by exception: " << (long)(numMisses / throwSecs) << " misses/sec\n";
+		std::cout << "  miss detection by return value: " << (long)(numMisses / returnSecs) << " misses/sec\n";
+	}
+	File::remove(filename);
+
+	std::cout << "Test 14 passed" << "\n";
+}
+
+void test15()
+{
+	// Run the same mixed workload under every replacement policy: a small hot set of
+	// "index" pages probed between the pages of repeated full scans. Contents are
+	// checked on every read, and each policy must still refuse to evict pinned pages.
+	const std::string& filename = "test.6";
+	const ReplacementPolicy policies[] = {CLOCK, LRU_K, TWO_Q, ARC};
+	const int numPolicies = sizeof(policies) / sizeof(policies[0]);
+	const int poolSize = 50;
+	const PageId numHot = 20;
+	const PageId numPages = 400;
+	const int numScans = 5;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		File* file6ptr = &file6;
+		PageId pageNo;
+		char buf[100];
+
+		{
+			BufMgr loader(poolSize);
+			for (PageId k = 0; k < numPages; k++)
+			{
+				loader.allocPage(file6ptr, pageNo, page);
+				sprintf(buf, "test.6 Page %d", pageNo);
+				page->insertRecord(buf);
+				loader.unPinPage(file6ptr, pageNo, true);
+			}
+			loader.flushFile(file6ptr);
+		}
+
+		for (int pol = 0; pol < numPolicies; pol++)
+		{
+			BufMgr* policyBufMgr = new BufMgr(poolSize, 1, policies[pol]);
+			srandom(15);
+
+			for (int r = 0; r < numScans; r++)
+			{
+				for (PageId scanNo = numHot + 1; scanNo <= numPages; scanNo++)
+				{
+					PageId probes[] = {scanNo, (PageId)(random() % numHot + 1), (PageId)(random() % numHot + 1)};
+					for (int k = 0; k < 3; k++)
+					{
+						policyBufMgr->readPage(file6ptr, probes[k], page);
+						sprintf(buf, "test.6 Page %d", probes[k]);
+						RecordId recordId = {probes[k], 1};
+						if (strncmp(page->getRecord(recordId).c_str(), buf, strlen(buf)) != 0)
+						{
+							PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+						}
+						policyBufMgr->unPinPage(file6ptr, probes[k], false);
+					}
+				}
+			}
+
+			BufStats& stats = policyBufMgr->getBufStats();
+			std::cout << "  " << policyName(stats.policy) << " hit rate: " << stats.hitRate()
+				<< " (" << stats.hits << " hits, " << stats.diskreads << " disk reads)\n";
+
+			for (pageNo = 1; pageNo <= (PageId) poolSize; pageNo++)
+				policyBufMgr->readPage(file6ptr, pageNo, page);
+			try
+			{
+				policyBufMgr->readPage(file6ptr, poolSize + 1, page);
+				PRINT_ERROR("ERROR :: No more frames left for allocation. Exception should have been thrown before execution reaches this point.");
+			}
+			catch(BufferExceededException e)
+			{
+			}
+			for (pageNo = 1; pageNo <= (PageId) poolSize; pageNo++)
+				policyBufMgr->unPinPage(file6ptr, pageNo, false);
+
+			policyBufMgr->flushFile(file6ptr);
+			delete policyBufMgr;
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 15 passed" << "\n";
+}
+
+void test16()
+{
+	// Fill the pool with dirty pages, give the background writer time to clean them, then
+	// push all of them out with new pages. With the writer running the evictions should
+	// find clean victims; without it every one of them is written in the foreground.
+	const std::string& filename = "test.6";
+	const PageId poolSize = 100;
+	int fgwrites[2];
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		File* file6ptr = &file6;
+		PageId pageNo;
+		char buf[100];
+
+		for (int withWriter = 0; withWriter < 2; withWriter++)
+		{
+			BufMgr* writerBufMgr = new BufMgr(poolSize, 4);
+			if (withWriter)
+				writerBufMgr->startBackgroundWriter(0.0, 0.1, 5);
+
+			for (int round = 0; round < 2; round++)
+			{
+				for (PageId k = 0; k < poolSize; k++)
+				{
+					writerBufMgr->allocPage(file6ptr, pageNo, page);
+					sprintf(buf, "test.6 Page %d", pageNo);
+					page->insertRecord(buf);
+					writerBufMgr->unPinPage(file6ptr, pageNo, true);
+				}
+				if (round == 0)
+					std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			}
+
+			BufStats& stats = writerBufMgr->getBufStats();
+			fgwrites[withWriter] = stats.fgwrites;
+			std::cout << "  background writer " << (withWriter ? "on" : "off") << ": " << stats.fgwrites
+				<< " foreground writes, " << stats.bgwrites << " background writes\n";
+			if (withWriter && stats.bgwrites == 0)
+			{
+				PRINT_ERROR("ERROR :: Background writer did not clean any page");
+			}
+
+			writerBufMgr->flushFile(file6ptr);
+			delete writerBufMgr;
+		}
+
+		if (fgwrites[1] >= fgwrites[0])
+		{
+			PRINT_ERROR("ERROR :: Background writer did not take writes off the foreground");
+		}
+
+		// every page must have reached the disk with its contents
+		BufMgr checker(poolSize);
+		for (pageNo = 1; pageNo <= 4 * poolSize; pageNo++)
+		{
+			checker.readPage(file6ptr, pageNo, page);
+			sprintf(buf, "test.6 Page %d", pageNo);
+			RecordId recordId = {pageNo, 1};
+			if (strncmp(page->getRecord(recordId).c_str(), buf, strlen(buf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			checker.unPinPage(file6ptr, pageNo, false);
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 16 passed" << "\n";
+}
+
+void test17()
+{
+	// Cost of a page transfer on a miss. The old readPage built a Page in File::readPage
+	// and then copied it into the frame; File::readPage(pageNo, frame) reads straight
+	// into the frame. Both are timed on their own, followed by BufMgr misses end to end.
+	const std::string& filename = "test.6";
+	const int numPages = num;
+	const int numFrames = 10;
+	const int numScans = 20;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		File* file6ptr = &file6;
+		PageId pageNo;
+		char buf[100];
+
+		{
+			BufMgr loader(numFrames);
+			for (int k = 0; k < numPages; k++)
+			{
+				loader.allocPage(file6ptr, pageNo, page);
+				sprintf(buf, "test.6 Page %d", pageNo);
+				page->insertRecord(buf);
+				loader.unPinPage(file6ptr, pageNo, true);
+			}
+			loader.flushFile(file6ptr);
+		}
+
+		Page* frames = new Page[numFrames];
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int r = 0; r < numScans; r++)
+		{
+			for (pageNo = 1; pageNo <= (PageId) numPages; pageNo++)
+			{
+				Page p = file6.readPage(pageNo);
+				frames[pageNo % numFrames] = p;
+			}
+		}
+		double copySecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < numScans; r++)
+		{
+			for (pageNo = 1; pageNo <= (PageId) numPages; pageNo++)
+			{
+				file6.readPage(pageNo, frames[pageNo % numFrames]);
+			}
+		}
+		double directSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		for (pageNo = numPages - numFrames + 1; pageNo <= (PageId) numPages; pageNo++)
+		{
+			sprintf(buf, "test.6 Page %d", pageNo);
+			RecordId recordId = {pageNo, 1};
+			if (strncmp(frames[pageNo % numFrames].getRecord(recordId).c_str(), buf, strlen(buf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+		delete [] frames;
+
+		BufMgr* smallBufMgr = new BufMgr(numFrames);
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < numScans; r++)
+		{
+			for (pageNo = 1; pageNo <= (PageId) numPages; pageNo++)
+			{
+				smallBufMgr->readPage(file6ptr, pageNo, page);
+				if (r == 0)
+				{
+					sprintf(buf, "test.6 Page %d", pageNo);
+					RecordId recordId = {pageNo, 1};
+					if (strncmp(page->getRecord(recordId).c_str(), buf, strlen(buf)) != 0)
+					{
+						PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+					}
+				}
+				smallBufMgr->unPinPage(file6ptr, pageNo, false);
+			}
+		}
+		double bufMgrSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		smallBufMgr->flushFile(file6ptr);
+		delete smallBufMgr;
+
+		std::cout << "  read then copy into frame: " << (long)(numScans * numPages / copySecs) << " pages/sec\n";
+		std::cout << "  read straight into frame: " << (long)(numScans * numPages / directSecs) << " pages/sec\n";
+		std::cout << "  readPage misses/sec: " << (long)(numScans * numPages / bufMgrSecs) << "\n";
+	}
+	File::remove(filename);
+
+	std::cout << "Test 17 passed" << "\n";
+}
+
+void test18()
+{
+	// Latency of a clock sweep over 1M frames where every frame but one is referenced,
+	// so the hand has to clear its way almost all the way round. The old sweep stepped
+	// through BufDesc entries one at a time; BufFrameMeta tests 64 frames per word.
+	const std::uint32_t numFrames = 1 << 20;
+	const int numSweeps = 20;
+
+	// frame layout the clock used to walk
+	struct OldDesc
+	{
+		File* file;
+		PageId pageNo;
+		FrameId frameNo;
+		int pinCnt;
+		bool dirty;
+		bool valid;
+		bool refbit;
+	};
+	std::vector<OldDesc> oldDescs(numFrames);
+	BufFrameMeta meta(numFrames);
+	for (std::uint32_t f = 0; f < numFrames; f++)
+	{
+		OldDesc d = {NULL, f + 1, f, 0, false, true, false};
+		oldDescs[f] = d;
+		meta.load(f);
+		meta.unpin(f);
+	}
+	// a few pinned frames for the sweep to skip
+	for (std::uint32_t f = 0; f < numFrames; f += 1000)
+	{
+		oldDescs[f].pinCnt = 1;
+		meta.pin(f);
+	}
+	// loading set every reference bit, one turn of the clock clears them again
+	std::uint32_t first = 0;
+	meta.sweep(0, first);
+
+	double oldSecs = 0, newSecs = 0;
+	std::uint32_t oldHand = 0, newHand = 0;
+	for (int r = 0; r < numSweeps; r++)
+	{
+		// everything referenced except the frame just behind the hands
+		std::uint32_t target = (oldHand + numFrames - 1) % numFrames;
+		if (oldDescs[target].pinCnt > 0)
+			target = (target + numFrames - 1) % numFrames;
+		for (std::uint32_t f = 0; f < numFrames; f++)
+		{
+			oldDescs[f].refbit = (f != target);
+			if (f != target)
+				meta.reference(f);
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::uint32_t h = oldHand;
+		std::uint32_t scanned = 0;
+		while (scanned < 2 * numFrames)
+		{
+			OldDesc& d = oldDescs[h];
+			if (!d.valid || (!d.refbit && d.pinCnt == 0))
+				break;
+			d.refbit = false;
+			h = (h + 1) % numFrames;
+			scanned++;
+		}
+		oldSecs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		std::uint32_t victim = 0;
+		bool found = meta.sweep(newHand, victim);
+		newSecs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (!found || victim != h || h != target)
+		{
+			PRINT_ERROR("ERROR :: CLOCK SWEEPS PICKED DIFFERENT VICTIMS");
+		}
+		oldHand = newHand = (victim + 1) % numFrames;
+	}
+
+	std::cout << "  1M frame sweep, frame by frame: " << (long)(oldSecs * 1e6 / numSweeps) << " us\n";
+	std::cout << "  1M frame sweep, 64 frames per word: " << (long)(newSecs * 1e6 / numSweeps) << " us\n";
+
+	std::cout << "Test 18 passed" << "\n";
+}
+
+void test19()
+{
+	// Grow a pool holding pinned and dirty pages, fill it, then shrink it well below the
+	// number of resident pages. Pinned pages must keep their address and contents through
+	// both, and the dirty pages pushed out by the shrink must reach the file.
+	const std::string& filename = "test.6";
+	const PageId numPages = 150;
+	const PageId numPinned = 4;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		File* file6ptr = &file6;
+		PageId pageNo;
+		char buf[100];
+		Page* pinned[numPinned];
+		PageId pinnedNo[numPinned];
+
+		BufMgr* resizeBufMgr = new BufMgr(40, 4);
+		for (PageId k = 0; k < 40; k++)
+		{
+			resizeBufMgr->allocPage(file6ptr, pageNo, page);
+			sprintf(buf, "test.6 Page %d", pageNo);
+			page->insertRecord(buf);
+			if (k < numPinned)
+			{
+				pinned[k] = page;
+				pinnedNo[k] = pageNo;
+			}
+			else
+			{
+				resizeBufMgr->unPinPage(file6ptr, pageNo, true);
+			}
+		}
+
+		// growing keeps every page resident
+		resizeBufMgr->resize(200);
+		resizeBufMgr->clearBufStats();
+		for (pageNo = 1; pageNo <= 40; pageNo++)
+		{
+			resizeBufMgr->readPage(file6ptr, pageNo, page);
+			resizeBufMgr->unPinPage(file6ptr, pageNo, false);
+		}
+		if (resizeBufMgr->getBufStats().diskreads != 0)
+		{
+			PRINT_ERROR("ERROR :: PAGES LOST WHEN GROWING THE POOL");
+		}
+
+		for (PageId k = 40; k < numPages; k++)
+		{
+			resizeBufMgr->allocPage(file6ptr, pageNo, page);
+			sprintf(buf, "test.6 Page %d", pageNo);
+			page->insertRecord(buf);
+			resizeBufMgr->unPinPage(file6ptr, pageNo, true);
+		}
+
+		// shrinking writes back the dirty pages it evicts
+		resizeBufMgr->clearBufStats();
+		resizeBufMgr->resize(20);
+		if (resizeBufMgr->getBufStats().diskwrites < (int) numPages - 20)
+		{
+			PRINT_ERROR("ERROR :: EVICTED DIRTY PAGES NOT WRITTEN");
+		}
+
+		for (PageId k = 0; k < numPinned; k++)
+		{
+			resizeBufMgr->readPage(file6ptr, pinnedNo[k], page);
+			if (page != pinned[k])
+			{
+				PRINT_ERROR("ERROR :: PINNED PAGE MOVED");
+			}
+			sprintf(buf, "test.6 Page %d", pinnedNo[k]);
+			RecordId recordId = {pinnedNo[k], 1};
+			if (strncmp(page->getRecord(recordId).c_str(), buf, strlen(buf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			resizeBufMgr->unPinPage(file6ptr, pinnedNo[k], false);
+		}
+
+		// the small pool still serves every page
+		for (pageNo = 1; pageNo <= numPages; pageNo++)
+		{
+			resizeBufMgr->readPage(file6ptr, pageNo, page);
+			sprintf(buf, "test.6 Page %d", pageNo);
+			RecordId recordId = {pageNo, 1};
+			if (strncmp(page->getRecord(recordId).c_str(), buf, strlen(buf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			resizeBufMgr->unPinPage(file6ptr, pageNo, false);
+		}
+
+		for (PageId k = 0; k < numPinned; k++)
+			resizeBufMgr->unPinPage(file6ptr, pinnedNo[k], false);
+		resizeBufMgr->flushFile(file6ptr);
+		delete resizeBufMgr;
+
+		// a pool cannot shrink below its pinned pages, and is left as it was
+		BufMgr* smallBufMgr = new BufMgr(10);
+		for (PageId k = 0; k < numPinned; k++)
+			smallBufMgr->readPage(file6ptr, k + 1, pinned[k]);
+		try
+		{
+			smallBufMgr->resize(numPinned - 1);
+			PRINT_ERROR("ERROR :: No more frames left for allocation. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(BufferExceededException e)
+		{
+		}
+		smallBufMgr->resize(numPinned);
+		for (PageId k = 0; k < numPinned; k++)
+		{
+			smallBufMgr->readPage(file6ptr, k + 1, page);
+			if (page != pinned[k])
+			{
+				PRINT_ERROR("ERROR :: PINNED PAGE MOVED");
+			}
+			smallBufMgr->unPinPage(file6ptr, k + 1, false);
+			smallBufMgr->unPinPage(file6ptr, k + 1, false);
+		}
+		smallBufMgr->flushFile(file6ptr);
+		delete smallBufMgr;
+	}
+	File::remove(filename);
+
+	std::cout << "Test 19 passed" << "\n";
+}
+
+void test20()
+{
+	// Warm restart. A pool that served a skewed workload saves its manifest on shutdown;
+	// the first lookups of the hot pages after a restart are timed once against a cold
+	// pool and once against one that preloaded the manifest.
+	const std::string& filename = "test.6";
+	const std::string& manifest = "test.manifest";
+	const PageId numPages = 2000;
+	const PageId numHot = 100;
+	const PageId hotStride = 17;
+	const std::uint32_t poolSize = 200;
+
+	try
+	{
+		File::remove(filename);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file6 = File::create(filename);
+		File* file6ptr = &file6;
+		PageId pageNo;
+		char buf[100];
+		std::vector<PageId> hot;
+		for (PageId k = 0; k < numHot; k++)
+			hot.push_back(1 + (k * hotStride) % numPages);
+
+		BufMgr* runBufMgr = new BufMgr(poolSize, 4);
+		for (PageId k = 0; k < numPages; k++)
+		{
+			runBufMgr->allocPage(file6ptr, pageNo, page);
+			sprintf(buf, "test.6 Page %d", pageNo);
+			page->insertRecord(buf);
+			runBufMgr->unPinPage(file6ptr, pageNo, true);
+		}
+		// hot pages are requested over and over, a scan of cold pages passes by once
+		for (int r = 0; r < 5; r++)
+		{
+			for (PageId k = 0; k < numHot; k++)
+			{
+				runBufMgr->readPage(file6ptr, hot[k], page);
+				runBufMgr->unPinPage(file6ptr, hot[k], false);
+			}
+			for (pageNo = 1 + r * 10; pageNo <= (PageId) (r + 1) * 10; pageNo++)
+			{
+				runBufMgr->readPage(file6ptr, pageNo, page);
+				runBufMgr->unPinPage(file6ptr, pageNo, false);
+			}
+		}
+		// flushFile() would drop the pages; the destructor writes them back after the manifest
+		runBufMgr->setManifest(manifest);
+		delete runBufMgr;
+
+		std::vector<File*> files(1, file6ptr);
+		double lookupSecs[2];
+		int lookupReads[2];
+		std::uint32_t preloaded = 0;
+		double preloadSecs = 0;
+		for (int warm = 0; warm < 2; warm++)
+		{
+			BufMgr* restartBufMgr = new BufMgr(poolSize, 4);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (warm)
+			{
+				preloaded = restartBufMgr->preload(manifest, files);
+				preloadSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			restartBufMgr->clearBufStats();
+
+			start = std::chrono::steady_clock::now();
+			for (PageId k = 0; k < numHot; k++)
+			{
+				restartBufMgr->readPage(file6ptr, hot[k], page);
+				sprintf(buf, "test.6 Page %d", hot[k]);
+				RecordId recordId = {hot[k], 1};
+				if (strncmp(page->getRecord(recordId).c_str(), buf, strlen(buf)) != 0)
+				{
+					PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+				}
+				restartBufMgr->unPinPage(file6ptr, hot[k], false);
+			}
+			lookupSecs[warm] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			lookupReads[warm] = restartBufMgr->getBufStats().diskreads;
+			delete restartBufMgr;
+		}
+
+		if (lookupReads[0] != (int) numHot)
+		{
+			PRINT_ERROR("ERROR :: COLD POOL SHOULD READ EVERY HOT PAGE");
+		}
+		// partitions are filled by hash, so a few hot pages may not have fit
+		bool warmed = preloaded >= numHot && lookupReads[1] <= (int) numHot / 10;
+		if (!warmed)
+		{
+			PRINT_ERROR("ERROR :: PRELOAD DID NOT WARM THE POOL");
+		}
+
+		// a missing manifest is a cold start, not an error
+		BufMgr* coldBufMgr = new BufMgr(poolSize, 4);
+		if (coldBufMgr->preload("test.nomanifest", files) != 0)
+		{
+			PRINT_ERROR("ERROR :: PRELOADED FROM A MISSING MANIFEST");
+		}
+		delete coldBufMgr;
+
+		std::cout << "  preloaded " << preloaded << " pages in " << (long)(preloadSecs * 1e6) << " us\n";
+		std::cout << "  first " << numHot << " lookups, cold: " << (long)(lookupSecs[0] * 1e6) << " us, "
+			<< lookupReads[0] << " disk reads\n";
+		std::cout << "  first " << numHot << " lookups, warm: " << (long)(lookupSecs[1] * 1e6) << " us, "
+			<< lookupReads[1] << " disk reads\n";
+	}
+	File::remove(filename);
+	std::remove(manifest.c_str());
+
+	std::cout << "Test 20 passed" << "\n";
+}
+
+void test21()
+{
+	// Instrumentation. A pool of one partition is driven through misses, hits, clean and
+	// dirty evictions and a full pool on two files, and the snapshot is checked against
+	// what the calls must have done.
+	const std::string& filename7 = "test.7";
+	const std::string& filename8 = "test.8";
+	const PageId numPages = 20;
+	const std::uint32_t poolSize = 20;
+
+	try
+	{
+		File::remove(filename7);
+		File::remove(filename8);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File file7 = File::create(filename7);
+		File file8 = File::create(filename8);
+		File* file7ptr = &file7;
+		File* file8ptr = &file8;
+		PageId pageNo;
+
+		BufMgr* statsBufMgr = new BufMgr(poolSize);
+		for (PageId k = 0; k < numPages; k++)
+		{
+			statsBufMgr->allocPage(file7ptr, pageNo, page);
+			statsBufMgr->unPinPage(file7ptr, pageNo, true);
+			statsBufMgr->allocPage(file8ptr, pageNo, page);
+			statsBufMgr->unPinPage(file8ptr, pageNo, true);
+		}
+		// start from an empty pool
+		statsBufMgr->flushFile(file7ptr);
+		statsBufMgr->flushFile(file8ptr);
+		statsBufMgr->clearBufStats();
+
+		// half of test.8 is read twice, the second time from the pool
+		for (int r = 0; r < 2; r++)
+		{
+			for (pageNo = 1; pageNo <= numPages / 2; pageNo++)
+			{
+				statsBufMgr->readPage(file8ptr, pageNo, page);
+				statsBufMgr->unPinPage(file8ptr, pageNo, false);
+			}
+		}
+		BufStats stats = statsBufMgr->getBufStats();
+		if (stats.files[file8ptr->id()].hits != (int) numPages / 2 || stats.files[file8ptr->id()].misses != (int) numPages / 2)
+		{
+			PRINT_ERROR("ERROR :: WRONG PER FILE HITS AND MISSES");
+		}
+
+		// test.7 is pinned entirely, which pushes out clean pages and fills the pool
+		for (pageNo = 1; pageNo <= numPages; pageNo++)
+			statsBufMgr->readPage(file7ptr, pageNo, page);
+		try
+		{
+			statsBufMgr->readPage(file8ptr, 1, page);
+			PRINT_ERROR("ERROR :: No more frames left for allocation. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(BufferExceededException e)
+		{
+		}
+		// every page of test.7 comes back dirty, so test.8 has to write them all back
+		for (pageNo = 1; pageNo <= numPages; pageNo++)
+			statsBufMgr->unPinPage(file7ptr, pageNo, true);
+		for (pageNo = 1; pageNo <= numPages / 2; pageNo++)
+		{
+			statsBufMgr->readPage(file8ptr, pageNo, page);
+			statsBufMgr->unPinPage(file8ptr, pageNo, false);
+		}
+
+		stats = statsBufMgr->getBufStats();
+		int fileHits = 0, fileMisses = 0;
+		for (std::map<std::uint32_t, FileStats>::const_iterator it = stats.files.begin(); it != stats.files.end(); ++it)
+		{
+			fileHits += it->second.hits;
+			fileMisses += it->second.misses;
+		}
+		if (fileHits != stats.hits || fileMisses != stats.misses || stats.misses != stats.diskreads || stats.files[file7ptr->id()].hits + stats.files[file7ptr->id()].misses != (int) numPages)
+		{
+			PRINT_ERROR("ERROR :: PER FILE COUNTS DO NOT ADD UP");
+		}
+		// every miss after the pool filled up evicted a page
+		bool evictionsCounted = stats.cleanevictions + stats.dirtyevictions == stats.diskreads - (int) poolSize
+			&& stats.dirtyevictions == (int) numPages / 2 && stats.fullpool == 1 && stats.latchwaits == 0;
+		if (!evictionsCounted)
+		{
+			PRINT_ERROR("ERROR :: WRONG EVICTION COUNTS");
+		}
+		bool latenciesCounted = stats.readLatency.count == (std::uint64_t) stats.diskreads
+			&& stats.writeLatency.count == (std::uint64_t) stats.diskwrites
+			&& stats.readLatency.percentile(0.5) <= stats.readLatency.percentile(0.99);
+		if (!latenciesCounted)
+		{
+			PRINT_ERROR("ERROR :: WRONG LATENCY HISTOGRAMS");
+		}
+		std::string json = stats.toJson();
+		bool jsonComplete = json[0] == '{' && json[json.size() - 1] == '}'
+			&& json.find("\"name\":\"test.7\"") != std::string::npos
+			&& json.find("\"evictions\":{\"clean\":") != std::string::npos;
+		if (!jsonComplete)
+		{
+			PRINT_ERROR("ERROR :: INCOMPLETE STATISTICS SNAPSHOT");
+		}
+		std::cout << "  " << json << "\n";
+
+		// flushing a file keeps its statistics, and another object for it is counted apart
+		int file8Misses = stats.files[file8ptr->id()].misses;
+		statsBufMgr->flushFile(file8ptr);
+		stats = statsBufMgr->getBufStats();
+		File file8again = file8;
+		if (stats.files.count(file8ptr->id()) != 1 || stats.files[file8ptr->id()].misses != file8Misses
+			|| file8again.id() == file8ptr->id())
+		{
+			PRINT_ERROR("ERROR :: PER FILE STATISTICS NOT KEPT");
+		}
+
+		statsBufMgr->clearBufStats();
+		stats = statsBufMgr->getBufStats();
+		if (!stats.files.empty() || stats.readLatency.count != 0 || stats.dirtyevictions != 0)
+		{
+			PRINT_ERROR("ERROR :: STATISTICS NOT CLEARED");
+		}
+
+		// allocations are disk reads but not misses
+		statsBufMgr->allocPage(file8ptr, pageNo, page);
+		statsBufMgr->unPinPage(file8ptr, pageNo, true);
+		statsBufMgr->readPage(file8ptr, pageNo, page);
+		statsBufMgr->unPinPage(file8ptr, pageNo, false);
+		stats = statsBufMgr->getBufStats();
+		bool allocsCounted = stats.allocs == 1 && stats.misses == 0 && stats.diskreads == 1
+			&& stats.hits == 1 && stats.hitRate() == 1.0;
+		if (!allocsCounted)
+		{
+			PRINT_ERROR("ERROR :: ALLOCATIONS COUNTED AS MISSES");
+		}
+		// a hit on a page that stayed resident is counted for its file again after a clear
+		statsBufMgr->clearBufStats();
+		statsBufMgr->readPage(file8ptr, pageNo, page);
+		statsBufMgr->unPinPage(file8ptr, pageNo, false);
+		stats = statsBufMgr->getBufStats();
+		if (stats.files.count(file8ptr->id()) != 1 || stats.files[file8ptr->id()].hits != 1)
+		{
+			PRINT_ERROR("ERROR :: HITS NOT COUNTED PER FILE AFTER CLEAR");
+		}
+		delete statsBufMgr;
+	}
+	File::remove(filename7);
+	File::remove(filename8);
+
+	std::cout << "Test 21 passed" << "\n";
+}
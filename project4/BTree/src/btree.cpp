@@ -80,6 +80,8 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 
 BTreeIndex::~BTreeIndex()
 {
+	// a scan left open still pins its leaf
+	this->currentPage.release();
 	this->bufMgr->flushFile(this->file);
 	this->scanExecuting = false;
 	delete this->file;
@@ -91,9 +93,6 @@ BTreeIndex::~BTreeIndex()
 
 const void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
 {
-	
-	Page* rootPage;
-
 	bool isLeaf = false; // if lower level is leaf
 	if (this->attributeType == INTEGER) {
 		RIDKeyPair<int> leafEntry;
@@ -109,14 +108,14 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 
 			traverse<int, struct LeafNodeInt,struct NonLeafNodeInt,PageKeyPair<int>,RIDKeyPair<int>>(this->rootPageNum, newPagePair, leafEntry);
 			PageId oldPageNum = this->rootPageNum;
-			this->bufMgr->readPage(this->file, oldPageNum, rootPage);
-			NonLeafNodeInt* rootNode = (NonLeafNodeInt*)rootPage;
+			PageHandle rootPage = this->bufMgr->fetch(this->file, oldPageNum);
+			rootPage.markDirty();
+			NonLeafNodeInt* rootNode = (NonLeafNodeInt*)rootPage.get();
 			
 			// if new child node is created (split happened in immediate child level)
 			if (newPagePair.pageNo != 0) {
 				createNewRoot<int, struct LeafNodeInt,struct NonLeafNodeInt,PageKeyPair<int>,RIDKeyPair<int>>(oldPageNum, newPagePair, false);
 			}
-			this->bufMgr->unPinPage(this->file, oldPageNum, true);
 		}
 	}
 	// same case for other attribute types
@@ -132,8 +131,9 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 			traverse<double, struct LeafNodeDouble,struct NonLeafNodeDouble,PageKeyPair<double>,RIDKeyPair<double>>(this->rootPageNum, newPagePair, leafEntry);
 
 			PageId oldPageNum = this->rootPageNum;
-			this->bufMgr->readPage(this->file, oldPageNum, rootPage);
-			NonLeafNodeDouble* rootNode = (NonLeafNodeDouble*)rootPage;
+			PageHandle rootPage = this->bufMgr->fetch(this->file, oldPageNum);
+			rootPage.markDirty();
+			NonLeafNodeDouble* rootNode = (NonLeafNodeDouble*)rootPage.get();
 			if (newPagePair.pageNo!= 0) {
 				if (rootNode->pageNoArray[nodeOccupancy] == 0) {
 					putEntryNonLeaf<double, struct NonLeafNodeDouble,PageKeyPair<double>> (rootNode,newPagePair);
@@ -144,7 +144,6 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 					createNewRoot<double, struct LeafNodeDouble,struct NonLeafNodeDouble,PageKeyPair<double>,RIDKeyPair<double>>(this->rootPageNum, rightFirstEntry, false);
 				}
 			}
-			this->bufMgr->unPinPage(this->file, oldPageNum, true);
 		}
 	}
 	else if (this->attributeType == STRING) {
@@ -161,8 +160,9 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 			PageId oldPageNum = this->rootPageNum;
 			traverse<char*, struct LeafNodeString,struct NonLeafNodeString,PageKeyPair<char*>,RIDKeyPair<char*>>(oldPageNum, newPagePair, leafEntry);
 			
-			this->bufMgr->readPage(this->file, oldPageNum, rootPage);
-			NonLeafNodeString* rootNode = (NonLeafNodeString*)rootPage;
+			PageHandle rootPage = this->bufMgr->fetch(this->file, oldPageNum);
+			rootPage.markDirty();
+			NonLeafNodeString* rootNode = (NonLeafNodeString*)rootPage.get();
 
 			if (newPagePair.pageNo!= 0) {
 				if (rootNode->pageNoArray[nodeOccupancy] == 0) {
@@ -174,7 +174,6 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 					createNewRoot<char*, struct LeafNodeString,struct NonLeafNodeString,PageKeyPair<char*>,RIDKeyPair<char*>>(oldPageNum, rightFirstEntry, false);
 				}
 			}
-			this->bufMgr->unPinPage(this->file, oldPageNum, true);
 		}
 	}
 }
@@ -245,14 +244,13 @@ const void BTreeIndex::startScan(const void* lowValParm,
 // -----------------------------------------------------------------------------
 template<class T,class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::scan(T lowVal) 
 {
-	Page* tmpPage;
 	PageId tmpPageNo;
 	NL_T* tmpNonLeafNode;
 	
 	// if root is leaf, that means the curent page for scanning is the only page in the tree
 	if (rootIsLeaf){
 		this->currentPageNum = this->rootPageNum;		
-		this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);	
+		this->currentPage = this->bufMgr->fetch(this->file, this->currentPageNum);
 		nextEntry = findPos<T, L_T,NL_T,P_T,RID_T>(true, false, this->rootPageNum, lowVal);
 
 		if (nextEntry == -1) {
@@ -263,17 +261,15 @@ template<class T,class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::sc
 
 	// else we need to traverse down to the right leaf node
 	tmpPageNo = this->rootPageNum;
-	this->bufMgr->readPage(this->file,tmpPageNo,tmpPage);
-	this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-	tmpNonLeafNode = (NL_T*) tmpPage;
+	PageHandle tmpPage = this->bufMgr->fetch(this->file,tmpPageNo);
+	tmpNonLeafNode = (NL_T*) tmpPage.get();
 
 	// if current node is not the level above leaf node, keep traversing
 	while (tmpNonLeafNode->level != 1) {
 		int nextPos = findPos<T, L_T,NL_T,P_T,RID_T>(false, true, tmpPageNo, lowVal);
 		tmpPageNo = tmpNonLeafNode->pageNoArray[nextPos];
-		this->bufMgr->readPage(this->file,tmpPageNo,tmpPage);
-		tmpNonLeafNode = (NL_T*)tmpPage;
-		this->bufMgr->unPinPage(this->file,tmpPageNo,false);
+		tmpPage = this->bufMgr->fetch(this->file,tmpPageNo);
+		tmpNonLeafNode = (NL_T*)tmpPage.get();
 	}
 	
 	// traversed to the right nonleafnode. Get the correct current page and then 
@@ -294,8 +290,8 @@ template<class T,class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::sc
 		throw IndexScanCompletedException();
 	}
 
-	this->bufMgr->readPage(this->file,this->currentPageNum,this->currentPageData);
-	this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
+	// the leaf stays pinned while the scan is on it
+	this->currentPage = this->bufMgr->fetch(this->file,this->currentPageNum);
 
 }
 
@@ -312,7 +308,7 @@ const void BTreeIndex::scanNext(RecordId& outRid)
 		throw IndexScanCompletedException();
 	} 
 	if (attributeType == INTEGER){
-		LeafNodeInt* currLeaf = (LeafNodeInt*) (this->currentPageData);
+		LeafNodeInt* currLeaf = (LeafNodeInt*) (this->currentPage.get());
 		if(highOp == LT && compareKey((void*)&(currLeaf->keyArray[nextEntry]),(void*)(&highValInt)) >=0)  {
 			throw IndexScanCompletedException();
 		}
@@ -326,13 +322,12 @@ const void BTreeIndex::scanNext(RecordId& outRid)
 			
 			this->currentPageNum =  currLeaf->rightSibPageNo;
 			if(currLeaf->rightSibPageNo == 0) return;
-			this->bufMgr->readPage(this->file,this->currentPageNum,this->currentPageData);
-			this->bufMgr->unPinPage(this->file,this->currentPageNum,false);
+			this->currentPage = this->bufMgr->fetch(this->file,this->currentPageNum);
 			nextEntry = 0;
 		}
 	}
 	else if(attributeType == DOUBLE){
-		LeafNodeDouble* currLeaf = (LeafNodeDouble*) (this->currentPageData);	
+		LeafNodeDouble* currLeaf = (LeafNodeDouble*) (this->currentPage.get());	
 		if(highOp == LT && compareKey((void*)&(currLeaf->keyArray[nextEntry]),(void*)(&highValDouble)) >=0)  {
 			throw IndexScanCompletedException();
 		}
@@ -344,13 +339,12 @@ const void BTreeIndex::scanNext(RecordId& outRid)
 		if( nextEntry == leafOccupancy || currLeaf->ridArray[nextEntry].page_number == 0 ){
 			this->currentPageNum =  currLeaf->rightSibPageNo;
 			if(currLeaf->rightSibPageNo == 0) return;
-			this->bufMgr->readPage(this->file,this->currentPageNum,this->currentPageData);
-			this->bufMgr->unPinPage(this->file,this->currentPageNum,false);
+			this->currentPage = this->bufMgr->fetch(this->file,this->currentPageNum);
 			nextEntry = 0;
 		}
 	}
 	else if(attributeType == STRING){
-		LeafNodeString* currLeaf = (LeafNodeString*) (this->currentPageData);
+		LeafNodeString* currLeaf = (LeafNodeString*) (this->currentPage.get());
 		char* key = (char*) (malloc)(STRINGSIZE);
 		snprintf(key,STRINGSIZE, "%s",highValString.c_str());
 
@@ -365,8 +359,7 @@ const void BTreeIndex::scanNext(RecordId& outRid)
 		if(nextEntry == leafOccupancy || currLeaf->ridArray[nextEntry].page_number == 0 ) {
 			this->currentPageNum =  currLeaf->rightSibPageNo;
 			if(currLeaf->rightSibPageNo == 0) return;
-			this->bufMgr->readPage(this->file,this->currentPageNum,this->currentPageData);
-			this->bufMgr->unPinPage(this->file,this->currentPageNum,false);
+			this->currentPage = this->bufMgr->fetch(this->file,this->currentPageNum);
 			nextEntry = 0;
 		}	
 	}
@@ -384,12 +377,7 @@ const void BTreeIndex::endScan()
 		throw ScanNotInitializedException();
 	}
 	// unpin any pinned pages
-	try{
-		if(this->currentPageNum !=0) this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
-	}
-	catch(PageNotPinnedException e){
-
-	}
+	this->currentPage.release();
 	
 	scanExecuting = false;
 }
@@ -456,73 +444,62 @@ bool leaf, bool nonleaf, PageId tmpPageNo, T lowVal){
 	int count = 0;
 	if (nonleaf) {
 		int pos = 0;
-		Page* tmpPage;
-
-		this->bufMgr->readPage(this->file,tmpPageNo,tmpPage);
-		NL_T* currNode = (NL_T*) tmpPage;
+		PageHandle tmpPage = this->bufMgr->fetch(this->file,tmpPageNo);
+		NL_T* currNode = (NL_T*) tmpPage.get();
 		T itr;
 		
 		while (pos < nodeOccupancy && currNode->pageNoArray[pos] != 0) {
 			itr = currNode->keyArray[pos];
 			if (attributeType == STRING) {
 				if(compare(itr, lowVal) > 0) {
-					this->bufMgr->unPinPage(this->file,tmpPageNo,false);
 					return pos;
 				}
 			}
 			else {
 				if(compare<T>(itr, lowVal) > 0) {
-					this->bufMgr->unPinPage(this->file,tmpPageNo,false);
 					return pos;
 				}
 			}
 			pos++;
 		}
 
-		this->bufMgr->unPinPage(this->file,tmpPageNo,false);
 		result = (currNode->pageNoArray[pos] == 0)? (pos-1) : pos;
 	}
 	if(leaf){
 		int pos = 0;
-		Page* tmpPage;
 		T itr;
 
-		this->bufMgr->readPage(this->file,tmpPageNo,tmpPage);
-		L_T* currNode = (L_T*) tmpPage;
+		PageHandle tmpPage = this->bufMgr->fetch(this->file,tmpPageNo);
+		L_T* currNode = (L_T*) tmpPage.get();
 
 		while (pos < leafOccupancy && currNode->ridArray[pos].page_number != 0) {
 			itr = currNode->keyArray[pos];
 			if(lowOp == GT){
 				if (attributeType == STRING) {
 					if (compare(itr, lowVal) > 0) {
-						this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-						return pos;
+							return pos;
 					}
 				}
 				else {
 					if (compare<T>(itr, lowVal) > 0) {
-						this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-						return pos;
+							return pos;
 					}
 				}
 			}
 			else if(lowOp == GTE){
 				if (attributeType == STRING) {
 					if (compare(itr, lowVal) >= 0) {
-						this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-						return pos;
+							return pos;
 					}
 				}
 				else {
 					if (compare<T>(itr, lowVal) >= 0) {
-						this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-						return pos;
+							return pos;
 					}
 				}
 			}
 			pos++;	
 		}
-		this->bufMgr->unPinPage(this->file,tmpPageNo,false);
 		result = (pos == leafOccupancy || currNode->ridArray[pos].page_number == 0)? (pos - 1):pos ;
 	}
 
@@ -538,16 +515,12 @@ bool leaf, bool nonleaf, PageId tmpPageNo, T lowVal){
 //
 const void BTreeIndex::openIndexFile(const std::string & relationName, const int attrByteOffset, const Datatype attrType) 
 {
-	Page* metaPage; // header page that stores struct IndexMetaInfo
-	Page* rootPage; // root of Btree
 	IndexMetaInfo * meta;
 
-	// Read meta info page (header page)
+	// Read meta info page (header page), unpinned again on return
 	this->headerPageNum = file->getFirstPageNo(); 	
-	this->bufMgr->readPage(this->file, this->headerPageNum, metaPage);
-
-	// Unpin file
-	meta = (IndexMetaInfo *) metaPage;	
+	PageHandle metaPage = this->bufMgr->fetch(this->file, this->headerPageNum);
+	meta = (IndexMetaInfo *) metaPage.get();
 	
 	// Save attributes
 	if (meta->attrByteOffset == attrByteOffset && meta->attrType == attrType) {
@@ -575,8 +548,6 @@ const void BTreeIndex::openIndexFile(const std::string & relationName, const int
 		this->nodeOccupancy = STRINGARRAYNONLEAFSIZE; 
 	}
 
-	this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
-
 }
 
 
@@ -587,8 +558,6 @@ const void BTreeIndex::openIndexFile(const std::string & relationName, const int
 //
 const void BTreeIndex::createIndexFile(const std::string & relationName, const int attrByteOffset, const Datatype attrType)
 {
-	Page* metaPage; // header page that stores struct IndexMetaInfo
-	Page* rootPage; // root of Btree
 	IndexMetaInfo * meta;
 	// Save attributes
 	this->attrByteOffset = attrByteOffset;
@@ -596,10 +565,12 @@ const void BTreeIndex::createIndexFile(const std::string & relationName, const i
 	this->rootIsLeaf = true; // root node is initially a LeafNode
 
 	// allocate metaInfo page, allocate root page
-	this->bufMgr->allocPage(this->file, this->headerPageNum, metaPage);
-	this->bufMgr->allocPage(this->file, this->rootPageNum, rootPage);
+	PageHandle metaPage = this->bufMgr->allocate(this->file, this->headerPageNum);
+	PageHandle rootPage = this->bufMgr->allocate(this->file, this->rootPageNum);
+	metaPage.markDirty();
+	rootPage.markDirty();
 
-	meta = (IndexMetaInfo *) metaPage;
+	meta = (IndexMetaInfo *) metaPage.get();
 
 	meta->attrByteOffset = this->attrByteOffset;
 	meta->attrType = this->attributeType;
@@ -608,28 +579,28 @@ const void BTreeIndex::createIndexFile(const std::string & relationName, const i
 
 	// Cast rootPage to LeafNode (root is a leaf for a new Btree)
 	if (attrType == INTEGER) {
-		LeafNodeInt* root = (LeafNodeInt*)rootPage;
+		LeafNodeInt* root = (LeafNodeInt*)rootPage.get();
 		root->rightSibPageNo = 0;
 	}
 	else if (attrType == DOUBLE) {
-		LeafNodeDouble* root = (LeafNodeDouble*)rootPage;
+		LeafNodeDouble* root = (LeafNodeDouble*)rootPage.get();
 		root->rightSibPageNo = 0;
 	}
 	else if (attrType == STRING) {
-		LeafNodeString* root = (LeafNodeString*)rootPage;
+		LeafNodeString* root = (LeafNodeString*)rootPage.get();
 		root->rightSibPageNo = 0;
 	}
 
 
-	this->bufMgr->unPinPage(this->file, this->rootPageNum, true);
-	this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+	rootPage.release();
+	metaPage.release();
 
-	// Scan the relation file
+	// Scan the relation file through the bulk read ring, so the index pages being built
+	// keep the rest of the buffer pool
 
-	FileScan* scan = new FileScan(relationName, this->bufMgr);
+	FileScan* scan = new FileScan(relationName, this->bufMgr, BULK_READ);
 	try {
 		while (1) {
-			std::string recordString;
 			const char* record;
 
 			//const char* key;
@@ -638,9 +609,9 @@ const void BTreeIndex::createIndexFile(const std::string & relationName, const i
 			double attr_double;
 
 			// Iterate the records in relation file
+			// the record is read in place, its page stays pinned by the scan
 			scan->scanNext(rid);
-			recordString = scan->getRecord();
-			record = recordString.c_str();
+			record = scan->viewRecord().data();
 			void* key = (void*)(record+attrByteOffset);
 			insertEntry(key,rid);
 		}
@@ -663,12 +634,11 @@ const void BTreeIndex::createIndexFile(const std::string & relationName, const i
 // ----------------------------------------------------------------------------
 template<class T, class L_T,class NL_T,class P_T, class RID_T> void BTreeIndex::insertRootLeaf( RID_T RIDPair){
 
-	Page* leafPage;
 	L_T* leafNode;
 
-	this->bufMgr->readPage(this->file, this->rootPageNum, leafPage);
-	PageId oldPageNum = this->rootPageNum;
-	leafNode = (L_T*) leafPage;
+	PageHandle leafPage = this->bufMgr->fetch(this->file, this->rootPageNum);
+	leafPage.markDirty();
+	leafNode = (L_T*) leafPage.get();
 
 	// If rootLeaf is not full just put the entry in
 	if ( leafNode->ridArray[this->leafOccupancy-1].page_number == 0 ) {
@@ -683,7 +653,6 @@ template<class T, class L_T,class NL_T,class P_T, class RID_T> void BTreeIndex::
 		createNewRoot<T, L_T,NL_T,P_T,RID_T>(rootPageNum, newChildPage, true);
 
 	}
-	this->bufMgr->unPinPage(this->file, oldPageNum, true);
 }
 
 // -----------------------------------------------------------------------------
@@ -818,12 +787,12 @@ template<class T, class NL_T,class P_T> void BTreeIndex::putEntryNonLeaf(NL_T* n
 // ----------------------------------------------------------------------------
 template<class T, class L_T,class P_T,class RID_T> void BTreeIndex::splitLeaf(L_T* leafNode, RID_T RIDPair, P_T& rightFirst) {
 	PageId newPageNo;
-	Page* newPage;
 	L_T* newLeafNode;
 	int mid = leafOccupancy/2+1;
 
-	this->bufMgr->allocPage(this->file, newPageNo, newPage); // allocate a new page
-	newLeafNode = (L_T*)newPage; // create new leaf node
+	PageHandle newPage = this->bufMgr->allocate(this->file, newPageNo); // allocate a new page
+	newPage.markDirty();
+	newLeafNode = (L_T*)newPage.get(); // create new leaf node
 
 	for (int i = mid; i < leafOccupancy; i++) {
 		newLeafNode->ridArray[i-mid] = leafNode->ridArray[i];
@@ -849,8 +818,6 @@ template<class T, class L_T,class P_T,class RID_T> void BTreeIndex::splitLeaf(L_
 		putEntryLeaf<T, L_T,RID_T>(newLeafNode,RIDPair);
 	}
 
-	bufMgr->unPinPage(file, newPageNo, true);
-
 }
 
 
@@ -860,12 +827,12 @@ template<class T, class L_T,class P_T,class RID_T> void BTreeIndex::splitLeaf(L_
 // ----------------------------------------------------------------------------
 template<class T, class NL_T,class P_T> void BTreeIndex::splitNonLeaf(NL_T* nonLeafNode, P_T pagePair2insert, P_T& rightFirstEntry) {
 	PageId newPageNo;
-	Page* newPage;
 	NL_T* newNonLeafNode;
 	int mid = nodeOccupancy/2+1;
 
-	this->bufMgr->allocPage(file, newPageNo, newPage);
-	newNonLeafNode = (NL_T*)newPage;
+	PageHandle newPage = this->bufMgr->allocate(file, newPageNo);
+	newPage.markDirty();
+	newNonLeafNode = (NL_T*)newPage.get();
 
 	// new node has same level with spliteed node
 	newNonLeafNode->level = nonLeafNode->level; 
@@ -893,8 +860,6 @@ template<class T, class NL_T,class P_T> void BTreeIndex::splitNonLeaf(NL_T* nonL
 		putEntryNonLeaf <T, NL_T,P_T> (newNonLeafNode, pagePair2insert);
 	}
 
-	bufMgr->unPinPage(file, newPageNo, true);
-
 } 
 
 
@@ -903,15 +868,14 @@ template<class T, class NL_T,class P_T> void BTreeIndex::splitNonLeaf(NL_T* nonL
 // create a new root node (non-leaf)
 // ----------------------------------------------------------------------------
 template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::createNewRoot(PageId left, P_T rightFirst, bool isLeaf){
-	Page* newRootPage;
 	PageId newRootPageNo;
-	Page* headerPage;
 	NL_T* newRootNode;
 	IndexMetaInfo * meta;
 
-	this->bufMgr->allocPage(file, newRootPageNo, newRootPage); // allocate a new page
+	PageHandle newRootPage = this->bufMgr->allocate(file, newRootPageNo); // allocate a new page
+	newRootPage.markDirty();
 	// insert new values
-	newRootNode = (NL_T*)newRootPage;
+	newRootNode = (NL_T*)newRootPage.get();
 	newRootNode->pageNoArray[0] = left;
 	newRootNode->pageNoArray[1] = rightFirst.pageNo;
 
@@ -930,13 +894,13 @@ template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::c
 	}
 	this->rootPageNum = newRootPageNo;
 	this->rootIsLeaf = false;
-	this->bufMgr->unPinPage(file, newRootPageNo, true);
+	newRootPage.release();
 
-	this->bufMgr->readPage(file, headerPageNum, headerPage);
-	meta = (IndexMetaInfo*) headerPage;
+	PageHandle headerPage = this->bufMgr->fetch(file, headerPageNum);
+	meta = (IndexMetaInfo*) headerPage.get();
 	meta->rootPageNo = this->rootPageNum;
 	// write back
-	this->bufMgr->unPinPage(file, headerPageNum, true);
+	headerPage.markDirty();
 
 }
 
@@ -948,11 +912,9 @@ template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::t
 	Page* rightPage;
 	int pos = 0;
 	PageId childPageNo;
-	Page* childPage;
 	L_T* childLeafNode;
 	NL_T* childNonLeafNode;
 
-	Page* currPage;
 	NL_T* currNode;
 
 	P_T itr;
@@ -960,8 +922,8 @@ template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::t
 	P_T pagePair2insert;
 
 
-	this->bufMgr->readPage(file, currPageNo, currPage);
-	currNode = (NL_T*) currPage;
+	PageHandle currPage = this->bufMgr->fetch(file, currPageNo);
+	currNode = (NL_T*) currPage.get();
 
 	while (pos < nodeOccupancy && currNode->pageNoArray[pos] != 0) {
 		itr.set( currNode->pageNoArray[pos], currNode->keyArray[pos]);
@@ -978,8 +940,10 @@ template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::t
 	// check level, if currNode is at level 1 just insert entry into leaf node
 	if (currNode->level == 1) {
 		// check if leaf node is full, if it is need to split leaf node
-		this->bufMgr->readPage(file, childPageNo, childPage);
-		L_T* childLeafNode = (L_T*) childPage;
+		PageHandle childPage = this->bufMgr->fetch(file, childPageNo);
+		childPage.markDirty();
+		currPage.markDirty();
+		L_T* childLeafNode = (L_T*) childPage.get();
 
 		if ( (childLeafNode->ridArray[leafOccupancy-1]).page_number == 0) {
 			putEntryLeaf<T, L_T,RID_T>(childLeafNode, RIDPair2insert);
@@ -996,8 +960,6 @@ template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::t
 		  	newPagePair = rightFirstEntry;
 		  }
 		}
-		this->bufMgr->unPinPage(file,childPageNo,true); 
-		this->bufMgr->unPinPage(file,currPageNo,true);
 		return;
 	}
 
@@ -1008,14 +970,16 @@ template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::t
 
 	newChildPagePair.set(0,dummykey);
 
-	// if currNode is at level 0
-	this->bufMgr->unPinPage(file,currPageNo,false); 
+	// if currNode is at level 0, let go of it while the insert goes further down
+	currPage.release();
   traverse<T, L_T, NL_T, P_T, RID_T> (childPageNo, newChildPagePair, RIDPair2insert);
 
-  Page* newReadCurr;
-  this->bufMgr->readPage(file,currPageNo,newReadCurr);
+  // the node may have moved to another frame meanwhile
+  currPage = this->bufMgr->fetch(file,currPageNo);
+  currNode = (NL_T*) currPage.get();
 
   if (newChildPagePair.pageNo != 0) {
+  	currPage.markDirty();
   	pagePair2insert.set(newChildPagePair.pageNo, newChildPagePair.key);
 
   	if (currNode->pageNoArray[nodeOccupancy]==0) {
@@ -1028,7 +992,6 @@ template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::t
 			newPagePair = rightFirstEntry;
   	}
   }
-  this->bufMgr->unPinPage(file, currPageNo, (newChildPagePair.pageNo !=0) ); 
 
 }
 
@@ -368,9 +368,9 @@ class BTreeIndex {
   PageId  currentPageNum;
 
   /**
-   * Current Page being scanned.
+   * Current Page being scanned, pinned until the scan moves on or ends.
    */
-  Page    *currentPageData;
+  PageHandle currentPage;
 
   /**
    * Low INTEGER value for scan.
@@ -0,0 +1,127 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cerrno>
+#include "bufTrace.h"
+#include "exceptions/file_io_exception.h"
+
+namespace badgerdb {
+
+/**
+ * First word of every trace file
+ */
+static const std::uint32_t TRACE_MAGIC = 0x54424442;
+
+/**
+ * Records buffered before they are written
+ */
+static const std::size_t TRACE_BLOCK = 4096;
+
+//----------------------------------------
+// BufTraceWriter
+//----------------------------------------
+
+BufTraceWriter::BufTraceWriter(const std::string& tracePath)
+	: path(tracePath)
+{
+	out = std::fopen(path.c_str(), "wb");
+	if (out == NULL)
+		throw FileIOException(path, errno);
+	if (std::fwrite(&TRACE_MAGIC, sizeof(TRACE_MAGIC), 1, out) != 1)
+	{
+		int error = errno;
+		std::fclose(out);
+		throw FileIOException(path, error);
+	}
+	pending.reserve(TRACE_BLOCK);
+}
+
+BufTraceWriter::~BufTraceWriter()
+{
+	try
+	{
+		flush();
+	}
+	catch (FileIOException e)
+	{
+		// the trace is cut short, nothing else depends on it
+	}
+	std::fclose(out);
+}
+
+void BufTraceWriter::flush()
+{
+	if (pending.empty())
+		return;
+	std::size_t count = pending.size();
+	std::size_t n = std::fwrite(&pending[0], sizeof(TraceRecord), count, out);
+	pending.clear();
+	if (n != count)
+		throw FileIOException(path, errno);
+}
+
+void BufTraceWriter::record(const TraceOp op, const File* file, const PageId pageNo, const bool dirty)
+{
+	std::map<const File*, std::uint16_t>::iterator it = fileIds.find(file);
+	if (it == fileIds.end())
+	{
+		// name the file before its first access
+		std::uint16_t fileId = (std::uint16_t) fileIds.size();
+		it = fileIds.insert(std::make_pair(file, fileId)).first;
+		const std::string& name = file->filename();
+		TraceRecord intro = {(std::uint32_t) name.size(), fileId, TRACE_FILE, 0};
+		flush();
+		if (std::fwrite(&intro, sizeof(intro), 1, out) != 1 ||
+				std::fwrite(name.data(), 1, name.size(), out) != name.size())
+			throw FileIOException(path, errno);
+	}
+
+	TraceRecord rec = {pageNo, it->second, (std::uint8_t) op, (std::uint8_t) (dirty ? 1 : 0)};
+	pending.push_back(rec);
+	if (pending.size() >= TRACE_BLOCK)
+		flush();
+}
+
+//----------------------------------------
+// BufTraceReader
+//----------------------------------------
+
+BufTraceReader::BufTraceReader(const std::string& tracePath)
+{
+	in = std::fopen(tracePath.c_str(), "rb");
+	if (in == NULL)
+		throw FileIOException(tracePath, errno);
+	std::uint32_t magic;
+	if (std::fread(&magic, sizeof(magic), 1, in) != 1 || magic != TRACE_MAGIC)
+	{
+		std::fclose(in);
+		throw FileIOException(tracePath, EINVAL);
+	}
+}
+
+BufTraceReader::~BufTraceReader()
+{
+	std::fclose(in);
+}
+
+bool BufTraceReader::next(TraceRecord& rec)
+{
+	while (std::fread(&rec, sizeof(rec), 1, in) == 1)
+	{
+		if (rec.op != TRACE_FILE)
+			return true;
+		std::string name(rec.pageNo, '\0');
+		if (rec.pageNo > 0 && std::fread(&name[0], 1, rec.pageNo, in) != rec.pageNo)
+			return false;
+		if (fileNames.size() <= rec.fileId)
+			fileNames.resize(rec.fileId + 1);
+		fileNames[rec.fileId] = name;
+	}
+	return false;
+}
+
+}
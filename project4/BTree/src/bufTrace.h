@@ -0,0 +1,191 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+* @brief Buffer manager calls recorded in an access trace
+*/
+enum TraceOp {
+	/**
+	 * Introduces a file: fileId is its new id, pageNo the length of its name, and the
+	 * name follows the record
+	 */
+	TRACE_FILE = 0,
+
+	/**
+	 * readPage() of (fileId, pageNo)
+	 */
+	TRACE_READ = 1,
+
+	/**
+	 * allocPage() returned (fileId, pageNo)
+	 */
+	TRACE_ALLOC = 2,
+
+	/**
+	 * unPinPage() of (fileId, pageNo); dirty is set if the page was marked dirty
+	 */
+	TRACE_UNPIN = 3,
+
+	/**
+	 * disposePage() of (fileId, pageNo)
+	 */
+	TRACE_DISPOSE = 4
+};
+
+/**
+* @brief One record of an access trace, as stored on disk
+*/
+struct TraceRecord {
+	/**
+	 * Page number, or name length for TRACE_FILE
+	 */
+	std::uint32_t pageNo;
+
+	/**
+	 * Id of the file, numbered from 0 in order of first access
+	 */
+	std::uint16_t fileId;
+
+	/**
+	 * A TraceOp
+	 */
+	std::uint8_t op;
+
+	/**
+	 * 1 if an unpinned page was marked dirty, 0 otherwise
+	 */
+	std::uint8_t dirty;
+};
+
+static_assert(sizeof(TraceRecord) == 8, "Trace records must be 8 bytes on disk.");
+
+
+/**
+* @brief Appends buffer manager calls to a binary access trace
+*
+* The trace starts with a magic word and is a sequence of TraceRecords. The first access
+* to a file is preceded by a TRACE_FILE record naming it. Records are buffered and
+* written in blocks.
+*
+* @warning This class is not threadsafe.
+*/
+class BufTraceWriter
+{
+ private:
+	/**
+   * Trace file being written
+	 */
+	std::FILE* out;
+
+	/**
+   * Name of the trace file, for error messages
+	 */
+	std::string path;
+
+	/**
+   * Ids handed out to the files seen so far
+	 */
+	std::map<const File*, std::uint16_t> fileIds;
+
+	/**
+   * Records not yet written
+	 */
+	std::vector<TraceRecord> pending;
+
+	/**
+   * Write the pending records to the trace file
+	 */
+	void flush();
+
+	BufTraceWriter(const BufTraceWriter&);
+	BufTraceWriter& operator=(const BufTraceWriter&);
+
+ public:
+	/**
+   * Creates the trace file, replacing any file of that name
+	 *
+	 * @param tracePath	Name of the trace file
+	 * @throws FileIOException If the trace file cannot be created
+	 */
+	BufTraceWriter(const std::string& tracePath);
+
+	/**
+   * Writes out the remaining records and closes the trace file
+	 */
+	~BufTraceWriter();
+
+	/**
+   * Append a call on page pageNo of file
+	 */
+	void record(const TraceOp op, const File* file, const PageId pageNo, const bool dirty = false);
+};
+
+
+/**
+* @brief Reads an access trace written by BufTraceWriter
+*/
+class BufTraceReader
+{
+ private:
+	/**
+   * Trace file being read
+	 */
+	std::FILE* in;
+
+	/**
+   * Names of the files introduced so far, by id
+	 */
+	std::vector<std::string> fileNames;
+
+	BufTraceReader(const BufTraceReader&);
+	BufTraceReader& operator=(const BufTraceReader&);
+
+ public:
+	/**
+   * Opens the trace file
+	 *
+	 * @param tracePath	Name of the trace file
+	 * @throws FileIOException If the trace cannot be opened or is not a trace
+	 */
+	BufTraceReader(const std::string& tracePath);
+
+	/**
+   * Closes the trace file
+	 */
+	~BufTraceReader();
+
+	/**
+   * Read the next page access, taking TRACE_FILE records in along the way
+	 *
+	 * @param rec 	Record read, never TRACE_FILE
+	 * @return    	False at the end of the trace
+	 */
+	bool next(TraceRecord& rec);
+
+	/**
+   * Name of the file with the given id
+	 */
+	const std::string& fileName(const std::uint16_t fileId) const { return fileNames[fileId]; }
+
+	/**
+   * Number of files introduced so far
+	 */
+	std::size_t numFiles() const { return fileNames.size(); }
+};
+
+}
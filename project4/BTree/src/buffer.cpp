@@ -7,21 +7,110 @@
 
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <cstdint>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "buffer.h"
+#include "exceptions/badgerdb_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 namespace badgerdb { 
 
+/**
+ * Upper bound on the number of frames in the ring of a bulk access strategy
+ */
+static const std::uint32_t MAX_RING_FRAMES = 32;
+
+/**
+ * Number of pages read ahead once a file is found to be read sequentially, and the most
+ * the read-ahead window may grow to
+ */
+static const std::uint32_t MIN_READ_AHEAD = 2;
+static const std::uint32_t MAX_READ_AHEAD = 32;
+
+/**
+ * Longest run of consecutive pages written back with a single vectored write
+ */
+static const std::uint32_t MAX_WRITE_RUN = 64;
+
+static_assert(sizeof(Page) == Page::SIZE, "Frames must be exactly one page apart in the arena.");
+
+//----------------------------------------
+// BufArena
+//----------------------------------------
+
+const std::size_t BufArena::HUGE_PAGE_SIZE;
+
+static std::size_t roundUp(const std::size_t n, const std::size_t unit)
+{
+	return (n + unit - 1) / unit * unit;
+}
+
+BufArena::BufArena(const std::size_t bytes, const bool hugePages)
+	: base(NULL), length(0), backing(SMALL_PAGES)
+{
+	void* mem;
+	if (hugePages && bytes >= HUGE_PAGE_SIZE)
+	{
+		std::size_t hugeLength = roundUp(bytes, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+		// reserved huge pages never turn into small pages behind our back
+		mem = mmap(NULL, hugeLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mem != MAP_FAILED)
+		{
+			base = mem;
+			length = hugeLength;
+			backing = HUGETLB_PAGES;
+			return;
+		}
+#endif
+#ifdef MADV_HUGEPAGE
+		// transparent huge pages only cover 2 MB aligned ranges: map one huge page more
+		// than needed and trim both ends down to an aligned range
+		mem = mmap(NULL, hugeLength + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem != MAP_FAILED)
+		{
+			std::uintptr_t start = reinterpret_cast<std::uintptr_t>(mem);
+			std::uintptr_t aligned = roundUp(start, HUGE_PAGE_SIZE);
+			if (aligned > start)
+				munmap(mem, aligned - start);
+			if (start + HUGE_PAGE_SIZE > aligned)
+				munmap(reinterpret_cast<void*>(aligned + hugeLength), start + HUGE_PAGE_SIZE - aligned);
+			base = reinterpret_cast<void*>(aligned);
+			length = hugeLength;
+			if (madvise(base, length, MADV_HUGEPAGE) == 0)
+				backing = TRANSPARENT_HUGE_PAGES;
+			return;
+		}
+#endif
+	}
+
+	length = roundUp(bytes > 0 ? bytes : 1, sysconf(_SC_PAGESIZE));
+	mem = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		throw std::bad_alloc();
+	base = mem;
+}
+
+BufArena::~BufArena()
+{
+	munmap(base, length);
+}
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, const bool hugePages)
+	: numBufs(bufs), trace(NULL) {
 	bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) 
@@ -30,28 +119,46 @@ BufMgr::BufMgr(std::uint32_t bufs)
   	bufDescTable[i].valid = false;
   }
 
-  bufPool = new Page[bufs];
+  // frames are laid out back to back in one page aligned arena
+  arena = new BufArena(bufs * sizeof(Page), hugePages);
+  bufPool = static_cast<Page*>(arena->memory());
+  for (FrameId i = 0; i < bufs; i++)
+  	new (&bufPool[i]) Page();
 
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
   hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
 
   clockHand = bufs - 1;
+
+  // an eighth of the pool, but never more than a few hundred kilobytes: enough to keep
+  // the disk streaming without a scan pushing out a noticeable share of the working set
+  ringSize = std::max<std::uint32_t>(1, std::min<std::uint32_t>(MAX_RING_FRAMES, bufs / 8));
+  for (int r = 0; r < 2; r++)
+  {
+  	rings[r].frames = new FrameId[ringSize];
+  	rings[r].used = 0;
+  	rings[r].next = 0;
+  }
 }
 
 
 BufMgr::~BufMgr() {
   //Flush out all unwritten pages
+  std::vector<FrameId> dirtyFrames;
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
-  	BufDesc* tmpbuf = &bufDescTable[i];
-  	if (tmpbuf->valid == true && tmpbuf->dirty == true)
-		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-  	}
+  	if (bufDescTable[i].valid == true && bufDescTable[i].dirty == true)
+			dirtyFrames.push_back(i);
   }
+  writeBack(dirtyFrames);
 
+  stopTrace();
   delete [] bufDescTable;
-  delete [] bufPool;
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  	bufPool[i].~Page();
+  delete arena;
+  delete [] rings[0].frames;
+  delete [] rings[1].frames;
 }
 
 void BufMgr::allocBuf(FrameId & frame) 
@@ -82,7 +189,7 @@ void BufMgr::allocBuf(FrameId & frame)
       {
         // hasn't been referenced and is not pinned, use it
         // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
+        unmapFrame(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
         found = true;
         break;
       }
@@ -104,11 +211,12 @@ void BufMgr::allocBuf(FrameId & frame)
   // flush any existing changes to disk if necessary
   if (bufDescTable[clockHand].dirty)
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    writeVictim(clockHand);
   }
 
+  if (bufDescTable[clockHand].prefetched)
+    bufStats.prefetchwasted++;
+
 	//Reset all the BufDesc entry for the frame before returning the frame
   bufDescTable[clockHand].Clear();
 
@@ -116,25 +224,81 @@ void BufMgr::allocBuf(FrameId & frame)
   frame = clockHand;
 } // end allocBuf
 
+
+void BufMgr::allocRingBuf(const AccessStrategy strategy, FrameId & frame)
+{
+  BufRing& ring = rings[strategy == BULK_READ ? 0 : 1];
+
+  // still filling the ring, take frames from the clock like everybody else
+  if (ring.used < ringSize)
+  {
+    allocBuf(frame);
+    ring.frames[ring.used++] = frame;
+    return;
+  }
+
+  FrameId victim = ring.frames[ring.next];
+  BufDesc* tmpbuf = &bufDescTable[victim];
+
+  if (tmpbuf->valid && tmpbuf->ring == strategy && tmpbuf->pinCnt == 0)
+  {
+    // recycle the ring's oldest frame
+    unmapFrame(tmpbuf->file, tmpbuf->pageNo);
+    if (tmpbuf->dirty)
+    {
+      writeVictim(victim);
+    }
+    if (tmpbuf->prefetched)
+      bufStats.prefetchwasted++;
+    tmpbuf->Clear();
+    frame = victim;
+  }
+  else
+  {
+    // the frame left the ring (evicted, adopted by a normal access, or still pinned)
+    allocBuf(frame);
+  }
+
+  ring.frames[ring.next] = frame;
+  ring.next = (ring.next + 1) % ringSize;
+}
+
 	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, const AccessStrategy strategy)
 {
+  if (trace)
+    trace->record(TRACE_READ, file, pageNo);
+
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
 	try
 	{
+  	bufStats.lookups++;
   	hashTable->lookup(file, pageNo, frameNo);
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
+    // set the referenced bit, unless this is just a bulk pass going by. A normal access
+    // takes the frame out of any ring so the page is not recycled under the working set
+    if (strategy == NORMAL_ACCESS)
+    {
+      bufDescTable[frameNo].refbit = true;
+      bufDescTable[frameNo].ring = NORMAL_ACCESS;
+    }
+    if (bufDescTable[frameNo].prefetched)
+    {
+      bufStats.prefetchhits++;
+      bufDescTable[frameNo].prefetched = false;
+    }
     bufDescTable[frameNo].pinCnt++;
     page = &bufPool[frameNo];
   }
   catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
   {
     // alloc a new frame
-    allocBuf(frameNo);
+    if (strategy == NORMAL_ACCESS)
+      allocBuf(frameNo);
+    else
+      allocRingBuf(strategy, frameNo);
 
     // read the page into the new frame
     bufStats.diskreads++;
@@ -143,11 +307,265 @@ void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 
     // set up the entry properly
     bufDescTable[frameNo].Set(file, pageNo);
+    if (strategy != NORMAL_ACCESS)
+    {
+      // first in line for the clock too, should the ring move on without it
+      bufDescTable[frameNo].refbit = false;
+      bufDescTable[frameNo].ring = strategy;
+    }
     page = &bufPool[frameNo];
 
     // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    mapFrame(file, pageNo, frameNo);
+  }
+
+  detectSequential(file, pageNo, strategy);
+}
+
+
+void BufMgr::detectSequential(File* file, const PageId pageNo, const AccessStrategy strategy)
+{
+  ReadAheadState& state = readAhead[file];
+  bool sequential = (pageNo == state.lastPage + 1);
+  state.lastPage = pageNo;
+
+  if (!sequential)
+  {
+    state.window = 0;
+    state.aheadUntil = pageNo;
+    return;
+  }
+
+  // never read ahead further than half a ring, or the ring would recycle
+  // pages before they are used
+  std::uint32_t limit = std::min<std::uint32_t>(MAX_READ_AHEAD, std::max<std::uint32_t>(1, numBufs / 4));
+  if (strategy != NORMAL_ACCESS)
+    limit = std::min<std::uint32_t>(limit, std::max<std::uint32_t>(1, ringSize / 2));
+
+  if (state.window == 0)
+  {
+    // start of a sequential run
+    state.window = std::min(MIN_READ_AHEAD, limit);
+    state.aheadUntil = pageNo;
+  }
+  else if (state.aheadUntil > pageNo + state.window / 2)
+  {
+    // wait until the reader is half way through what was read ahead
+    return;
+  }
+  else
+  {
+    // the reader is catching up with the window, so it paid off: grow it
+    state.window = std::min(2 * state.window, limit);
+  }
+
+  const PageId first = std::max(state.aheadUntil, pageNo) + 1;
+  if (first <= pageNo + state.window)
+    state.aheadUntil = prefetch(file, first, pageNo + state.window, strategy);
+}
+
+
+PageId BufMgr::prefetch(File* file, const PageId first, const PageId last, const AccessStrategy strategy)
+{
+  std::vector<FrameId> frames;
+  std::vector<Page*> pages;
+  PageId runStart = first;
+  PageId pageNo = first;
+
+  for (;; pageNo++)
+  {
+    // gather the pages not in the pool yet into one run, and read the run
+    // as soon as a page breaks it
+    bool resident = false;
+    bool haveFrame = false;
+    FrameId frameNo = 0;
+    if (pageNo <= last)
+    {
+      try
+      {
+        bufStats.lookups++;
+        hashTable->lookup(file, pageNo, frameNo);
+        resident = true;
+      }
+      catch(HashNotFoundException e)
+      {
+        haveFrame = allocReadAheadBuf(strategy, frameNo);
+      }
+    }
+
+    if (haveFrame)
+    {
+      // pinned until it is read, so the frame is not handed out twice
+      bufDescTable[frameNo].Set(file, pageNo);
+      if (frames.empty())
+        runStart = pageNo;
+      frames.push_back(frameNo);
+      pages.push_back(&bufPool[frameNo]);
+      continue;
+    }
+
+    if (!frames.empty())
+    {
+      std::uint32_t count = frames.size();
+      try
+      {
+        file->readPages(runStart, count, &pages[0]);
+      }
+      catch(InvalidPageException e)
+      {
+        // end of the file, or a page deleted in between: keep what was read before it
+        count = e.page_number() - runStart;
+      }
+      catch(BadgerDbException e)
+      {
+        // read-ahead is only a hint, a failed read is left to the reader to report
+        count = 0;
+      }
+      catch(...)
+      {
+        for (std::uint32_t i = 0; i < frames.size(); i++)
+          bufDescTable[frames[i]].Clear();
+        throw;
+      }
+
+      for (std::uint32_t i = 0; i < frames.size(); i++)
+      {
+        BufDesc& desc = bufDescTable[frames[i]];
+        if (i >= count)
+        {
+          desc.Clear();
+          continue;
+        }
+        bufStats.diskreads++;
+        bufStats.prefetches++;
+        desc.pinCnt = 0;
+        desc.refbit = false;
+        desc.ring = strategy;
+        desc.prefetched = true;
+        mapFrame(file, runStart + i, frames[i]);
+      }
+
+      if (count < frames.size())
+        return runStart + count - 1;
+      frames.clear();
+      pages.clear();
+    }
+
+    // out of clean frames, or past the window
+    if (!resident)
+      return pageNo - 1;
+  }
+}
+
+
+bool BufMgr::allocReadAheadBuf(const AccessStrategy strategy, FrameId & frame)
+{
+  BufRing* ring = NULL;
+  if (strategy != NORMAL_ACCESS)
+  {
+    ring = &rings[strategy == BULK_READ ? 0 : 1];
+    if (ring->used == ringSize)
+    {
+      FrameId victim = ring->frames[ring->next];
+      BufDesc* tmpbuf = &bufDescTable[victim];
+      if (tmpbuf->valid && tmpbuf->ring == strategy && tmpbuf->pinCnt == 0)
+      {
+        // the ring's oldest frame is next, but writing it back is the reader's job
+        if (tmpbuf->dirty)
+          return false;
+        unmapFrame(tmpbuf->file, tmpbuf->pageNo);
+        if (tmpbuf->prefetched)
+          bufStats.prefetchwasted++;
+        tmpbuf->Clear();
+        frame = victim;
+        ring->next = (ring->next + 1) % ringSize;
+        return true;
+      }
+    }
+  }
+
+  // one turn of the clock for an empty frame or a clean one nobody uses, leaving
+  // the reference bits alone: pages merely guessed at must not age the working set,
+  // nor push out other pages read ahead and still waiting for their reader
+  bool found = false;
+  for (std::uint32_t numScanned = 0; numScanned < numBufs && !found; numScanned++)
+  {
+    advanceClock();
+    BufDesc* tmpbuf = &bufDescTable[clockHand];
+    if (!tmpbuf->valid)
+      found = true;
+    else if (!tmpbuf->refbit && tmpbuf->pinCnt == 0 && !tmpbuf->dirty && !tmpbuf->prefetched)
+    {
+      unmapFrame(tmpbuf->file, tmpbuf->pageNo);
+      found = true;
+    }
+  }
+  if (!found)
+    return false;
+
+  bufDescTable[clockHand].Clear();
+  frame = clockHand;
+
+  if (ring != NULL)
+  {
+    if (ring->used < ringSize)
+      ring->frames[ring->used++] = frame;
+    else
+    {
+      // the frame due in the ring left it, this one takes its place
+      ring->frames[ring->next] = frame;
+      ring->next = (ring->next + 1) % ringSize;
+    }
+  }
+  return true;
+}
+
+
+void BufMgr::prefetchPage(File* file, const PageId pageNo)
+{
+  prefetch(file, pageNo, pageNo, NORMAL_ACCESS);
+}
+
+
+bool BufMgr::cachePage(File* file, const PageId pageNo, const Page& page, const AccessStrategy strategy)
+{
+  FrameId frameNo = 0;
+	try
+	{
+  	bufStats.lookups++;
+  	hashTable->lookup(file, pageNo, frameNo);
+    return true;
+  }
+  catch(HashNotFoundException e)
+  {
+  }
+
+  try
+  {
+    if (strategy == NORMAL_ACCESS)
+      allocBuf(frameNo);
+    else
+      allocRingBuf(strategy, frameNo);
+  }
+  catch(BadgerDbException e)
+  {
+    // every frame pinned, or the victim could not be written back
+    return false;
   }
+
+  bufPool[frameNo] = page;
+
+  // the file has the same contents, so the frame is clean
+  bufDescTable[frameNo].Set(file, pageNo);
+  bufDescTable[frameNo].pinCnt = 0;
+  if (strategy != NORMAL_ACCESS)
+  {
+    bufDescTable[frameNo].refbit = false;
+    bufDescTable[frameNo].ring = strategy;
+  }
+
+  mapFrame(file, pageNo, frameNo);
+  return true;
 }
 
 
@@ -156,66 +574,301 @@ void BufMgr::unPinPage(File* file, const PageId pageNo,
 {
   // lookup in hashtable
   FrameId frameNo = 0;
+  bufStats.lookups++;
   hashTable->lookup(file, pageNo, frameNo);
 
+  unPinFrame(frameNo, dirty);
+}
+
+
+void BufMgr::unPinFrame(const FrameId frameNo, const bool dirty)
+{
   if (dirty == true) bufDescTable[frameNo].dirty = dirty;
 
   // make sure the page is actually pinned
   if (bufDescTable[frameNo].pinCnt == 0)
   {
-  	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+  	throw PageNotPinnedException(bufDescTable[frameNo].file->filename(), bufDescTable[frameNo].pageNo, frameNo);
   }
   else bufDescTable[frameNo].pinCnt--;
+
+  if (trace)
+    trace->record(TRACE_UNPIN, bufDescTable[frameNo].file, bufDescTable[frameNo].pageNo, dirty);
+}
+
+
+PageHandle BufMgr::fetch(File* file, const PageId pageNo, const AccessStrategy strategy)
+{
+  Page* page;
+  readPage(file, pageNo, page, strategy);
+  return PageHandle(this, (FrameId) (page - bufPool), page);
+}
+
+
+PageHandle BufMgr::allocate(File* file, PageId &pageNo, const AccessStrategy strategy)
+{
+  Page* page;
+  allocPage(file, pageNo, page, strategy);
+  return PageHandle(this, (FrameId) (page - bufPool), page);
+}
+
+
+PageHandle::PageHandle(PageHandle&& other)
+  : bufMgr(other.bufMgr), frameNo(other.frameNo), page(other.page), dirty(other.dirty)
+{
+  other.bufMgr = NULL;
+  other.page = NULL;
+  other.dirty = false;
+}
+
+
+PageHandle& PageHandle::operator=(PageHandle&& other)
+{
+  if (this != &other)
+  {
+    release();
+    bufMgr = other.bufMgr;
+    frameNo = other.frameNo;
+    page = other.page;
+    dirty = other.dirty;
+    other.bufMgr = NULL;
+    other.page = NULL;
+    other.dirty = false;
+  }
+  return *this;
+}
+
+
+PageHandle::~PageHandle()
+{
+  // destructors must not throw; a pin that is already gone has nothing left to release
+  try
+  {
+    release();
+  }
+  catch(PageNotPinnedException e)
+  {
+  }
+}
+
+
+void PageHandle::release()
+{
+  if (page == NULL)
+    return;
+
+  BufMgr* mgr = bufMgr;
+  bool wasDirty = dirty;
+  bufMgr = NULL;
+  page = NULL;
+  dirty = false;
+  mgr->bufStats.handleunpins++;
+  mgr->unPinFrame(frameNo, wasDirty);
 }
 
 void BufMgr::flushFile(const File* file) 
 {
+  std::map<const File*, std::map<PageId, FrameId> >::iterator entry = fileFrames.find(file);
+  if (entry != fileFrames.end())
+  {
+    std::map<PageId, FrameId>& frames = entry->second;
+    std::map<PageId, FrameId>::iterator it;
+
+    // refuse before writing anything if some page is still in use
+    for (it = frames.begin(); it != frames.end(); ++it)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[it->second]);
+      if (tmpbuf->valid == false)
+        throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+      if (tmpbuf->pinCnt > 0)
+        throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+    }
+
+    // the map is ordered by page number, so dirty pages go out as one ascending sweep
+    std::vector<FrameId> dirtyFrames;
+    for (it = frames.begin(); it != frames.end(); ++it)
+    {
+      if (bufDescTable[it->second].dirty == true)
+        dirtyFrames.push_back(it->second);
+    }
+    writeBack(dirtyFrames);
+
+    for (it = frames.begin(); it != frames.end(); ++it)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[it->second]);
+      if (tmpbuf->prefetched)
+        bufStats.prefetchwasted++;
+
+      hashTable->remove(file, tmpbuf->pageNo);
+      tmpbuf->Clear();
+    }
+    fileFrames.erase(entry);
+  }
+
+  // the next reader of the file starts from scratch
+  readAhead.erase(file);
+
+  // this is where the file's writes become durable, whatever its mode
+  file->sync();
+}
+
+void BufMgr::checkpoint()
+{
+  std::vector<FrameId> dirtyFrames;
   for (std::uint32_t i = 0; i < numBufs; i++)
-	{
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->valid == true && tmpbuf->file == file)
-		{
-	    if (tmpbuf->pinCnt > 0)
-  			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+  {
+    BufDesc* tmpbuf = &bufDescTable[i];
+    if (tmpbuf->valid && tmpbuf->dirty && tmpbuf->pinCnt == 0)
+      dirtyFrames.push_back(i);
+  }
+  writeBack(dirtyFrames);
+
+  // writeBack() left the frames sorted by file
+  const File* synced = NULL;
+  for (std::size_t i = 0; i < dirtyFrames.size(); i++)
+  {
+    File* file = bufDescTable[dirtyFrames[i]].file;
+    if (file != synced)
+    {
+      file->sync();
+      synced = file;
+    }
+  }
+}
 
-	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
 
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
-  	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+void BufMgr::writeBack(std::vector<FrameId>& frames)
+{
+  std::sort(frames.begin(), frames.end(), [this](const FrameId a, const FrameId b) {
+    const BufDesc& descA = bufDescTable[a];
+    const BufDesc& descB = bufDescTable[b];
+    if (descA.file != descB.file)
+      return std::less<const File*>()(descA.file, descB.file);
+    return descA.pageNo < descB.pageNo;
+  });
+
+  std::vector<const Page*> run;
+  std::size_t i = 0;
+  while (i < frames.size())
+  {
+    BufDesc* head = &bufDescTable[frames[i]];
+
+    // extend the run while the next frame holds the next page of the same file
+    run.clear();
+    run.push_back(&bufPool[frames[i]]);
+    std::size_t j = i + 1;
+    while (j < frames.size() && run.size() < MAX_WRITE_RUN
+        && bufDescTable[frames[j]].file == head->file
+        && bufDescTable[frames[j]].pageNo == head->pageNo + run.size())
+    {
+      run.push_back(&bufPool[frames[j]]);
+      j++;
+    }
+
+    head->file->writePages(head->pageNo, (std::uint32_t) run.size(), &run[0]);
+    bufStats.diskwrites += run.size();
+    bufStats.writecalls++;
+
+    for (; i < j; i++)
+      bufDescTable[frames[i]].dirty = false;
   }
 }
 
+
+void BufMgr::writeVictim(const FrameId frame)
+{
+  BufDesc* victim = &bufDescTable[frame];
+  std::vector<FrameId> batch(1, frame);
+
+  std::map<const File*, std::map<PageId, FrameId> >::iterator entry = fileFrames.find(victim->file);
+  if (entry != fileFrames.end())
+  {
+    std::map<PageId, FrameId>& frames = entry->second;
+    std::map<PageId, FrameId>::iterator it = frames.upper_bound(victim->pageNo);
+
+    // dirty pages following the victim. Only those the clock would take soon
+    // anyway: a page still in use would just be dirtied and written again
+    PageId next = victim->pageNo + 1;
+    for (; it != frames.end() && batch.size() < MAX_WRITE_RUN; ++it, ++next)
+    {
+      BufDesc* tmpbuf = &bufDescTable[it->second];
+      if (it->first != next || !tmpbuf->dirty || tmpbuf->pinCnt > 0 || tmpbuf->refbit)
+        break;
+      batch.push_back(it->second);
+    }
+
+    // and preceding it
+    PageId prev = victim->pageNo;
+    it = frames.lower_bound(victim->pageNo);
+    while (it != frames.begin() && batch.size() < MAX_WRITE_RUN)
+    {
+      --it;
+      BufDesc* tmpbuf = &bufDescTable[it->second];
+      if (it->first != prev - 1 || !tmpbuf->dirty || tmpbuf->pinCnt > 0 || tmpbuf->refbit)
+        break;
+      batch.push_back(it->second);
+      prev--;
+    }
+  }
+
+  writeBack(batch);
+}
+
+
+void BufMgr::mapFrame(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  hashTable->insert(file, pageNo, frameNo);
+  fileFrames[file][pageNo] = frameNo;
+}
+
+
+void BufMgr::unmapFrame(const File* file, const PageId pageNo)
+{
+  hashTable->remove(file, pageNo);
+
+  std::map<const File*, std::map<PageId, FrameId> >::iterator entry = fileFrames.find(file);
+  entry->second.erase(pageNo);
+  if (entry->second.empty())
+    fileFrames.erase(entry);
+}
+
+
 void BufMgr::disposePage(File* file, const PageId pageNo) 
 {
+  if (trace)
+    trace->record(TRACE_DISPOSE, file, pageNo);
+
 	//Deallocate from file altogether
   //See if it is in the buffer pool
   FrameId frameNo = 0;
+  bufStats.lookups++;
   hashTable->lookup(file, pageNo, frameNo);
 
+  // a pin, or a PageHandle holding the frame, would outlive the page
+  if (bufDescTable[frameNo].pinCnt > 0)
+  {
+    throw PagePinnedException(file->filename(), pageNo, frameNo);
+  }
+
 	// clear the page
 	bufDescTable[frameNo].Clear();
 
-	hashTable->remove(file, pageNo);
+	unmapFrame(file, pageNo);
 
   // deallocate it in the file	
   file->deletePage(pageNo);
 }
 
 
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page, const AccessStrategy strategy) 
 {
   FrameId frameNo;
 
   // alloc a new frame
-  allocBuf(frameNo);
+  if (strategy == NORMAL_ACCESS)
+    allocBuf(frameNo);
+  else
+    allocRingBuf(strategy, frameNo);
 
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
@@ -224,9 +877,29 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
+  if (strategy != NORMAL_ACCESS)
+  {
+    bufDescTable[frameNo].refbit = false;
+    bufDescTable[frameNo].ring = strategy;
+  }
 
   // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  mapFrame(file, pageNo, frameNo);
+
+  if (trace)
+    trace->record(TRACE_ALLOC, file, pageNo);
+}
+
+void BufMgr::startTrace(const std::string& path)
+{
+  stopTrace();
+  trace = new BufTraceWriter(path);
+}
+
+void BufMgr::stopTrace()
+{
+  delete trace;
+  trace = NULL;
 }
 
 void BufMgr::printSelf(void) 
@@ -9,7 +9,10 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "bufTrace.h"
 #include <iostream>
+#include <map>
+#include <vector>
 
 namespace badgerdb {
 
@@ -18,6 +21,26 @@ namespace badgerdb {
 */
 class BufMgr;
 
+/**
+* @brief Hint passed to readPage() and allocPage() describing how the caller walks the file
+*/
+enum AccessStrategy {
+	/**
+	 * Page is part of the working set and competes for the whole buffer pool
+	 */
+	NORMAL_ACCESS,
+
+	/**
+	 * Page is read once as part of a sequential pass over the file (e.g. a relation scan)
+	 */
+	BULK_READ,
+
+	/**
+	 * Page is written once as part of a sequential pass over the file (e.g. a bulk load)
+	 */
+	BULK_WRITE
+};
+
 /**
 * @brief Class for maintaining information about buffer pool frames
 */
@@ -61,6 +84,16 @@ class BufDesc {
 	 */
   bool refbit;
 
+	/**
+   * Bulk strategy whose ring currently recycles this frame, NORMAL_ACCESS if none
+	 */
+  AccessStrategy ring;
+
+	/**
+   * True if the page was read ahead and has not been requested yet
+	 */
+  bool prefetched;
+
 	/**
    * Initialize buffer frame for a new user
 	 */
@@ -72,6 +105,8 @@ class BufDesc {
     dirty = false;
     refbit = false;
 		valid = false;
+		ring = NORMAL_ACCESS;
+		prefetched = false;
   };
 
 	/**
@@ -89,6 +124,8 @@ class BufDesc {
     dirty = false;
     valid = true;
     refbit = true;
+		ring = NORMAL_ACCESS;
+		prefetched = false;
   }
 
   void Print()
@@ -104,7 +141,8 @@ class BufDesc {
 		std::cout << "valid:" << valid << " ";
 		std::cout << "pinCnt:" << pinCnt << " ";
 		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "refbit:" << refbit << " ";
+		std::cout << "ring:" << ring << "\n";
   }
 
 	/**
@@ -137,12 +175,46 @@ struct BufStats
 	 */
   int diskwrites;
 
+	/**
+   * Number of write requests the pages in diskwrites went out with; consecutive dirty
+	 * pages of a file are written with one vectored write
+	 */
+  int writecalls;
+
+	/**
+   * Number of pages read ahead of a sequential reader (included in diskreads)
+	 */
+  int prefetches;
+
+	/**
+   * Number of read-ahead pages that were requested before being evicted
+	 */
+  int prefetchhits;
+
+	/**
+   * Number of read-ahead pages evicted or flushed without ever being requested
+	 */
+  int prefetchwasted;
+
+	/**
+   * Number of hash table lookups made by readPage(), unPinPage(), prefetching and disposePage()
+	 */
+  int lookups;
+
+	/**
+   * Number of pages unpinned through a PageHandle, each without the hash table lookup
+	 * unPinPage() makes
+	 */
+  int handleunpins;
+
 	/**
    * Clear all values 
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = diskreads = diskwrites = writecalls = 0;
+		prefetches = prefetchhits = prefetchwasted = 0;
+		lookups = handleunpins = 0;
   }
       
 	/**
@@ -155,11 +227,219 @@ struct BufStats
 };
 
 
+/**
+* @brief Small private set of frames that a bulk access strategy recycles in order
+*/
+struct BufRing
+{
+	/**
+   * Frames handed out to the ring so far, in the order they are reused
+	 */
+  FrameId *frames;
+
+	/**
+   * Number of entries of frames in use, at most BufMgr::ringSize
+	 */
+  std::uint32_t used;
+
+	/**
+   * Entry of frames to recycle next once the ring is full
+	 */
+  std::uint32_t next;
+};
+
+
+/**
+* @brief Sequential access detector BufMgr keeps for every file it reads
+*/
+struct ReadAheadState
+{
+	/**
+   * Page most recently requested through readPage()
+	 */
+  PageId lastPage;
+
+	/**
+   * Highest page read ahead so far
+	 */
+  PageId aheadUntil;
+
+	/**
+   * Number of pages to stay ahead of the reader, 0 while access is not sequential
+	 */
+  std::uint32_t window;
+};
+
+
+/**
+* @brief Pin on a page in the buffer pool, returned by BufMgr::fetch() and BufMgr::allocate()
+*
+* The handle knows the frame the page lives in, so releasing the pin does not look the
+* page up again the way unPinPage() does. The pin is released when the handle is
+* destroyed, reassigned or release()d, including on the way out of a function that
+* throws; the page is written back later if markDirty() was called. Handles can be moved
+* but not copied, so every pin has exactly one owner. An empty handle holds no pin.
+*/
+class PageHandle
+{
+	friend class BufMgr;
+
+ private:
+	/**
+   * Buffer manager holding the pin, NULL for an empty handle
+	 */
+  BufMgr* bufMgr;
+
+	/**
+   * Frame the page is pinned in
+	 */
+  FrameId frameNo;
+
+	/**
+   * The pinned page
+	 */
+  Page* page;
+
+	/**
+   * True if the page is to be marked dirty when the pin is released
+	 */
+  bool dirty;
+
+  PageHandle(BufMgr* mgr, FrameId frame, Page* pinned)
+		: bufMgr(mgr), frameNo(frame), page(pinned), dirty(false) {}
+
+  PageHandle(const PageHandle&);
+  PageHandle& operator=(const PageHandle&);
+
+ public:
+	/**
+   * Constructs an empty handle
+	 */
+  PageHandle() : bufMgr(NULL), frameNo(0), page(NULL), dirty(false) {}
+
+	/**
+   * Takes over the pin of other, leaving other empty
+	 */
+  PageHandle(PageHandle&& other);
+
+	/**
+   * Releases the pin held, then takes over the pin of other, leaving other empty
+	 */
+  PageHandle& operator=(PageHandle&& other);
+
+	/**
+   * Releases the pin held, if any
+	 */
+  ~PageHandle();
+
+	/**
+   * The pinned page, NULL for an empty handle
+	 */
+  Page* get() const { return page; }
+  Page* operator->() const { return page; }
+
+	/**
+   * True if the handle holds a pin
+	 */
+  bool pinned() const { return page != NULL; }
+
+	/**
+   * The page has been modified and must be written back before its frame is reused
+	 */
+  void markDirty() { dirty = true; }
+
+	/**
+	 * Unpin the page now, leaving the handle empty. Does nothing on an empty handle.
+	 *
+   * @throws  PageNotPinnedException If the page is no longer pinned
+	 */
+  void release();
+};
+
+
+/**
+* @brief Kind of memory backing the buffer pool's arena
+*/
+enum ArenaBacking {
+	/**
+	 * Ordinary pages of the operating system's page size
+	 */
+	SMALL_PAGES,
+
+	/**
+	 * 2 MB aligned memory the kernel was asked to back with transparent huge pages
+	 */
+	TRANSPARENT_HUGE_PAGES,
+
+	/**
+	 * Huge pages reserved through MAP_HUGETLB
+	 */
+	HUGETLB_PAGES
+};
+
+/**
+* @brief One anonymous mapping the buffer pool's frames are carved from
+*
+* The mapping starts on an operating system page boundary, so with Page::SIZE a multiple
+* of the page size every frame is page aligned, as O_DIRECT transfers need. For pools of
+* at least one huge page, huge pages can be requested: reserved MAP_HUGETLB pages if the
+* system has any, otherwise a 2 MB aligned mapping advised for transparent huge pages,
+* and plain pages if neither is available. Fewer TLB entries then cover the whole pool.
+*/
+class BufArena
+{
+ private:
+	/**
+   * Start of the mapping
+	 */
+  void* base;
+
+	/**
+   * Length of the mapping in bytes
+	 */
+  std::size_t length;
+
+	/**
+   * Kind of pages backing the mapping
+	 */
+  ArenaBacking backing;
+
+  BufArena(const BufArena&);
+  BufArena& operator=(const BufArena&);
+
+ public:
+	/**
+   * Size of a huge page on the platforms BadgerDB runs on
+	 */
+  static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	/**
+   * Map at least bytes of zeroed memory
+	 *
+	 * @param bytes   	Size needed
+	 * @param hugePages	Try huge pages before falling back to ordinary ones
+	 * @throws std::bad_alloc If no memory could be mapped at all
+	 */
+  BufArena(const std::size_t bytes, const bool hugePages);
+
+	/**
+   * Unmaps the arena
+	 */
+  ~BufArena();
+
+  void* memory() const { return base; }
+  std::size_t size() const { return length; }
+  ArenaBacking pages() const { return backing; }
+};
+
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
 */
 class BufMgr 
 {
+	friend class PageHandle;
+
  private:
 	/**
    * Current position of clockhand in our buffer pool
@@ -176,6 +456,16 @@ class BufMgr
 	 */
   BufHashTbl *hashTable;
 
+	/**
+   * Memory bufPool is carved from
+	 */
+  BufArena *arena;
+
+	/**
+   * Access trace being recorded, NULL when not tracing
+	 */
+  BufTraceWriter *trace;
+
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
 	 */
@@ -187,6 +477,16 @@ class BufMgr
   BufStats bufStats;
 
 	/**
+   * Number of frames in the ring of each bulk access strategy
+	 */
+  std::uint32_t ringSize;
+
+	/**
+   * Rings of the BULK_READ and BULK_WRITE strategies
+	 */
+  BufRing rings[2];
+
+	/**
 	 * Allocate a free frame.  
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
@@ -195,6 +495,106 @@ class BufMgr
   void allocBuf(FrameId & frame);
 
 	/**
+	 * Allocate a frame for a page accessed with a bulk strategy. Until its ring is full the
+	 * frame comes from allocBuf(); after that the ring's oldest frame is written back if
+	 * dirty and reused, so a sequential pass only ever occupies ringSize frames. A ring
+	 * frame that is pinned or has since been taken over by a normal access is replaced by
+	 * a fresh one from allocBuf().
+	 *
+	 * @param strategy	BULK_READ or BULK_WRITE
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocRingBuf(const AccessStrategy strategy, FrameId & frame);
+
+	/**
+   * Frames holding pages of each file, by page number. Kept in step with hashTable so
+	 * flushFile() only visits the file's own frames, in page order.
+	 */
+  std::map<const File*, std::map<PageId, FrameId> > fileFrames;
+
+	/**
+	 * Unpin the page in frame, which the caller already knows
+	 *
+   * @throws  PageNotPinnedException If the page is not pinned
+	 */
+  void unPinFrame(const FrameId frameNo, const bool dirty);
+
+	/**
+	 * Make the page (file, pageNo) resident in frame: enter it in hashTable and fileFrames
+	 */
+  void mapFrame(const File* file, const PageId pageNo, const FrameId frameNo);
+
+	/**
+	 * Forget the page (file, pageNo) in hashTable and fileFrames
+	 *
+   * @throws HashNotFoundException if the page is not in the buffer pool
+	 */
+  void unmapFrame(const File* file, const PageId pageNo);
+
+	/**
+	 * Write back the given dirty frames and mark them clean. The frames are sorted by
+	 * (file, page number) and every run of consecutive pages of a file, up to
+	 * MAX_WRITE_RUN pages long, goes out with one vectored write.
+	 *
+	 * @param frames  	Frames to write back, reordered by this call
+	 */
+  void writeBack(std::vector<FrameId>& frames);
+
+	/**
+	 * Write back the dirty page evicted from frame together with the dirty, unpinned and
+	 * unreferenced pages of its file directly before and after it, which stay in the pool
+	 * but clean.
+	 * The page must already be unmapped.
+	 *
+	 * @param frame   	Frame of the victim
+	 */
+  void writeVictim(const FrameId frame);
+
+	/**
+   * Sequential access detector of every file read so far
+	 */
+  std::map<const File*, ReadAheadState> readAhead;
+
+	/**
+	 * Called by readPage() for every request. Once a file is read page after page, keep
+	 * the next window pages read ahead, doubling the window (up to a limit depending on
+	 * the pool and ring sizes) every time the reader catches up with it, and dropping
+	 * back to nothing when the reader jumps.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number just requested
+	 * @param strategy	Access strategy of the request, used for the pages read ahead too
+	 */
+  void detectSequential(File* file, const PageId pageNo, const AccessStrategy strategy);
+
+	/**
+	 * Read pages first to last into the pool without pinning them, skipping those already
+	 * there. Each run of missing pages is read with a single File::readPages() call straight
+	 * into the frames from allocReadAheadBuf(). Read-ahead pages are not marked as
+	 * referenced, so unused ones are the first to go.
+	 *
+	 * @param file   	File object
+	 * @param first  	First page to read
+	 * @param last  	Last page to read
+	 * @param strategy	Access strategy the pages are read for
+	 * @return  			Last page up to which all pages are in the pool; stops early at the end
+	 *								of the file, when no clean frame is left or when a read fails
+	 */
+  PageId prefetch(File* file, const PageId first, const PageId last, const AccessStrategy strategy);
+
+	/**
+	 * Find a frame for a page read ahead, like allocRingBuf() or allocBuf() would, but
+	 * only ever an empty frame or a clean, unpinned and unreferenced one not itself read
+	 * ahead: read-ahead never writes anything back and does not clear reference bits.
+	 *
+	 * @param strategy	Access strategy the page is read for
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @return  			False if there is no such frame
+	 */
+  bool allocReadAheadBuf(const AccessStrategy strategy, FrameId & frame);
+
+	/**
    * Advance clock to next frame in the buffer pool
 	 */
   void advanceClock()
@@ -205,14 +605,22 @@ class BufMgr
 
  public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Actual buffer pool from which frames are allocated, laid out in arena
 	 */
   Page* bufPool;
 
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs    	Number of frames in the buffer pool
+	 * @param hugePages	Back the pool with huge pages where the system provides them
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, const bool hugePages = true);
+
+	/**
+   * Kind of memory pages the buffer pool ended up on
+	 */
+  ArenaBacking poolBacking() const { return arena->pages(); }
 	
 	/**
    * Destructor of BufMgr class
@@ -227,8 +635,54 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param strategy	How the caller walks the file. With BULK_READ or BULK_WRITE a page that is not
+	 *                	yet buffered is loaded into the strategy's ring instead of evicting the working
+	 *                	set, and a page that is buffered is not marked as recently referenced.
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, const AccessStrategy strategy = NORMAL_ACCESS);
+
+	/**
+	 * Reads the given page like readPage() and returns a handle holding the pin, which
+	 * is released without another hash table lookup.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param strategy	How the caller walks the file, see readPage()
+	 * @return  			Handle pinning the page
+	 */
+  PageHandle fetch(File* file, const PageId PageNo, const AccessStrategy strategy = NORMAL_ACCESS);
+
+	/**
+	 * Allocates a new page like allocPage() and returns a handle holding the pin.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param strategy	How the caller walks the file, see readPage()
+	 * @return  			Handle pinning the new page
+	 */
+  PageHandle allocate(File* file, PageId &PageNo, const AccessStrategy strategy = NORMAL_ACCESS);
+
+	/**
+	 * Hint that the given page will be read soon. Brings the page into the buffer pool
+	 * unpinned if it exists, a clean frame can be found and it can be read; never throws.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void prefetchPage(File* file, const PageId PageNo);
+
+	/**
+	 * Places a copy of a page just written to the file in the buffer pool, clean and
+	 * unpinned, so that it can be read without going to disk. A page already in the pool
+	 * is left as it is. Used by FileAppender; never throws.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file
+	 * @param page  	Contents of the page, as on disk
+	 * @param strategy	How the caller walks the file, see readPage()
+	 * @return  			False if no frame could be found for the page
+	 */
+  bool cachePage(File* file, const PageId PageNo, const Page& page, const AccessStrategy strategy = NORMAL_ACCESS);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -247,13 +701,16 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
 	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param strategy	How the caller walks the file, see readPage()
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  void allocPage(File* file, PageId &PageNo, Page*& page, const AccessStrategy strategy = NORMAL_ACCESS); 
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk in ascending page order, then syncs the file (see
+	 * File::sync()) so that everything written to it so far is durable.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
+	 * Otherwise Error returned, before anything has been written.
+	 * Only the frames holding pages of the file are visited.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
@@ -261,12 +718,20 @@ class BufMgr
 	 */
   void flushFile(const File* file);
 
+	/**
+	 * Writes out every dirty, unpinned page in the buffer pool, in (file, page) order
+	 * with one vectored write per run of consecutive pages, then syncs the files
+	 * written to. The pages stay in the pool.
+	 */
+  void checkpoint();
+
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number
+	 * @throws PagePinnedException If the page is pinned
 	 */
   void disposePage(File* file, const PageId PageNo);
 
@@ -284,6 +749,22 @@ class BufMgr
   }
 
 	/**
+	 * Record every readPage(), allocPage(), unPinPage() and disposePage() from now on in
+	 * a binary access trace, which the bufsim tool replays against other replacement
+	 * policies and pool sizes. Calls through PageHandle are recorded as the calls they
+	 * stand for. A trace already being recorded is finished first.
+	 *
+	 * @param path   	Name of the trace file, replaced if it exists
+	 * @throws FileIOException If the trace file cannot be created
+	 */
+  void startTrace(const std::string& path);
+
+	/**
+	 * Finish the access trace being recorded, if any. Called by the destructor.
+	 */
+  void stopTrace();
+
+	/**
    * Clear buffer pool usage statistics
 	 */
   void clearBufStats() 
@@ -0,0 +1,394 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * bufsim replays a buffer manager access trace (see BufMgr::startTrace()) against
+ * several replacement policies and pool sizes and prints the hit ratio of readPage()
+ * for each. Pages are never pinned in the simulation, and allocPage() loads its page
+ * without counting as a read, as in BufMgr. disposePage() drops the page.
+ *
+ * Usage: bufsim <trace> [frames ...]
+ * Without a list of pool sizes, powers of two up to the number of distinct pages are
+ * simulated.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include "bufTrace.h"
+#include "exceptions/file_io_exception.h"
+
+using namespace badgerdb;
+
+/**
+ * A page of the trace: file id in the upper half, page number in the lower
+ */
+typedef std::uint64_t PageKey;
+
+/**
+ * Page accesses of the trace, in order
+ */
+struct Event {
+	TraceOp op;
+	PageKey key;
+};
+
+/**
+* @brief Replacement policy simulated over a pool of a fixed number of frames
+*/
+class SimPolicy
+{
+ public:
+	virtual ~SimPolicy() {}
+
+	/**
+   * Name printed in the column header
+	 */
+	virtual const char* name() const = 0;
+
+	/**
+   * Event i references key: returns true on a hit, otherwise loads key, evicting a page
+	 * if the pool is full
+	 */
+	virtual bool access(const std::size_t i, const PageKey key) = 0;
+
+	/**
+   * key has been disposed of; drop it if it is resident
+	 */
+	virtual void remove(const PageKey key) = 0;
+};
+
+/**
+* @brief Clock with one reference bit per frame, as BufMgr runs it
+*/
+class SimClock : public SimPolicy
+{
+ private:
+	std::vector<PageKey> frames;
+	std::vector<bool> refbit;
+	std::vector<bool> valid;
+	std::map<PageKey, std::size_t> resident;
+	std::size_t hand;
+
+ public:
+	SimClock(const std::size_t numFrames)
+		: frames(numFrames), refbit(numFrames, false), valid(numFrames, false), hand(numFrames - 1) {}
+
+	const char* name() const { return "CLOCK"; }
+
+	bool access(const std::size_t i, const PageKey key)
+	{
+		std::map<PageKey, std::size_t>::iterator it = resident.find(key);
+		if (it != resident.end())
+		{
+			refbit[it->second] = true;
+			return true;
+		}
+		// stop at the first invalid frame or the first one with its bit clear
+		for (;;)
+		{
+			hand = (hand + 1) % frames.size();
+			if (!valid[hand] || !refbit[hand])
+				break;
+			refbit[hand] = false;
+		}
+		if (valid[hand])
+			resident.erase(frames[hand]);
+		frames[hand] = key;
+		valid[hand] = true;
+		refbit[hand] = true;
+		resident[key] = hand;
+		return false;
+	}
+
+	void remove(const PageKey key)
+	{
+		std::map<PageKey, std::size_t>::iterator it = resident.find(key);
+		if (it == resident.end())
+			return;
+		valid[it->second] = false;
+		refbit[it->second] = false;
+		resident.erase(it);
+	}
+};
+
+/**
+* @brief Least recently used
+*/
+class SimLru : public SimPolicy
+{
+ private:
+	std::size_t numFrames;
+	std::list<PageKey> order;
+	std::map<PageKey, std::list<PageKey>::iterator> resident;
+
+ public:
+	SimLru(const std::size_t frames) : numFrames(frames) {}
+
+	const char* name() const { return "LRU"; }
+
+	bool access(const std::size_t i, const PageKey key)
+	{
+		std::map<PageKey, std::list<PageKey>::iterator>::iterator it = resident.find(key);
+		if (it != resident.end())
+		{
+			order.splice(order.end(), order, it->second);
+			return true;
+		}
+		if (resident.size() >= numFrames)
+		{
+			resident.erase(order.front());
+			order.pop_front();
+		}
+		resident[key] = order.insert(order.end(), key);
+		return false;
+	}
+
+	void remove(const PageKey key)
+	{
+		std::map<PageKey, std::list<PageKey>::iterator>::iterator it = resident.find(key);
+		if (it == resident.end())
+			return;
+		order.erase(it->second);
+		resident.erase(it);
+	}
+};
+
+/**
+* @brief LRU-2: evicts the page whose second most recent reference is oldest, pages seen
+* once first. The last reference of evicted pages is remembered.
+*/
+class SimLruK : public SimPolicy
+{
+ private:
+	/**
+   * Second most recent and most recent reference time
+	 */
+	typedef std::pair<std::size_t, std::size_t> History;
+
+	std::size_t numFrames;
+	std::map<PageKey, History> resident;
+	std::set<std::pair<History, PageKey> > byHistory;
+	std::map<PageKey, std::size_t> retained;
+
+ public:
+	SimLruK(const std::size_t frames) : numFrames(frames) {}
+
+	const char* name() const { return "LRU-2"; }
+
+	bool access(const std::size_t i, const PageKey key)
+	{
+		// times start at 1 so that 0 means no such reference
+		const std::size_t now = i + 1;
+		std::map<PageKey, History>::iterator it = resident.find(key);
+		if (it != resident.end())
+		{
+			byHistory.erase(std::make_pair(it->second, key));
+			it->second = History(it->second.second, now);
+			byHistory.insert(std::make_pair(it->second, key));
+			return true;
+		}
+		if (resident.size() >= numFrames)
+		{
+			PageKey victim = byHistory.begin()->second;
+			retained[victim] = byHistory.begin()->first.second;
+			byHistory.erase(byHistory.begin());
+			resident.erase(victim);
+		}
+		History h(0, now);
+		std::map<PageKey, std::size_t>::iterator last = retained.find(key);
+		if (last != retained.end())
+		{
+			h.first = last->second;
+			retained.erase(last);
+		}
+		resident[key] = h;
+		byHistory.insert(std::make_pair(h, key));
+		return false;
+	}
+
+	void remove(const PageKey key)
+	{
+		std::map<PageKey, History>::iterator it = resident.find(key);
+		if (it == resident.end())
+			return;
+		byHistory.erase(std::make_pair(it->second, key));
+		resident.erase(it);
+	}
+};
+
+/**
+* @brief Belady's OPT: evicts the page referenced again furthest in the future
+*/
+class SimOpt : public SimPolicy
+{
+ private:
+	std::size_t numFrames;
+
+	/**
+   * For every event, the index of the next event referencing the same page
+	 */
+	const std::vector<std::size_t>& nextUse;
+
+	std::map<PageKey, std::size_t> resident;
+	std::set<std::pair<std::size_t, PageKey> > byNextUse;
+
+ public:
+	SimOpt(const std::size_t frames, const std::vector<std::size_t>& next)
+		: numFrames(frames), nextUse(next) {}
+
+	const char* name() const { return "OPT"; }
+
+	bool access(const std::size_t i, const PageKey key)
+	{
+		std::map<PageKey, std::size_t>::iterator it = resident.find(key);
+		bool hit = it != resident.end();
+		if (hit)
+		{
+			byNextUse.erase(std::make_pair(it->second, key));
+		}
+		else if (resident.size() >= numFrames)
+		{
+			std::set<std::pair<std::size_t, PageKey> >::iterator victim = --byNextUse.end();
+			resident.erase(victim->second);
+			byNextUse.erase(victim);
+		}
+		resident[key] = nextUse[i];
+		byNextUse.insert(std::make_pair(nextUse[i], key));
+		return hit;
+	}
+
+	void remove(const PageKey key)
+	{
+		std::map<PageKey, std::size_t>::iterator it = resident.find(key);
+		if (it == resident.end())
+			return;
+		byNextUse.erase(std::make_pair(it->second, key));
+		resident.erase(it);
+	}
+};
+
+/**
+ * Replay events against policy and return the hit ratio of the reads
+ */
+double replay(const std::vector<Event>& events, SimPolicy& policy)
+{
+	std::size_t reads = 0, hits = 0;
+	for (std::size_t i = 0; i < events.size(); i++)
+	{
+		if (events[i].op == TRACE_DISPOSE)
+		{
+			policy.remove(events[i].key);
+			continue;
+		}
+		bool hit = policy.access(i, events[i].key);
+		if (events[i].op == TRACE_READ)
+		{
+			reads++;
+			if (hit)
+				hits++;
+		}
+	}
+	return reads == 0 ? 0.0 : (double) hits / reads;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: bufsim <trace> [frames ...]\n";
+		return 1;
+	}
+
+	std::vector<Event> events;
+	std::size_t numReads = 0, numAllocs = 0, numFiles = 0;
+	try
+	{
+		BufTraceReader reader(argv[1]);
+		TraceRecord rec;
+		while (reader.next(rec))
+		{
+			if (rec.op == TRACE_UNPIN)
+				continue;
+			Event e = {(TraceOp) rec.op, ((PageKey) rec.fileId << 32) | rec.pageNo};
+			events.push_back(e);
+			if (rec.op == TRACE_READ)
+				numReads++;
+			else if (rec.op == TRACE_ALLOC)
+				numAllocs++;
+		}
+		numFiles = reader.numFiles();
+	}
+	catch (FileIOException e)
+	{
+		std::cout << "Cannot read trace " << argv[1] << ": " << e.message() << "\n";
+		return 1;
+	}
+
+	// next reference of every event's page, for OPT; disposals don't count
+	const std::size_t NEVER = (std::size_t) -1;
+	std::vector<std::size_t> nextUse(events.size(), NEVER);
+	std::map<PageKey, std::size_t> seen;
+	for (std::size_t i = events.size(); i > 0; i--)
+	{
+		if (events[i - 1].op == TRACE_DISPOSE)
+			continue;
+		std::map<PageKey, std::size_t>::iterator it = seen.find(events[i - 1].key);
+		if (it != seen.end())
+		{
+			nextUse[i - 1] = it->second;
+			it->second = i - 1;
+		}
+		else
+		{
+			seen[events[i - 1].key] = i - 1;
+		}
+	}
+	const std::size_t distinct = seen.size();
+
+	std::vector<std::size_t> sizes;
+	for (int a = 2; a < argc; a++)
+		if (atoi(argv[a]) > 0)
+			sizes.push_back(atoi(argv[a]));
+	if (sizes.empty())
+	{
+		for (std::size_t frames = 4; frames < distinct; frames *= 2)
+			sizes.push_back(frames);
+		sizes.push_back(distinct > 0 ? distinct : 1);
+	}
+
+	std::cout << argv[1] << ": " << numReads << " reads, " << numAllocs << " allocs, "
+		<< numFiles << " files, " << distinct << " distinct pages\n";
+	std::cout << "hit ratio of readPage()\n";
+
+	for (std::size_t s = 0; s < sizes.size(); s++)
+	{
+		SimClock clock(sizes[s]);
+		SimLru lru(sizes[s]);
+		SimLruK lruK(sizes[s]);
+		SimOpt opt(sizes[s], nextUse);
+		SimPolicy* policies[] = {&clock, &lru, &lruK, &opt};
+
+		if (s == 0)
+		{
+			std::cout << std::setw(8) << "frames";
+			for (int p = 0; p < 4; p++)
+				std::cout << std::setw(8) << policies[p]->name();
+			std::cout << "\n";
+		}
+		std::cout << std::setw(8) << sizes[s];
+		for (int p = 0; p < 4; p++)
+			std::cout << std::setw(8) << std::fixed << std::setprecision(3) << replay(events, *policies[p]);
+		std::cout << "\n";
+	}
+	return 0;
+}
@@ -7,14 +7,26 @@
 
 #include "file.h"
 
-#include <fstream>
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 #include <cstdio>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -23,8 +35,481 @@
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/**
+ * Milliseconds on the steady clock, for group commit deadlines
+ */
+static std::int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Alignment of buffers, offsets and lengths of direct transfers, enough for
+ * the logical block size of any device we run on
+ */
+static const std::size_t DIRECT_IO_ALIGNMENT = 4096;
+
+/**
+ * First word of the map of used pages stored behind the last page of a file
+ */
+static const std::uint32_t PAGE_MAP_MAGIC = 0x50474d50;
+
+/**
+ * Stored in front of the map of used pages
+ */
+struct PageMapHeader {
+  std::uint32_t magic;
+
+  /**
+   * Number of 64 bit words of the map that follow
+   */
+  std::uint32_t num_words;
+
+  /**
+   * Header of the file when the map was written; a map stored with any other
+   * header is out of date
+   */
+  FileHeader header;
+
+  /**
+   * FNV-1a hash of the header and the map words
+   */
+  std::uint64_t checksum;
+};
+
+/**
+ * Number of map words needed for num_pages pages
+ */
+static std::size_t mapWords(const PageId num_pages) {
+  return (num_pages + 63) / 64;
+}
+
+/**
+ * Checksum of a stored map, over the file header and the first num_words words
+ */
+static std::uint64_t mapChecksum(const FileHeader& header,
+                                 const std::vector<std::uint64_t>& words,
+                                 const std::size_t num_words) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&header);
+  for (std::size_t i = 0; i < sizeof(FileHeader); ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  bytes = reinterpret_cast<const unsigned char*>(num_words > 0 ? &words[0] : NULL);
+  for (std::size_t i = 0; i < num_words * sizeof(std::uint64_t); ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+PageId PageMap::next(const PageId page_number) const {
+  const PageId from = page_number + 1;
+  std::size_t w = from / 64;
+  if (w >= words_.size()) {
+    return Page::INVALID_NUMBER;
+  }
+  std::uint64_t bits = words_[w] & (~(std::uint64_t) 0 << (from % 64));
+  while (bits == 0) {
+    if (++w == words_.size()) {
+      return Page::INVALID_NUMBER;
+    }
+    bits = words_[w];
+  }
+  return (PageId) (w * 64 + __builtin_ctzll(bits));
+}
+
+PageId PageMap::previous(const PageId page_number) const {
+  if (page_number == 0 || words_.empty()) {
+    return Page::INVALID_NUMBER;
+  }
+  // page 0 is never set, so running out of bits means there is none
+  const PageId last = std::min(page_number, size()) - 1;
+  std::size_t w = last / 64;
+  std::uint64_t bits = words_[w] & (~(std::uint64_t) 0 >> (63 - last % 64));
+  while (bits == 0) {
+    if (w == 0) {
+      return Page::INVALID_NUMBER;
+    }
+    bits = words_[--w];
+  }
+  return (PageId) (w * 64 + 63 - __builtin_clzll(bits));
+}
+
+PageId PageMap::count() const {
+  PageId num_used = 0;
+  for (std::size_t w = 0; w < words_.size(); ++w) {
+    num_used += (PageId) __builtin_popcountll(words_[w]);
+  }
+  return num_used;
+}
+
+PageId PageMap::nextFree(const PageId page_number, const PageId limit) const {
+  PageId from = page_number + 1;
+  while (from < limit) {
+    const std::size_t w = from / 64;
+    if (w >= words_.size()) {
+      // past the map, nothing is used
+      return from;
+    }
+    const std::uint64_t free_bits = ~words_[w] & (~(std::uint64_t) 0 << (from % 64));
+    if (free_bits != 0) {
+      const PageId free_page = (PageId) (w * 64 + __builtin_ctzll(free_bits));
+      return free_page < limit ? free_page : Page::INVALID_NUMBER;
+    }
+    from = (PageId) ((w + 1) * 64);
+  }
+  return Page::INVALID_NUMBER;
+}
+
+/**
+ * Memory aligned for direct transfers, freed when it goes out of scope
+ */
+class AlignedBuffer {
+ public:
+  explicit AlignedBuffer(const std::size_t len) : data_(NULL) {
+    if (posix_memalign(reinterpret_cast<void**>(&data_), DIRECT_IO_ALIGNMENT, len) != 0) {
+      throw std::bad_alloc();
+    }
+  }
+  ~AlignedBuffer() { free(data_); }
+  char* get() const { return data_; }
+
+ private:
+  AlignedBuffer(const AlignedBuffer&);
+  AlignedBuffer& operator=(const AlignedBuffer&);
+
+  char* data_;
+};
+
+FileHandle::FileHandle(const std::string& name, const bool create_new)
+    : name_(name), direct_fd_(-1), mode_(SYNC_ON_FLUSH), group_ms_(10),
+      group_pages_(64), written_(0), synced_(0), last_sync_ms_(nowMs()),
+      reserved_to_(0) {
+  int flags = O_RDWR;
+  if (create_new) {
+    flags |= O_CREAT | O_TRUNC;
+  }
+  fd_ = ::open(name.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    throw FileIOException(name_, errno);
+  }
+}
+
+FileHandle::~FileHandle() {
+  if (direct_fd_ >= 0) {
+    ::close(direct_fd_);
+  }
+  ::close(fd_);
+}
+
+bool FileHandle::setDirectIO(const bool on) {
+  if (!on) {
+    if (direct_fd_ >= 0) {
+      ::close(direct_fd_);
+      direct_fd_ = -1;
+    }
+    return false;
+  }
+  if (direct_fd_ >= 0) {
+    return true;
+  }
+#ifdef O_DIRECT
+  const int fd = ::open(name_.c_str(), O_RDWR | O_DIRECT);
+  if (fd < 0) {
+    // the filesystem does not do direct I/O, stay buffered
+    return false;
+  }
+  // some filesystems take the flag and then fail every transfer
+  AlignedBuffer probe(DIRECT_IO_ALIGNMENT);
+  ssize_t n;
+  do {
+    n = ::pread(fd, probe.get(), DIRECT_IO_ALIGNMENT, 0);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    ::close(fd);
+    return false;
+  }
+  direct_fd_ = fd;
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::size_t FileHandle::read(void* buf, const std::size_t len,
+                             const off_t offset) const {
+  struct iovec iov = {buf, len};
+  return transfer(&iov, 1, offset, false /* writing */);
+}
+
+void FileHandle::write(const void* buf, const std::size_t len,
+                       const off_t offset) const {
+  struct iovec iov = {const_cast<void*>(buf), len};
+  transfer(&iov, 1, offset, true /* writing */);
+  wrote();
+}
+
+std::size_t FileHandle::readv(const struct iovec* iov, const int iovcnt,
+                              const off_t offset) const {
+  return transfer(iov, iovcnt, offset, false /* writing */);
+}
+
+void FileHandle::writev(const struct iovec* iov, const int iovcnt,
+                        const off_t offset) const {
+  transfer(iov, iovcnt, offset, true /* writing */);
+  wrote();
+}
+
+bool FileHandle::reserve(const off_t offset, const off_t len) const {
+#ifdef FALLOC_FL_KEEP_SIZE
+  int rc;
+  do {
+    rc = ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, offset, len);
+  } while (rc != 0 && errno == EINTR);
+  if (rc != 0) {
+    return false;
+  }
+  off_t to = reserved_to_;
+  while (offset + len > to && !reserved_to_.compare_exchange_weak(to, offset + len)) {
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void FileHandle::setDurability(const DurabilityMode mode,
+                               const std::uint32_t group_ms,
+                               const std::uint32_t group_pages) {
+  // whatever the old mode left unsynced is covered by the new one's next sync
+  mode_ = mode;
+  group_ms_ = group_ms;
+  group_pages_ = group_pages;
+}
+
+void FileHandle::sync() const {
+  const std::uint64_t target = written_;
+  if (synced_ >= target) {
+    return;
+  }
+  // Another thread's fdatasync() may be running already without covering our
+  // writes; wait for it, then sync unless a later one has covered them.
+  std::lock_guard<std::mutex> guard(sync_latch_);
+  if (synced_ >= target) {
+    return;
+  }
+  const std::uint64_t covered = written_;
+  if (::fdatasync(fd_) != 0) {
+    throw FileIOException(name_, errno);
+  }
+  synced_ = covered;
+  last_sync_ms_ = nowMs();
+}
+
+void FileHandle::wrote() const {
+  ++written_;
+  switch (mode_) {
+    case SYNC_EACH_WRITE:
+      sync();
+      break;
+    case GROUP_COMMIT:
+      if (written_ - synced_ >= group_pages_ || nowMs() - last_sync_ms_ >= group_ms_) {
+        sync();
+      }
+      break;
+    case SYNC_ON_FLUSH:
+      break;
+  }
+}
+
+std::size_t FileHandle::transfer(const struct iovec* iov, const int iovcnt,
+                                 off_t offset, const bool writing) const {
+  if (direct_fd_ >= 0) {
+    return transferDirect(iov, iovcnt, offset, writing);
+  }
+  return transferVectors(fd_, iov, iovcnt, offset, writing);
+}
+
+std::size_t FileHandle::transferVectors(const int fd, const struct iovec* iov,
+                                        const int iovcnt, off_t offset,
+                                        const bool writing) const {
+  // work on a copy so partial transfers can advance through the buffers
+  std::vector<struct iovec> rest(iov, iov + iovcnt);
+  std::size_t done = 0;
+  std::size_t next = 0;
+  while (next < rest.size()) {
+    const int count = (int) std::min<std::size_t>(rest.size() - next, IOV_MAX);
+    ssize_t n;
+    if (count == 1) {
+      n = writing ? ::pwrite(fd, rest[next].iov_base, rest[next].iov_len, offset)
+                  : ::pread(fd, rest[next].iov_base, rest[next].iov_len, offset);
+    } else {
+      n = writing ? ::pwritev(fd, &rest[next], count, offset)
+                  : ::preadv(fd, &rest[next], count, offset);
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(name_, errno);
+    }
+    if (n == 0) {
+      if (writing) {
+        throw FileIOException(name_, EIO);
+      }
+      break;  // end of file
+    }
+    done += n;
+    offset += n;
+    // skip the buffers completed by this call, trim the one it stopped in
+    std::size_t left = n;
+    while (next < rest.size() && left >= rest[next].iov_len) {
+      left -= rest[next].iov_len;
+      ++next;
+    }
+    if (left > 0) {
+      rest[next].iov_base = static_cast<char*>(rest[next].iov_base) + left;
+      rest[next].iov_len -= left;
+    }
+    // a short direct read ends at the end of the file; the rest is not aligned
+    if (!writing && fd == direct_fd_ && (n % DIRECT_IO_ALIGNMENT) != 0) {
+      break;
+    }
+  }
+  return done;
+}
+
+std::size_t FileHandle::transferDirect(const struct iovec* iov, const int iovcnt,
+                                       const off_t offset, const bool writing) const {
+  std::size_t len = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    len += iov[i].iov_len;
+  }
+  if (len == 0) {
+    return 0;
+  }
+  // buffers that follow each other in memory, like the header and data of a
+  // page, go to the kernel as one
+  std::vector<struct iovec> blocks;
+  blocks.reserve(iovcnt);
+  for (int i = 0; i < iovcnt; ++i) {
+    if (!blocks.empty() && static_cast<char*>(blocks.back().iov_base) +
+        blocks.back().iov_len == iov[i].iov_base) {
+      blocks.back().iov_len += iov[i].iov_len;
+    } else {
+      blocks.push_back(iov[i]);
+    }
+  }
+  bool aligned = (offset % DIRECT_IO_ALIGNMENT) == 0;
+  for (std::size_t i = 0; aligned && i < blocks.size(); ++i) {
+    aligned = (reinterpret_cast<std::uintptr_t>(blocks[i].iov_base) % DIRECT_IO_ALIGNMENT) == 0 &&
+        (blocks[i].iov_len % DIRECT_IO_ALIGNMENT) == 0;
+  }
+  if (aligned) {
+    // whole blocks in aligned memory, as pool frames are: straight to disk
+    return transferVectors(direct_fd_, &blocks[0], (int) blocks.size(), offset, writing);
+  }
+  // the whole blocks covering [offset, offset + len)
+  const off_t start = offset / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+  const off_t end = (offset + (off_t) len + DIRECT_IO_ALIGNMENT - 1) /
+      DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+  const std::size_t span = end - start;
+  const std::size_t head = offset - start;
+  AlignedBuffer bounce(span);
+
+  if (!writing) {
+    const std::size_t got = transferBlocks(bounce.get(), span, start, false);
+    const std::size_t avail = got > head ? std::min(len, got - head) : 0;
+    std::size_t copied = 0;
+    for (int i = 0; i < iovcnt && copied < avail; ++i) {
+      const std::size_t n = std::min(iov[i].iov_len, avail - copied);
+      memcpy(iov[i].iov_base, bounce.get() + head + copied, n);
+      copied += n;
+    }
+    return avail;
+  }
+
+  std::size_t copied = 0;
+  if (head == 0 && offset + (off_t) len == end) {
+    // whole blocks, as pages are: nothing around them to keep, nothing to trim
+    for (int i = 0; i < iovcnt; ++i) {
+      memcpy(bounce.get() + copied, iov[i].iov_base, iov[i].iov_len);
+      copied += iov[i].iov_len;
+    }
+    transferBlocks(bounce.get(), span, start, true);
+    return len;
+  }
+
+  std::lock_guard<std::mutex> guard(direct_latch_);
+  struct stat st;
+  if (::fstat(direct_fd_, &st) != 0) {
+    throw FileIOException(name_, errno);
+  }
+  // blocks the range only partly covers keep the bytes around it; past the
+  // end of the file they are zero
+  memset(bounce.get(), 0, span);
+  if (head != 0) {
+    transferBlocks(bounce.get(), DIRECT_IO_ALIGNMENT, start, false);
+  }
+  if (offset + (off_t) len != end && (head == 0 || span > DIRECT_IO_ALIGNMENT)) {
+    transferBlocks(bounce.get() + span - DIRECT_IO_ALIGNMENT, DIRECT_IO_ALIGNMENT,
+                   end - DIRECT_IO_ALIGNMENT, false);
+  }
+  for (int i = 0; i < iovcnt; ++i) {
+    memcpy(bounce.get() + head + copied, iov[i].iov_base, iov[i].iov_len);
+    copied += iov[i].iov_len;
+  }
+  transferBlocks(bounce.get(), span, start, true);
+  // writing whole blocks may have moved the end of the file past the data
+  const off_t size = std::max<off_t>(st.st_size, offset + (off_t) len);
+  if (end > size) {
+    if (::ftruncate(direct_fd_, size) != 0) {
+      throw FileIOException(name_, errno);
+    }
+    // the trim also released the space reserved behind the data
+    if (reserved_to_ > size) {
+      reserve(size, reserved_to_ - size);
+    }
+  }
+  return len;
+}
+
+std::size_t FileHandle::transferBlocks(void* buf, const std::size_t len,
+                                       off_t offset, const bool writing) const {
+  std::size_t done = 0;
+  while (done < len) {
+    char* at = static_cast<char*>(buf) + done;
+    const ssize_t n = writing ? ::pwrite(direct_fd_, at, len - done, offset)
+                              : ::pread(direct_fd_, at, len - done, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(name_, errno);
+    }
+    if (n == 0) {
+      if (writing) {
+        throw FileIOException(name_, EIO);
+      }
+      break;  // end of file
+    }
+    done += n;
+    offset += n;
+    // a short direct read ends at the end of the file; the rest is not aligned
+    if (!writing && (n % DIRECT_IO_ALIGNMENT) != 0) {
+      break;
+    }
+  }
+  return done;
+}
+
+File::HandleMap File::open_handles_;
 File::CountMap File::open_counts_;
+std::mutex File::open_latch_;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -40,24 +525,26 @@ bool File::isOpen(const std::string& filename) {
   if (!exists(filename)) {
     return false;
   }
+  std::lock_guard<std::mutex> guard(open_latch_);
   return open_counts_.find(filename) != open_counts_.end();
 }
 
 bool File::exists(const std::string& filename) {
-	std::fstream file(filename);
-	if(file)
-	{
-		file.close();
-		return true;
-	}
-
-	return false;
+  return ::access(filename.c_str(), R_OK | W_OK) == 0;
 }
 
 File::~File() {
   close();
 }
 
+void File::sync() const {
+  {
+    std::lock_guard<std::mutex> guard(handle_->metaLatch());
+    flushMeta();
+  }
+  handle_->sync();
+}
+
 
 PageId File::getFirstPageNo() {
   const FileHeader& header = readHeader();
@@ -76,56 +563,116 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
 }
 
 void File::openIfNeeded(const bool create_new) {
+  std::lock_guard<std::mutex> guard(open_latch_);
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    handle_ = open_handles_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
       if (already_exists) {
         throw FileExistsException(filename_);
       }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    handle_.reset(new FileHandle(filename_, create_new));
+    if (!create_new) {
+      // cached for as long as the file is open; new files get theirs below
+      handle_->read(&handle_->meta().header, sizeof(FileHeader), 0 /* offset */);
+    }
+    open_handles_[filename_] = handle_;
     open_counts_[filename_] = 1;
   }
 }
 
 void File::close() {
+  std::lock_guard<std::mutex> guard(open_latch_);
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
-  stream_.reset();
+  if (open_counts_[filename_] == 0 && handle_) {
+    // last one out writes back what was only cached
+    std::lock_guard<std::mutex> guard(handle_->metaLatch());
+    try {
+      flushMeta();
+    } catch (FileIOException e) {
+      // nothing to report it to; call sync() first to see errors
+    }
+  }
+  handle_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    open_handles_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  return handle_->meta().header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  handle_->meta().header = header;
+  headerChanged();
+}
+
+void File::headerChanged() const {
+  FileMeta& meta = handle_->meta();
+  // the stored map carries a copy of the header, so it is out of date too
+  meta.header_dirty = true;
+  meta.map_dirty = true;
+  if (handle_->durability() == SYNC_EACH_WRITE) {
+    handle_->write(&meta.header, sizeof(FileHeader), 0 /* offset */);
+    meta.header_dirty = false;
+  }
+}
+
+void File::reserveExtents(const PageId first, const PageId count) const {
+  FileMeta& meta = handle_->meta();
+  const PageId end = first + count;
+  if (!meta.can_reserve || end <= meta.reserved_pages) {
+    return;
+  }
+  const PageId from = std::max(first, meta.reserved_pages);
+  const PageId to = from + (end - from + EXTENT_PAGES - 1) / EXTENT_PAGES * EXTENT_PAGES;
+  if (handle_->reserve(pagePosition(from), (off_t) (to - from) * Page::SIZE)) {
+    meta.reserved_pages = to;
+  } else {
+    // pages are still written where they belong, only not reserved up front
+    meta.can_reserve = false;
+  }
+}
+
+void File::flushMeta() const {
+  FileMeta& meta = handle_->meta();
+  if (meta.has_map && meta.map_dirty) {
+    // behind the last page, padded to whole pages
+    const std::size_t num_words = mapWords(meta.header.num_pages);
+    meta.used_pages.resize(meta.header.num_pages);
+    const PageMapHeader stored = {PAGE_MAP_MAGIC, (std::uint32_t) num_words, meta.header,
+                                  mapChecksum(meta.header, meta.used_pages.words(), num_words)};
+    const std::size_t len = sizeof(PageMapHeader) + num_words * sizeof(std::uint64_t);
+    std::vector<char> buf((len + Page::SIZE - 1) / Page::SIZE * Page::SIZE, 0);
+    memcpy(&buf[0], &stored, sizeof(PageMapHeader));
+    if (num_words > 0) {
+      memcpy(&buf[sizeof(PageMapHeader)], &meta.used_pages.words()[0],
+             num_words * sizeof(std::uint64_t));
+    }
+    handle_->write(&buf[0], buf.size(), pagePosition(meta.header.num_pages));
+    meta.map_dirty = false;
+  }
+  if (meta.header_dirty) {
+    handle_->write(&meta.header, sizeof(FileHeader), 0 /* offset */);
+    meta.header_dirty = false;
+  }
 }
 
 
@@ -143,6 +690,7 @@ PageFile PageFile::open(const std::string& filename) {
 PageFile::PageFile(const std::string& name, const bool create_new)
 : File(name, create_new)
 {
+  loadMap();
 }
 
 PageFile::~PageFile() {
@@ -151,6 +699,7 @@ PageFile::~PageFile() {
 PageFile::PageFile(const PageFile& other)
 : File(other.filename_, false /* create_new */)
 {
+  loadMap();
 }
 
 PageFile& PageFile::operator=(const PageFile& rhs) {
@@ -159,82 +708,245 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
+  loadMap();
   return *this;
 }
 
-Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
-  Page new_page;
-  Page existing_page;
-  if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
-    --header.num_free_pages;
-
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
+void PageFile::loadMap() {
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  FileMeta& meta = handle_->meta();
+  if (meta.has_map) {
+    return;
+  }
+  const FileHeader& header = meta.header;
+  std::vector<std::uint64_t>& words = meta.used_pages.words();
+  meta.used_pages.resize(header.num_pages);
+  meta.has_map = true;
+
+  const std::size_t num_words = mapWords(header.num_pages);
+  const off_t position = pagePosition(header.num_pages);
+  PageMapHeader stored;
+  if (handle_->read(&stored, sizeof(PageMapHeader), position) == sizeof(PageMapHeader) &&
+      stored.magic == PAGE_MAP_MAGIC && stored.num_words == num_words &&
+      stored.header == header) {
+    const std::size_t len = num_words * sizeof(std::uint64_t);
+    if ((len == 0 || handle_->read(&words[0], len, position + sizeof(PageMapHeader)) == len) &&
+        stored.checksum == mapChecksum(header, words, num_words)) {
+      // Growing the file overwrites the stored map, but free pages taken into
+      // use after it was written are only found in their page headers.
+      bool current = true;
+      for (PageId free_page = meta.used_pages.nextFree(Page::INVALID_NUMBER, header.num_pages);
+           current && free_page != Page::INVALID_NUMBER;
+           free_page = meta.used_pages.nextFree(free_page, header.num_pages)) {
+        current = readPageHeader(free_page).current_page_number == Page::INVALID_NUMBER;
       }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
+      if (current) {
+        meta.map_dirty = false;
+        checkHeader();
+        return;
       }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
     }
-
-    assert((header.num_free_pages == 0) ==
-           (header.first_free_page == Page::INVALID_NUMBER));
   }
-	else
-	{
-    new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
+
+  // Missing or out of date: read the page headers, a run of pages at a time,
+  // dropping the page data into a scratch page.
+  std::fill(words.begin(), words.end(), 0);
+  std::vector<PageId> next_page_numbers(header.num_pages, (PageId) Page::INVALID_NUMBER);
+  const std::uint32_t run = 64;
+  std::vector<PageHeader> headers(run);
+  std::vector<struct iovec> iov(2 * run);
+  Page scratch;
+  for (PageId first = 1; first < header.num_pages; first += run) {
+    const std::uint32_t count = std::min<PageId>(run, header.num_pages - first);
+    for (std::uint32_t i = 0; i < count; ++i) {
+      iov[2 * i].iov_base = &headers[i];
+      iov[2 * i].iov_len = sizeof(PageHeader);
+      iov[2 * i + 1].iov_base = &scratch.data_[0];
+      iov[2 * i + 1].iov_len = Page::DATA_SIZE;
+    }
+    const std::size_t got = handle_->readv(&iov[0], (int) (2 * count), pagePosition(first));
+    for (std::uint32_t i = 0; i < count && (i + 1) * Page::SIZE <= got; ++i) {
+      if (headers[i].current_page_number != Page::INVALID_NUMBER) {
+        meta.used_pages.set(first + i);
+        next_page_numbers[first + i] = headers[i].next_page_number;
       }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
     }
+  }
+
+  // Pages allocated past the end of the file as the header last saw it are
+  // dropped, and may still be linked from the page before them; make the list
+  // on disk agree with the map again.
+  for (PageId page_number = meta.used_pages.next(Page::INVALID_NUMBER);
+       page_number != Page::INVALID_NUMBER;) {
+    const PageId next_page_number = meta.used_pages.next(page_number);
+    if (next_page_numbers[page_number] != next_page_number) {
+      writeNextPageNumber(page_number, next_page_number);
+    }
+    page_number = next_page_number;
+  }
+  meta.map_dirty = true;
+  checkHeader();
+}
+
+void PageFile::checkHeader() {
+  FileMeta& meta = handle_->meta();
+  FileHeader& header = meta.header;
+  // After a crash the header on disk may predate the last allocations and
+  // deletions, and files written before free pages were found through the map
+  // chained them, last freed first.
+  const PageId first_used_page = meta.used_pages.next(Page::INVALID_NUMBER);
+  const PageId first_free_page =
+      meta.used_pages.nextFree(Page::INVALID_NUMBER, header.num_pages);
+  const PageId num_used_pages = meta.used_pages.count();
+  const PageId num_free_pages =
+      header.num_pages > 1 ? header.num_pages - 1 - num_used_pages : 0;
+  if (header.first_used_page != first_used_page ||
+      header.first_free_page != first_free_page ||
+      header.num_free_pages != num_free_pages) {
+    header.first_used_page = first_used_page;
+    header.first_free_page = first_free_page;
+    header.num_free_pages = num_free_pages;
+    headerChanged();
+  }
+}
+
+PageId PageFile::nextUsedPage(const PageId page_number) const {
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  return handle_->meta().used_pages.next(page_number);
+}
+
+PageId PageFile::previousUsedPage(const PageId page_number) const {
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  return handle_->meta().used_pages.previous(page_number);
+}
+
+Page PageFile::allocatePage(PageId &new_page_number) {
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  FileMeta& meta = handle_->meta();
+  const FileHeader& header = meta.header;
+  new_page_number = Page::INVALID_NUMBER;
+  if (header.num_free_pages > 0) {
+    // Next fit: go on after the page allocated last, then from the start.
+    new_page_number = meta.used_pages.nextFree(meta.alloc_cursor, header.num_pages);
+    if (new_page_number == Page::INVALID_NUMBER) {
+      new_page_number = header.first_free_page;
+    }
+  }
+  if (new_page_number == Page::INVALID_NUMBER) {
+    new_page_number = header.num_pages;
+  }
+  return usePage(new_page_number);
+}
+
+Page PageFile::allocatePage(PageId &new_page_number, const PageId near) {
+  {
+    std::lock_guard<std::mutex> guard(handle_->metaLatch());
+    FileMeta& meta = handle_->meta();
+    const FileHeader& header = meta.header;
+    const PageId limit = near + EXTENT_PAGES + 1;
+    new_page_number = meta.used_pages.nextFree(near, std::min(limit, header.num_pages));
+    if (new_page_number == Page::INVALID_NUMBER && header.num_pages < limit) {
+      new_page_number = header.num_pages;
+    }
+    if (new_page_number != Page::INVALID_NUMBER) {
+      return usePage(new_page_number);
+    }
+  }
+  return allocatePage(new_page_number);
+}
+
+Page PageFile::usePage(const PageId new_page_number) {
+  FileMeta& meta = handle_->meta();
+  FileHeader& header = meta.header;
+  if (new_page_number == header.num_pages) {
+    reserveExtents(new_page_number, 1);
     ++header.num_pages;
+    meta.used_pages.resize(header.num_pages);
+  } else {
+    --header.num_free_pages;
+    if (new_page_number == header.first_free_page) {
+      header.first_free_page = meta.used_pages.nextFree(new_page_number, header.num_pages);
+    }
+
+    assert((header.num_free_pages == 0) ==
+           (header.first_free_page == Page::INVALID_NUMBER));
   }
+  meta.alloc_cursor = new_page_number;
+  Page new_page;
+  new_page.set_page_number(new_page_number);
+
+  // The used list is kept in page order, so the map of used pages tells which
+  // pages the new one goes between without walking the list.
+  const PageId previous_page_number = meta.used_pages.previous(new_page_number);
+  new_page.set_next_page_number(meta.used_pages.next(new_page_number));
+  meta.used_pages.set(new_page_number);
+
   writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+  if (previous_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = new_page_number;
+  } else {
+    writeNextPageNumber(previous_page_number, new_page_number);
   }
-  writeHeader(header);
+  headerChanged();
 
   return new_page;
 }
 
+std::vector<PageId> PageFile::defragment(const std::string& filename) {
+  if (isOpen(filename)) {
+    throw FileOpenException(filename);
+  }
+  const std::string temp_name = filename + ".defrag";
+  std::vector<PageId> new_numbers;
+  {
+    PageFile source = PageFile::open(filename);
+    // left over from an interrupted run
+    std::remove(temp_name.c_str());
+    PageFile target = PageFile::create(temp_name);
+
+    const FileHeader header = source.readHeader();
+    new_numbers.assign(header.num_pages, (PageId) Page::INVALID_NUMBER);
+    {
+      std::lock_guard<std::mutex> guard(target.handle_->metaLatch());
+      target.reserveExtents(1, header.num_pages - 1 - header.num_free_pages);
+    }
+
+    // copy the used pages in list order, renumbered, a run at a time
+    std::vector<Page> run;
+    run.reserve(EXTENT_PAGES);
+    PageId next_number = 1;
+    for (FileIterator iter = source.begin(); iter != source.end(); ++iter) {
+      new_numbers[iter.page_number()] = next_number;
+      run.push_back(*iter);
+      run.back().set_page_number(next_number);
+      run.back().set_next_page_number(next_number + 1);
+      ++next_number;
+      if (run.size() == EXTENT_PAGES) {
+        target.writeNewPages(next_number - EXTENT_PAGES, EXTENT_PAGES, &run[0]);
+        run.clear();
+      }
+    }
+    if (!run.empty()) {
+      run.back().set_next_page_number(Page::INVALID_NUMBER);
+      target.writeNewPages(next_number - (PageId) run.size(), (std::uint32_t) run.size(), &run[0]);
+    } else if (next_number > 1) {
+      target.writeNextPageNumber(next_number - 1, Page::INVALID_NUMBER);
+    }
+
+    FileHeader target_header = {next_number /* num_pages */, 1 /* first_used_page */,
+                                0 /* num_free_pages */, Page::INVALID_NUMBER /* first_free_page */};
+    if (next_number == 1) {
+      target_header.first_used_page = Page::INVALID_NUMBER;
+    }
+    target.writeHeader(target_header);
+    target.sync();
+  }
+  if (std::rename(temp_name.c_str(), filename.c_str()) != 0) {
+    throw FileIOException(filename, errno);
+  }
+  return new_numbers;
+}
+
 Page PageFile::readPage(const PageId page_number) const {
   FileHeader header = readHeader();
 
@@ -247,9 +959,9 @@ Page PageFile::readPage(const PageId page_number) const {
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  struct iovec iov[2] = {{&page.header_, sizeof(PageHeader)},
+                         {&page.data_[0], Page::DATA_SIZE}};
+  handle_->readv(iov, 2, pagePosition(page_number));
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
@@ -273,35 +985,99 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 	writePage(new_page_number, header, new_page);
 }
 
-void PageFile::deletePage(const PageId page_number) {
+void PageFile::readPages(const PageId first, const std::uint32_t count, Page* pages) const {
+  std::vector<Page*> run(count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    run[i] = &pages[i];
+  }
+  readPages(first, count, &run[0]);
+}
+
+void PageFile::readPages(const PageId first, const std::uint32_t count, Page* const* pages) const {
   FileHeader header = readHeader();
+  // read whatever exists, so the pages before a missing one are always filled in
+  std::uint32_t avail = first >= header.num_pages
+      ? 0 : std::min<std::uint32_t>(count, header.num_pages - first);
+  if (avail > 0) {
+    // the pages are contiguous on disk, so a single read fills them all
+    std::vector<struct iovec> iov(2 * avail);
+    for (std::uint32_t i = 0; i < avail; ++i) {
+      iov[2 * i].iov_base = &pages[i]->header_;
+      iov[2 * i].iov_len = sizeof(PageHeader);
+      iov[2 * i + 1].iov_base = &pages[i]->data_[0];
+      iov[2 * i + 1].iov_len = Page::DATA_SIZE;
+    }
+    const std::size_t got = handle_->readv(&iov[0], (int) iov.size(), pagePosition(first));
+    avail = std::min<std::uint32_t>(avail, got / Page::SIZE);
+  }
+  for (std::uint32_t i = 0; i < avail; ++i) {
+    if (!pages[i]->isUsed()) {
+      throw InvalidPageException(first + i, filename_);
+    }
+  }
+  if (avail < count) {
+    throw InvalidPageException(first + avail, filename_);
+  }
+}
 
-  Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
-  } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
+void PageFile::writePages(const PageId first, const std::uint32_t count, const Page* pages) {
+  std::vector<const Page*> run(count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    run[i] = &pages[i];
+  }
+  writePages(first, count, &run[0]);
+}
+
+void PageFile::writePages(const PageId first, const std::uint32_t count, const Page* const* pages) {
+  // as in writePage(), keep each page's next page pointer, which the page list
+  // in memory knows without reading anything back from disk. Holding the latch
+  // keeps the pages from being deleted before they are written.
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  const FileMeta& meta = handle_->meta();
+  std::vector<PageHeader> headers(count);
+  std::vector<struct iovec> iov(2 * count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    const PageId page_number = first + i;
+    if (page_number >= meta.header.num_pages || !meta.used_pages.test(page_number)) {
+      // Page has been deleted since it was read.
+      throw InvalidPageException(page_number, filename_);
     }
+    headers[i] = pages[i]->header_;
+    headers[i].next_page_number = meta.used_pages.next(page_number);
+    iov[2 * i].iov_base = &headers[i];
+    iov[2 * i].iov_len = sizeof(PageHeader);
+    iov[2 * i + 1].iov_base = const_cast<char*>(&pages[i]->data_[0]);
+    iov[2 * i + 1].iov_len = Page::DATA_SIZE;
   }
-  // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
-  header.first_free_page = page_number;
-  ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
+  handle_->writev(&iov[0], (int) iov.size(), pagePosition(first));
+}
+
+void PageFile::deletePage(const PageId page_number) {
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  FileMeta& meta = handle_->meta();
+  FileHeader& header = meta.header;
+  if (page_number >= header.num_pages || !meta.used_pages.test(page_number)) {
+    throw InvalidPageException(page_number, filename_);
   }
-  writePage(page_number, existing_page.header_, existing_page);
-  writeHeader(header);
+
+  // Unlink the page from the used list; its neighbours come from the map.
+  const PageId previous_page_number = meta.used_pages.previous(page_number);
+  const PageId next_page_number = meta.used_pages.next(page_number);
+  if (previous_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
+  } else {
+    writeNextPageNumber(previous_page_number, next_page_number);
+  }
+  meta.used_pages.clear(page_number);
+
+  // Clear the page; the map finds it when it is needed again.
+  Page free_page;
+  if (header.first_free_page == Page::INVALID_NUMBER || page_number < header.first_free_page) {
+    header.first_free_page = page_number;
+  }
+  ++header.num_free_pages;
+  writePage(page_number, free_page.header_, free_page);
+  headerChanged();
 }
 
 FileIterator PageFile::begin() {
@@ -315,20 +1091,51 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  struct iovec iov[2] = {{const_cast<PageHeader*>(&header), sizeof(PageHeader)},
+                         {const_cast<char*>(&new_page.data_[0]), Page::DATA_SIZE}};
+  handle_->writev(iov, 2, pagePosition(page_number));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  handle_->read(&header, sizeof(PageHeader), pagePosition(page_number));
   return header;
 }
 
+void PageFile::writeNextPageNumber(const PageId page_number,
+                                   const PageId next_page_number) {
+  handle_->write(&next_page_number, sizeof(PageId),
+                 pagePosition(page_number) + offsetof(PageHeader, next_page_number));
+}
+
+void PageFile::writeNewPages(const PageId first, const std::uint32_t count, const Page* pages) {
+  std::vector<struct iovec> iov(2 * count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    iov[2 * i].iov_base = const_cast<PageHeader*>(&pages[i].header_);
+    iov[2 * i].iov_len = sizeof(PageHeader);
+    iov[2 * i + 1].iov_base = const_cast<char*>(&pages[i].data_[0]);
+    iov[2 * i + 1].iov_len = Page::DATA_SIZE;
+  }
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  reserveExtents(first, count);
+  handle_->writev(&iov[0], (int) iov.size(), pagePosition(first));
+
+  FileMeta& meta = handle_->meta();
+  FileHeader& header = meta.header;
+  meta.used_pages.resize(first + count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    if (pages[i].header_.current_page_number != Page::INVALID_NUMBER) {
+      meta.used_pages.set(first + i);
+      if (header.first_used_page == Page::INVALID_NUMBER || first + i < header.first_used_page) {
+        header.first_used_page = first + i;
+      }
+    }
+  }
+  // only the fields the new pages change, others may have moved on meanwhile
+  header.num_pages = std::max(header.num_pages, first + count);
+  headerChanged();
+}
+
 
 
 
@@ -362,7 +1169,8 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
+  std::lock_guard<std::mutex> guard(handle_->metaLatch());
+  FileHeader& header = handle_->meta().header;
 	Page new_page;
 
 	new_page_number = header.num_pages;
@@ -374,22 +1182,59 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 	++header.num_pages;
 
 	writePage(new_page_number, new_page);
-	writeHeader(header);
+	headerChanged();
 
 	return new_page;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	if (handle_->read(&page, Page::SIZE, pagePosition(page_number)) != Page::SIZE)
+	{
+		// past the end of the file
+		throw InvalidPageException(page_number, filename_);
+	}
 	return page;
 }
 
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	handle_->write(&new_page, Page::SIZE, pagePosition(new_page_number));
+}
+
+void BlobFile::readPages(const PageId first, const std::uint32_t count, Page* pages) const {
+	// pages are stored exactly as they are laid out in memory
+	if (handle_->read(pages, count * Page::SIZE, pagePosition(first)) != count * Page::SIZE)
+	{
+		throw InvalidPageException(first + count - 1, filename_);
+	}
+}
+
+void BlobFile::readPages(const PageId first, const std::uint32_t count, Page* const* pages) const {
+	std::vector<struct iovec> iov(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		iov[i].iov_base = pages[i];
+		iov[i].iov_len = Page::SIZE;
+	}
+	const std::size_t got = handle_->readv(&iov[0], (int) iov.size(), pagePosition(first)) / Page::SIZE;
+	if (got < count)
+	{
+		throw InvalidPageException(first + (PageId) got, filename_);
+	}
+}
+
+void BlobFile::writePages(const PageId first, const std::uint32_t count, const Page* pages) {
+	handle_->write(pages, count * Page::SIZE, pagePosition(first));
+}
+
+void BlobFile::writePages(const PageId first, const std::uint32_t count, const Page* const* pages) {
+	std::vector<struct iovec> iov(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		iov[i].iov_base = const_cast<Page*>(pages[i]);
+		iov[i].iov_len = Page::SIZE;
+	}
+	handle_->writev(&iov[0], (int) iov.size(), pagePosition(first));
 }
 
 //delePage should not be called for a blob_file, not supported
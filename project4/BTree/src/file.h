@@ -7,10 +7,15 @@
 
 #pragma once
 
-#include <fstream>
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <map>
+#include <vector>
 #include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #include "page.h"
 
@@ -39,6 +44,7 @@ struct FileHeader {
 
   /**
    * Page number of the first free (allocated but unused) page in the file.
+   * Free pages are not chained; the map of used pages finds the others.
    */
   PageId first_free_page;
 
@@ -56,19 +62,394 @@ struct FileHeader {
   }
 };
 
+/**
+ * @brief One bit per page of a file, set for the pages in use.
+ *
+ * Page 0 is the file header and never set.  The used page list of a PageFile
+ * is kept in page order, so the neighbours of a page in the list are the
+ * nearest set bits on either side of it.
+ */
+class PageMap {
+ public:
+  /**
+   * Grows the map to cover pages [0, num_pages); new pages are free.
+   */
+  void resize(const PageId num_pages) {
+    if (num_pages > size()) {
+      words_.resize((num_pages + 63) / 64, 0);
+    }
+  }
+
+  /**
+   * Number of pages the map covers, rounded up to whole words.
+   */
+  PageId size() const { return (PageId) (words_.size() * 64); }
+
+  /**
+   * Returns true if the given page is in use.
+   */
+  bool test(const PageId page_number) const {
+    return page_number < size() &&
+        (words_[page_number / 64] >> (page_number % 64)) & 1;
+  }
+
+  /**
+   * Marks the given page as used.  The map must cover it.
+   */
+  void set(const PageId page_number) {
+    words_[page_number / 64] |= (std::uint64_t) 1 << (page_number % 64);
+  }
+
+  /**
+   * Marks the given page as free.  The map must cover it.
+   */
+  void clear(const PageId page_number) {
+    words_[page_number / 64] &= ~((std::uint64_t) 1 << (page_number % 64));
+  }
+
+  /**
+   * Returns the first used page after the given one, or Page::INVALID_NUMBER.
+   */
+  PageId next(const PageId page_number) const;
+
+  /**
+   * Returns the last used page before the given one, or Page::INVALID_NUMBER.
+   */
+  PageId previous(const PageId page_number) const;
+
+  /**
+   * Returns the number of used pages.
+   */
+  PageId count() const;
+
+  /**
+   * Returns the first free page after the given one and before limit, or
+   * Page::INVALID_NUMBER.
+   */
+  PageId nextFree(const PageId page_number, const PageId limit) const;
+
+  /**
+   * The bits, 64 pages to a word, as they are stored on disk.
+   */
+  std::vector<std::uint64_t>& words() { return words_; }
+  const std::vector<std::uint64_t>& words() const { return words_; }
+
+ private:
+  std::vector<std::uint64_t> words_;
+};
+
+/**
+ * @brief File metadata kept in memory while a file is open.
+ *
+ * The header is only written back on File::sync() and when the file is closed
+ * (on every change in SYNC_EACH_WRITE mode).  The map of used pages of a
+ * PageFile is written behind its last page at the same time, together with a
+ * copy of the header it matches; opening a file whose map is missing, does
+ * not match or marks pages free that are in use rebuilds it from the page
+ * headers, repairs the used page list and recounts the free pages.  Pages
+ * allocated past the end of the file without the header being written, as
+ * after a crash, are dropped.
+ */
+struct FileMeta {
+  FileMeta() : header_dirty(false), has_map(false), map_dirty(false),
+               alloc_cursor(Page::INVALID_NUMBER), reserved_pages(0),
+               can_reserve(true) {}
+
+  /**
+   * Current header of the file.
+   */
+  FileHeader header;
+
+  /**
+   * Whether header differs from the header on disk.
+   */
+  bool header_dirty;
+
+  /**
+   * Whether used_pages has been loaded; only PageFiles load it.
+   */
+  bool has_map;
+
+  /**
+   * Pages of the file in use.
+   */
+  PageMap used_pages;
+
+  /**
+   * Whether the map on disk is out of date.
+   */
+  bool map_dirty;
+
+  /**
+   * Page allocated last; the next free page after it is allocated next.
+   */
+  PageId alloc_cursor;
+
+  /**
+   * Pages below this number have disk space reserved for them.
+   */
+  PageId reserved_pages;
+
+  /**
+   * Cleared once the filesystem has refused to reserve space.
+   */
+  bool can_reserve;
+};
+
+/**
+ * @brief When writes to a file are forced to stable storage.
+ */
+enum DurabilityMode {
+  /**
+   * Every page and header write is followed by fdatasync().  The map of used
+   * pages is still only written by File::sync().
+   */
+  SYNC_EACH_WRITE,
+
+  /**
+   * Writes reach the operating system only; they are made durable by
+   * File::sync(), which BufMgr::flushFile() calls.  The file header is
+   * written by File::sync() too.
+   */
+  SYNC_ON_FLUSH,
+
+  /**
+   * Writes are synced in groups.  The limits are checked only when a write
+   * happens: it syncs if a given number of writes is unsynced, or a given
+   * time has passed since the last sync.  There is no timer, so the last
+   * writes of a burst stay unsynced until the next write or File::sync(), and
+   * after an idle gap the first write syncs on its own.
+   */
+  GROUP_COMMIT
+};
+
+/**
+ * @brief An open UNIX file descriptor, shared by all File objects on the same file.
+ *
+ * Every transfer is positional (pread/pwrite, or preadv/pwritev for several
+ * buffers at once), so there is no shared seek position and any number of
+ * threads may read and write through the same handle concurrently.  Short
+ * transfers and EINTR are retried; other failures throw FileIOException.
+ */
+class FileHandle {
+ public:
+  /**
+   * Opens the file for reading and writing.
+   *
+   * @param name        Name of file.
+   * @param create_new  Whether to create (and truncate) the file.
+   * @throws  FileIOException  If the file cannot be opened.
+   */
+  FileHandle(const std::string& name, const bool create_new);
+
+  /**
+   * Closes the file descriptor.
+   */
+  ~FileHandle();
+
+  /**
+   * Reads up to len bytes at offset into buf.
+   *
+   * @return  Number of bytes read, less than len only at the end of the file.
+   */
+  std::size_t read(void* buf, const std::size_t len, const off_t offset) const;
+
+  /**
+   * Writes len bytes from buf at offset.
+   */
+  void write(const void* buf, const std::size_t len, const off_t offset) const;
+
+  /**
+   * Reads into the iovcnt buffers of iov, in order, starting at offset.
+   *
+   * @return  Number of bytes read, less than requested only at the end of the file.
+   */
+  std::size_t readv(const struct iovec* iov, const int iovcnt, const off_t offset) const;
+
+  /**
+   * Writes the iovcnt buffers of iov, in order, starting at offset.
+   */
+  void writev(const struct iovec* iov, const int iovcnt, const off_t offset) const;
+
+  /**
+   * Has the filesystem allocate disk space for len bytes at offset, where it
+   * can keep them contiguous, without changing the size of the file.
+   *
+   * @return  False if the filesystem cannot reserve space.
+   */
+  bool reserve(const off_t offset, const off_t len) const;
+
+  /**
+   * Latch serializing updates of the file header and page lists
+   * (allocatePage(), deletePage()) between threads.
+   */
+  std::mutex& metaLatch() const { return meta_latch_; }
+
+  /**
+   * Metadata shared by all File objects on this file, guarded by metaLatch().
+   */
+  FileMeta& meta() const { return meta_; }
+
+  /**
+   * Sets when writes through this handle are synced.
+   *
+   * @param mode        Durability mode.
+   * @param group_ms    GROUP_COMMIT: a write this long after the last sync
+   *                    syncs.
+   * @param group_pages GROUP_COMMIT: the write that leaves this many writes
+   *                    unsynced syncs.
+   */
+  void setDurability(const DurabilityMode mode, const std::uint32_t group_ms,
+                     const std::uint32_t group_pages);
+
+  /**
+   * Returns the durability mode of this handle.
+   */
+  DurabilityMode durability() const { return mode_; }
+
+  /**
+   * Forces all writes so far to stable storage, if there are any unsynced ones.
+   */
+  void sync() const;
+
+  /**
+   * Switches transfers to a second descriptor opened with O_DIRECT, so they
+   * bypass the kernel page cache, or back to the ordinary one.  Filesystems
+   * that refuse O_DIRECT, or accept the flag but fail direct transfers, leave
+   * the handle buffered.  Must not be called while transfers are running.
+   *
+   * @param on  Whether to use direct I/O.
+   * @return  True if transfers now use direct I/O.
+   */
+  bool setDirectIO(const bool on);
+
+  /**
+   * Returns true if transfers bypass the page cache.
+   */
+  bool directIO() const { return direct_fd_ >= 0; }
+
+ private:
+  /**
+   * Called after every write; syncs as the durability mode demands.
+   */
+  void wrote() const;
+
+  /**
+   * Transfer the buffers of iov, retrying until done, at end of file (reads)
+   * or on error.
+   */
+  std::size_t transfer(const struct iovec* iov, const int iovcnt, off_t offset,
+                       const bool writing) const;
+
+  /**
+   * transfer() through the descriptor fd, with as few preadv/pwritev calls as
+   * IOV_MAX allows.
+   */
+  std::size_t transferVectors(const int fd, const struct iovec* iov,
+                              const int iovcnt, off_t offset,
+                              const bool writing) const;
+
+  /**
+   * transfer() in direct I/O mode.  Buffers that are block aligned in memory
+   * and cover whole blocks on disk, like pool frames, go to the direct
+   * descriptor as they are.  Anything else goes through an aligned bounce
+   * buffer covering its blocks; only writes of less than a block, like the
+   * file header, read the blocks first to keep their other bytes.
+   */
+  std::size_t transferDirect(const struct iovec* iov, const int iovcnt,
+                             const off_t offset, const bool writing) const;
+
+  /**
+   * Transfer the block aligned buffer buf of len bytes at the block aligned
+   * offset through the direct descriptor, stopping early only at end of file.
+   */
+  std::size_t transferBlocks(void* buf, const std::size_t len, off_t offset,
+                             const bool writing) const;
+
+  FileHandle(const FileHandle&);
+  FileHandle& operator=(const FileHandle&);
+
+  /**
+   * Name of the file, for error messages.
+   */
+  std::string name_;
+
+  /**
+   * The file descriptor.
+   */
+  int fd_;
+
+  /**
+   * Descriptor opened with O_DIRECT while in direct I/O mode, -1 otherwise.
+   */
+  int direct_fd_;
+
+  /**
+   * See metaLatch().
+   */
+  mutable std::mutex meta_latch_;
+
+  /**
+   * See meta().
+   */
+  mutable FileMeta meta_;
+
+  /**
+   * Serializes direct writes of partial blocks, which rewrite the whole
+   * blocks around them.
+   */
+  mutable std::mutex direct_latch_;
+
+  /**
+   * See setDurability().
+   */
+  DurabilityMode mode_;
+  std::uint32_t group_ms_;
+  std::uint32_t group_pages_;
+
+  /**
+   * Number of writes completed so far.
+   */
+  mutable std::atomic<std::uint64_t> written_;
+
+  /**
+   * Value of written_ before the last fdatasync() started; all those writes
+   * are durable.
+   */
+  mutable std::atomic<std::uint64_t> synced_;
+
+  /**
+   * Held across fdatasync(), so that a sync returns only once a sync covering
+   * every write before it has finished.
+   */
+  mutable std::mutex sync_latch_;
+
+  /**
+   * Time of the last sync, in steady clock milliseconds.
+   */
+  mutable std::atomic<std::int64_t> last_sync_ms_;
+
+  /**
+   * End of the space reserve() has reserved so far. Direct writes that trim
+   * the file back to its size reserve what lies behind it again.
+   */
+  mutable std::atomic<off_t> reserved_to_;
+};
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
+ * The File class wraps a FileHandle on an underlying file on disk.  Files contain
  * fixed-sized pages, and they never deallocate space (though they do reuse
  * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * underlying file, they will share the handle.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_handles_ map) and just returns a file object with
+ * the already open handle for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * Reading and writing pages is threadsafe.  allocatePage() and deletePage() are
+ * serialized per file; opening and closing are serialized globally.
  */
 
 
@@ -143,6 +524,50 @@ class File {
    */
   virtual void writePage(const PageId page_number, const Page& new_page) = 0;
 
+  /**
+   * Reads count consecutive pages, starting at first, with one vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param pages   Array of at least count pages to read into.
+   * @throws  InvalidPageException  If any of the pages doesn't exist in the file
+   *                                or is not currently used.
+   */
+  virtual void readPages(const PageId first, const std::uint32_t count, Page* pages) const = 0;
+
+  /**
+   * Reads count consecutive pages, starting at first, with one vectored read,
+   * scattering them to wherever they go in memory.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param pages   Array of count pointers to the pages to read into, in page order.
+   * @throws  InvalidPageException  If any of the pages doesn't exist in the file
+   *                                or is not currently used. The exception names
+   *                                the first such page; the pages before it are read.
+   */
+  virtual void readPages(const PageId first, const std::uint32_t count, Page* const* pages) const = 0;
+
+  /**
+   * Writes count consecutive pages, starting at first, with one vectored write.
+   * Page by page this behaves exactly like writePage().
+   *
+   * @param first   Number of first page to write.
+   * @param count   Number of pages to write.
+   * @param pages   Array of at least count pages to write.
+   */
+  virtual void writePages(const PageId first, const std::uint32_t count, const Page* pages) = 0;
+
+  /**
+   * Writes count consecutive pages, starting at first, with one vectored write,
+   * gathering them from wherever they are in memory.
+   *
+   * @param first   Number of first page to write.
+   * @param count   Number of pages to write.
+   * @param pages   Array of count pointers to the pages to write, in page order.
+   */
+  virtual void writePages(const PageId first, const std::uint32_t count, const Page* const* pages) = 0;
+
   /**
    * Deletes a page from the file.
    *
@@ -157,6 +582,55 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Sets when writes to this file are forced to stable storage.  The setting
+   * is shared by all File objects open on the same file.  New files start in
+   * SYNC_ON_FLUSH.
+   *
+   * @param mode        Durability mode.
+   * @param group_ms    GROUP_COMMIT: a write this long after the last sync
+   *                    syncs.
+   * @param group_pages GROUP_COMMIT: the write that leaves this many writes
+   *                    unsynced syncs.
+   */
+  void setDurability(const DurabilityMode mode, const std::uint32_t group_ms = 10,
+                     const std::uint32_t group_pages = 64) {
+    handle_->setDurability(mode, group_ms, group_pages);
+  }
+
+  /**
+   * Returns the durability mode of this file.
+   */
+  DurabilityMode durability() const { return handle_->durability(); }
+
+  /**
+   * Writes the file header and map of used pages, if they have changed, and
+   * forces all writes to this file so far to stable storage.
+   */
+  void sync() const;
+
+  /**
+   * Reads and writes this file with O_DIRECT, bypassing the kernel page cache
+   * so that pages held by the buffer pool are not cached a second time.  The
+   * setting is shared by all File objects open on the same file.  Where the
+   * filesystem does not support direct I/O the file stays buffered.
+   *
+   * @param on  Whether to use direct I/O.
+   * @return  True if the file now uses direct I/O.
+   */
+  bool setDirectIO(const bool on) { return handle_->setDirectIO(on); }
+
+  /**
+   * Returns true if the file is read and written with direct I/O.
+   */
+  bool directIO() const { return handle_->directIO(); }
+
+ 	/**
+   * Number of pages disk space is reserved for at a time when a file grows,
+   * so that neighbouring pages end up next to each other on disk.
+   */
+  static const PageId EXTENT_PAGES = 64;
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -167,19 +641,20 @@ class File {
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
-   * offset from the beginning of the file).
+   * offset from the beginning of the file).  The header takes up all of page 0,
+   * so every page starts on a block boundary, as direct I/O wants it.
    *
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  static off_t pagePosition(const PageId page_number) {
+    return (off_t) page_number * Page::SIZE;
   }
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing handle.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -190,48 +665,71 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file handle in <handle_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, as cached while it is open.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file.  It reaches the disk on sync() or when
+   * the file is closed.
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Notes a change of the cached header; the caller holds the meta latch.
+   */
+  void headerChanged() const;
+
+  /**
+   * Writes the cached header and map of used pages, if they have changed; the
+   * caller holds the meta latch.
+   */
+  void flushMeta() const;
+
+  /**
+   * Reserves disk space, in whole extents of EXTENT_PAGES, for the pages
+   * [first, first + count) not covered yet; the caller holds the meta latch.
+   */
+  void reserveExtents(const PageId first, const PageId count) const;
+
+  typedef std::map<std::string, std::shared_ptr<FileHandle> > HandleMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
-   * Streams for opened files.
+   * Handles for opened files.
    */
-  static StreamMap open_streams_;
+  static HandleMap open_handles_;
 
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Protects open_handles_ and open_counts_.
+   */
+  static std::mutex open_latch_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Handle for underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<FileHandle> handle_;
 
   friend class FileIterator;
 };
@@ -249,10 +747,10 @@ class PageFile : public File {
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file handle to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the handle associated with this File object are inserted into the
+	 * open_handles_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -294,12 +792,40 @@ class PageFile : public File {
   ~PageFile();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file.  Free pages are handed out in page
+   * order, starting after the page allocated last, so that pages allocated
+   * one after the other are neighbours on disk; the file grows when none is
+   * left.
    *
    * @return The new page.
    */
   Page allocatePage(PageId &new_page_number);
 
+  /**
+   * Allocates a new page in the file, close behind the given page if there
+   * is a free page within EXTENT_PAGES after it, otherwise as allocatePage()
+   * does.
+   *
+   * @param new_page_number Number of the new page.
+   * @param near            Page the new page belongs next to.
+   * @return The new page.
+   */
+  Page allocatePage(PageId &new_page_number, const PageId near);
+
+  /**
+   * Rewrites a file so that its used pages are numbered 1, 2, ... in the
+   * order of the used page list, without free pages in between, and lie in
+   * one reserved run on disk.  The file must not be open; record IDs and
+   * indexes referring to its pages have to be translated or rebuilt.
+   *
+   * @param filename  Name of the file.
+   * @return  New number of every page, indexed by its old number;
+   *          Page::INVALID_NUMBER for free pages.
+   * @throws  FileOpenException       If the file is open.
+   * @throws  FileNotFoundException   If the file doesn't exist.
+   */
+  static std::vector<PageId> defragment(const std::string& filename);
+
   /**
    * Reads an existing page from the file.
    *
@@ -319,6 +845,48 @@ class PageFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page);
 
+  /**
+   * Reads count consecutive pages, starting at first, with one vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param pages   Array of at least count pages to read into.
+   * @throws  InvalidPageException  If any of the pages doesn't exist in the file
+   *                                or is not currently used.
+   */
+  void readPages(const PageId first, const std::uint32_t count, Page* pages) const;
+
+  /**
+   * Reads count consecutive pages, starting at first, scattered to the given pages
+   * with one vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param pages   Array of count pointers to the pages to read into, in page order.
+   * @throws  InvalidPageException  If any of the pages doesn't exist in the file
+   *                                or is not currently used.
+   */
+  void readPages(const PageId first, const std::uint32_t count, Page* const* pages) const;
+
+  /**
+   * Writes count consecutive pages, starting at first, with one vectored write.
+   *
+   * @param first   Number of first page to write.
+   * @param count   Number of pages to write.
+   * @param pages   Array of at least count pages to write.
+   */
+  void writePages(const PageId first, const std::uint32_t count, const Page* pages);
+
+  /**
+   * Writes count consecutive pages, starting at first, gathered from the given pages
+   * with one vectored write.
+   *
+   * @param first   Number of first page to write.
+   * @param count   Number of pages to write.
+   * @param pages   Array of count pointers to the pages to write, in page order.
+   */
+  void writePages(const PageId first, const std::uint32_t count, const Page* const* pages);
+
   /**
    * Deletes a page from the file.
    *
@@ -347,8 +915,8 @@ class PageFile : public File {
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as unused.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
@@ -379,7 +947,60 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the next page pointer in the header of the given page to disk.
+   * No bounds checking is performed.
+   *
+   * @param page_number       Number of page to update.
+   * @param next_page_number  New next page pointer.
+   */
+  void writeNextPageNumber(const PageId page_number, const PageId next_page_number);
+
+  /**
+   * Returns the first used page after the given one, from the map of used
+   * pages, or Page::INVALID_NUMBER.
+   */
+  PageId nextUsedPage(const PageId page_number) const;
+
+  /**
+   * Returns the last used page before the given one, from the map of used
+   * pages, or Page::INVALID_NUMBER.
+   */
+  PageId previousUsedPage(const PageId page_number) const;
+
+  /**
+   * Takes the given page, free or just past the end of the file, into use;
+   * the caller holds the meta latch.
+   */
+  Page usePage(const PageId new_page_number);
+
+  /**
+   * Sets the first used page, first free page and number of free pages in the
+   * header from the map; the caller holds the meta latch.
+   */
+  void checkHeader();
+
+  /**
+   * Loads the map of used pages stored behind the last page, or rebuilds it
+   * from the page headers if it is missing or out of date.  Does nothing if
+   * it is loaded already.
+   */
+  void loadMap();
+
+  /**
+   * Writes count consecutive new pages, starting at first, headers included,
+   * with one vectored write.  Unlike writePages(), the pages need not exist
+   * on disk yet: they are marked used, and the file grows to hold them.
+   * No bounds checking is performed.
+   *
+   * @param first   Number of first page to write.
+   * @param count   Number of pages to write.
+   * @param pages   Array of at least count pages to write.
+   */
+  void writeNewPages(const PageId first, const std::uint32_t count, const Page* pages);
+
   friend class FileIterator;
+  friend class FileAppender;
 };
 
 class BlobFile : public File {
@@ -395,10 +1016,10 @@ class BlobFile : public File {
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file handle to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the handle associated with this File object are inserted into the
+	 * open_handles_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -467,6 +1088,48 @@ class BlobFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page);
 
+  /**
+   * Reads count consecutive pages, starting at first, with one vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param pages   Array of at least count pages to read into.
+   * @throws  InvalidPageException  If any of the pages doesn't exist in the file
+   *                                or is not currently used.
+   */
+  void readPages(const PageId first, const std::uint32_t count, Page* pages) const;
+
+  /**
+   * Reads count consecutive pages, starting at first, scattered to the given pages
+   * with one vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param pages   Array of count pointers to the pages to read into, in page order.
+   * @throws  InvalidPageException  If any of the pages doesn't exist in the file
+   *                                or is not currently used.
+   */
+  void readPages(const PageId first, const std::uint32_t count, Page* const* pages) const;
+
+  /**
+   * Writes count consecutive pages, starting at first, with one vectored write.
+   *
+   * @param first   Number of first page to write.
+   * @param count   Number of pages to write.
+   * @param pages   Array of at least count pages to write.
+   */
+  void writePages(const PageId first, const std::uint32_t count, const Page* pages);
+
+  /**
+   * Writes count consecutive pages, starting at first, gathered from the given pages
+   * with one vectored write.
+   *
+   * @param first   Number of first page to write.
+   * @param count   Number of pages to write.
+   * @param pages   Array of count pointers to the pages to write, in page order.
+   */
+  void writePages(const PageId first, const std::uint32_t count, const Page* const* pages);
+
   /**
    * Deletes a page from the file.
    *
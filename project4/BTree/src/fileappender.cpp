@@ -0,0 +1,130 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "fileappender.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+
+namespace badgerdb { 
+
+FileAppender::FileAppender(PageFile *pageFile, BufMgr *bufferMgr, const AccessStrategy accessStrategy)
+{
+  file = pageFile;
+	bufMgr = bufferMgr;
+	strategy = accessStrategy;
+  nextPage = file->readHeader().num_pages;
+  pageOpen = false;
+  batch.reserve(BATCH_PAGES);
+
+  // the used page list is in page order, so its last page is the last used page of the file
+  tail = file->previousUsedPage(nextPage);
+}
+
+FileAppender::~FileAppender()
+{
+  try
+  {
+    flush();
+  }
+  catch (BadgerDbException e)
+  {
+    // nothing to report it to
+  }
+}
+
+RecordId FileAppender::append(const std::string &record)
+{
+  std::vector<std::string> records(1, record);
+  std::vector<RecordId> recordIds;
+  append(records, &recordIds);
+  return recordIds[0];
+}
+
+void FileAppender::append(const std::vector<std::string> &records, std::vector<RecordId> *recordIds)
+{
+  std::size_t next = 0;
+  while (next < records.size())
+  {
+    if (!pageOpen)
+      startPage();
+    const std::size_t inserted = curPage.insertRecords(records, next, recordIds);
+    next += inserted;
+    if (next == records.size())
+      break;
+
+    // the next record does not fit
+    if (inserted == 0 && curPage.header_.num_slots == 0)
+    {
+      // give the empty page back, flush() must not write it
+      pageOpen = false;
+      nextPage--;
+      // nor may the page filled before it point at it; that page ends the list again
+      if (!batch.empty())
+      {
+        if (batch.back().next_page_number() == nextPage)
+          batch.back().set_next_page_number(Page::INVALID_NUMBER);
+      }
+      else if (tail == Page::INVALID_NUMBER)
+      {
+        // the filled page went out with the last batch
+        tail = file->previousUsedPage(nextPage);
+        if (tail != Page::INVALID_NUMBER)
+          file->writeNextPageNumber(tail, Page::INVALID_NUMBER);
+      }
+      throw InsufficientSpaceException(curPage.page_number(), records[next].length(), curPage.getFreeSpace());
+    }
+    curPage.set_next_page_number(nextPage);
+    batch.push_back(curPage);
+    pageOpen = false;
+    if (batch.size() >= BATCH_PAGES)
+      writeBatch();
+  }
+}
+
+void FileAppender::flush()
+{
+  if (pageOpen)
+  {
+    batch.push_back(curPage);
+    pageOpen = false;
+  }
+  writeBatch();
+}
+
+void FileAppender::startPage()
+{
+  curPage = Page();
+  curPage.set_page_number(nextPage);
+  nextPage++;
+  pageOpen = true;
+}
+
+void FileAppender::writeBatch()
+{
+  if (batch.empty())
+    return;
+  const PageId first = batch.front().page_number();
+  file->writeNewPages(first, (std::uint32_t) batch.size(), &batch[0]);
+
+  // hook the batch onto the used page list; writing the pages has updated the header
+  if (tail != Page::INVALID_NUMBER)
+  {
+    file->writeNextPageNumber(tail, first);
+  }
+  // the last page only has a successor if it was filled up
+  const Page& last = batch.back();
+  tail = last.next_page_number() == Page::INVALID_NUMBER ? last.page_number() : Page::INVALID_NUMBER;
+
+  if (bufMgr != NULL)
+  {
+    for (std::size_t i = 0; i < batch.size(); i++)
+      bufMgr->cachePage(file, batch[i].page_number(), batch[i], strategy);
+  }
+  batch.clear();
+}
+
+}
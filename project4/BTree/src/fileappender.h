@@ -0,0 +1,123 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+ * @brief This class is used to load records into a relation, filling one page at a time.
+ *
+ * New pages are numbered past the end of the file and chained behind its last used page;
+ * free pages are left for allocatePage() to reuse. Pages are filled through Page::insertRecords() and
+ * written to the file in batches, with one vectored write per batch. Given a buffer
+ * manager, a copy of every page written is also left in its pool.
+ *
+ * Nothing else may allocate pages in the file while an appender is open, and the last
+ * pages appended are only in the file after flush().
+ */
+class FileAppender
+{
+ public:
+
+  /**
+   * Opens file for appending. The pages written are cached by bufMgr, if given, with
+   * the given access strategy.
+   */
+  FileAppender(PageFile *file, BufMgr *bufMgr = NULL, const AccessStrategy strategy = BULK_WRITE);
+
+  /**
+   * Flushes the appended records to the file. Errors are lost; call flush() first to see
+   * them.
+   */
+  ~FileAppender();
+
+  /**
+   * Appends one record and returns its id.
+   *
+   * @throws InsufficientSpaceException If the record does not fit in an empty page
+   */
+  RecordId append(const std::string &record);
+
+  /**
+   * Appends records in order, adding their ids to recordIds if given.
+   *
+   * @throws InsufficientSpaceException If a record does not fit in an empty page; the
+   *                                    records before it are appended
+   */
+  void append(const std::vector<std::string> &records, std::vector<RecordId> *recordIds = NULL);
+
+  /**
+   * Writes the pages appended so far, including the one being filled, and the file
+   * header. Appending more records afterwards starts a new page.
+   */
+  void flush();
+
+ private:
+  /**
+   * Number of full pages collected before they are written.
+   */
+  static const std::uint32_t BATCH_PAGES = 32;
+
+  /**
+   * File which is being appended to.
+   */
+  PageFile      *file;
+
+  /**
+   * Buffer Manager instance the pages written are cached in, or NULL.
+   */
+	BufMgr				*bufMgr;
+
+  /**
+   * Access strategy the pages are cached with.
+   */
+  AccessStrategy strategy;
+
+  /**
+   * Number of the next page to start, past the pages numbered but not written yet.
+   */
+  PageId        nextPage;
+
+  /**
+   * Last page of the used page list on disk whose next page is still to be appended,
+   * or Page::INVALID_NUMBER.
+   */
+  PageId        tail;
+
+  /**
+   * Full pages not written yet, consecutively numbered and chained.
+   */
+  std::vector<Page> batch;
+
+  /**
+   * Page being filled, valid if pageOpen.
+   */
+  Page          curPage;
+
+  bool          pageOpen;
+
+  /**
+   * Number a new page past the end of the file and start filling it.
+   */
+  void startPage();
+
+  /**
+   * Write the pages in batch and link them to the used page list.
+   */
+  void writeBatch();
+};
+
+}
@@ -10,40 +10,31 @@
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const AccessStrategy accessStrategy)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
-	curDirtyFlag = false;
-  curPage = NULL;
+	strategy = accessStrategy;
 	filePageIter = file->begin();
 }
 
 FileScan::~FileScan()
 {
   // generally must unpin last page of the scan
-  if (curPage != NULL)
-  {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-		curDirtyFlag = false;
-    filePageIter = file->begin();
-  }
+  curPage.release();
   bufMgr->flushFile(file);
   delete file;
 }
 
 void FileScan::scanNext(RecordId& outRid)
 {
-  std::string rec;
-
   if (filePageIter == file->end())
 	{
 		throw EndOfFileException();
 	}
 
   // special case of the first record of the first page of the file
-  if (curPage == NULL)
+  if (!curPage.pinned())
   {
     // need to get the first page of the file
 		filePageIter = file->begin();
@@ -53,17 +44,13 @@ void FileScan::scanNext(RecordId& outRid)
 		}
 	 
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
+    curPage = bufMgr->fetch(file, filePageIter.page_number(), strategy);
 
 		// get the first record off the page
     pageRecordIter = curPage->begin(); 
 
 		if(pageRecordIter != curPage->end()) 
 		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
-
 			outRid = pageRecordIter.getCurrentRecord();
 			return;
 		}
@@ -76,28 +63,22 @@ void FileScan::scanNext(RecordId& outRid)
   while (pageRecordIter == curPage->end())
   {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-    curDirtyFlag = false;
+    curPage.release();
 
     filePageIter++;
     if (filePageIter == file->end())
     {
-      curPage = NULL;
 			throw EndOfFileException();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    curPage = bufMgr->fetch(file, filePageIter.page_number(), strategy);
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
   }
 
-  // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
+  // pageRecordIter points at a valid record, which getRecord() and viewRecord() return
 
 	// return rid of the record
 	outRid = pageRecordIter.getCurrentRecord();
@@ -108,13 +89,18 @@ void FileScan::scanNext(RecordId& outRid)
 // and the scan logic is required to unpin the page 
 std::string FileScan::getRecord()
 {
-  return *pageRecordIter;
+  return pageRecordIter.view().str();
+}
+
+RecordView FileScan::viewRecord()
+{
+  return pageRecordIter.view();
 }
 
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
-  curDirtyFlag = true;
+  curPage.markDirty();
 }
 
 }
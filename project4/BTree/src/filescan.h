@@ -24,16 +24,27 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * Opens relation name for a sequential scan. Pages are read with the given access
+   * strategy, by default through the buffer manager's BULK_READ ring so that scanning a
+   * large relation does not flush the rest of the buffer pool.
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, const AccessStrategy strategy = BULK_READ);
 
   ~FileScan();
 
   //return RecordId of next record that satisfies the scan 
   void scanNext(RecordId& outRid);
 
-  //read current record, returning pointer and length
+  //read current record, returning a copy of it
   std::string getRecord();
 
+  /**
+   * Returns the current record in place on the scan's pinned page, without copying it.
+   * The view is good until the scan moves to the next page or is destroyed.
+   */
+  RecordView viewRecord();
+
   //marks current page of scan dirty
   void markDirty();
 
@@ -49,17 +60,18 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Access strategy the pages of the scan are read with.
    */
-  Page*         curPage;
-
-  FileIterator  filePageIter;
-  PageIterator  pageRecordIter;
+  AccessStrategy strategy;
 
   /**
-   * True if page has been updated
+   * Current page being scanned, pinned until the scan moves on. Marked dirty through
+   * markDirty().
    */
-  bool  	      curDirtyFlag;
+  PageHandle    curPage;
+
+  FileIterator  filePageIter;
+  PageIterator  pageRecordIter;
 };
 
 }
@@ -5,20 +5,31 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
+#include "fileappender.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -45,6 +56,9 @@ const std::string relationName = "relA";
 const int	relationSize = 5000;
 std::string intIndexName, doubleIndexName, stringIndexName;
 
+// traces of the forward, backward and random tests are written with this prefix if given
+std::string tracePrefix;
+
 // This is the structure for tuples in the base relation
 
 typedef struct tuple {
@@ -78,151 +92,1611 @@ int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Opera
 void test1();
 void test2();
 void test3();
+void test4();
+void test5();
+void test6();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+bool pageHolds(const Page& page, const PageId pageNo, const int version);
 void test7();
+int indexPassReads(BTreeIndex *index, BufMgr *mgr);
 void errorTests();
 void deleteRelation();
 
 int main(int argc, char **argv)
 {
-	if( argc != 2 )
+	if( argc != 2 && argc != 3 )
+	{
+		std::cout << "Expects one argument as a number between 1 to 3 to choose datatype of key.\n";
+		std::cout << "For INTEGER keys run as: ./badgerdb_main 1\n";
+		std::cout << "For DOUBLE keys run as: ./badgerdb_main 2\n";
+		std::cout << "For STRING keys run as: ./badgerdb_main 3\n";
+		std::cout << "A second argument names a prefix for buffer access traces of the forward,\n";
+		std::cout << "backward and random tests, for bufsim: ./badgerdb_main 1 int\n";
+		return 0;
+	}
+
+	sscanf(argv[1],"%d",&testNum);
+	if (argc == 3)
+		tracePrefix = argv[2];
+
+	switch(testNum)
+	{
+		case 1:
+			std::cout << "leaf size:" << INTARRAYLEAFSIZE << " non-leaf size:" << INTARRAYNONLEAFSIZE << std::endl;
+			break;
+		case 2:
+			std::cout << "leaf size:" << DOUBLEARRAYLEAFSIZE << " non-leaf size:" << DOUBLEARRAYNONLEAFSIZE << std::endl;
+			break;
+		case 3:
+			std::cout << "leaf size:" << STRINGARRAYLEAFSIZE << " non-leaf size:" << STRINGARRAYNONLEAFSIZE << std::endl;
+			break;
+	}
+
+
+  // Clean up from any previous runs that crashed.
+  try
+	{
+    File::remove(relationName);
+  }
+	catch(FileNotFoundException)
+	{
+  }
+
+	{
+		// Create a new database file.
+		PageFile new_file = PageFile::create(relationName);
+
+		// Allocate some pages and put data on them.
+		for (int i = 0; i < 20; ++i)
+		{
+			PageId new_page_number;
+			Page new_page = new_file.allocatePage(new_page_number);
+
+    	sprintf(record1.s, "%05d string record", i);
+    	record1.i = i;
+    	record1.d = (double)i;
+    	std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+
+			new_page.insertRecord(new_data);
+			new_file.writePage(new_page_number, new_page);
+		}
+
+	}
+	// new_file goes out of scope here, so file is automatically closed.
+
+	{
+		FileScan fscan(relationName, bufMgr);
+
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
+				std::string recordStr = fscan.getRecord();
+				const char *record = recordStr.c_str();
+				int key = *((int *)(record + offsetof (RECORD, i)));
+				std::cout << "Extracted : " << key << std::endl;
+			}
+		}
+		catch(EndOfFileException e)
+		{
+			std::cout << "Read all records" << std::endl;
+		}
+	}
+	// filescan goes out of scope here, so relation file gets closed.
+
+	File::remove(relationName);
+	if (testNum == 6){
+		createRelationForward();
+		BTreeIndex index1(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		deleteRelation();
+		createRelationForward();
+		BTreeIndex index2(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE);
+		deleteRelation();
+		createRelationForward();
+		BTreeIndex index3(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+		deleteRelation();
+		printf("all 3 indexes has been created\n");
+		return 1 ;
+	}
+	
+	test1();
+	test2();
+	test3();
+	test4();
+	test5();
+	test6();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	//test7(); // insert a lot of entries 600000
+	errorTests();
+
+	printf("PASSED ALL TESTS\n");
+
+  return 1;
+}
+
+void test1()
+{
+	// Create a relation with tuples valued 0 to relationSize and perform index tests 
+	// on attributes of all three types (int, double, string)
+	std::cout << "---------------------" << std::endl;
+	std::cout << "createRelationForward" << std::endl;
+	createRelationForward();
+	if (!tracePrefix.empty())
+		bufMgr->startTrace(tracePrefix + ".forward.trace");
+	indexTests();
+	bufMgr->stopTrace();
+	deleteRelation();
+	printf("passed createRelationForward()\n");
+}
+
+void test2()
+{
+	// Create a relation with tuples valued 0 to relationSize in reverse order and perform index tests 
+	// on attributes of all three types (int, double, string)
+	std::cout << "----------------------" << std::endl;
+	std::cout << "createRelationBackward" << std::endl;
+	createRelationBackward();
+	if (!tracePrefix.empty())
+		bufMgr->startTrace(tracePrefix + ".backward.trace");
+	indexTests();
+	bufMgr->stopTrace();
+	deleteRelation();
+	printf("passed createRelationBackward()\n");
+}
+
+void test3()
+{
+	// Create a relation with tuples valued 0 to relationSize in random order and perform index tests 
+	// on attributes of all three types (int, double, string)
+	std::cout << "--------------------" << std::endl;
+	std::cout << "createRelationRandom" << std::endl;
+	createRelationRandom();
+	if (!tracePrefix.empty())
+		bufMgr->startTrace(tracePrefix + ".random.trace");
+	indexTests();
+	bufMgr->stopTrace();
+	deleteRelation();
+	printf("passed createRelationRandom()\n");
+}
+
+void test4()
+{
+	// Build an integer index through a small buffer pool and check that a full scan of a
+	// relation larger than the pool leaves the index pages resident when the scan reads
+	// through the bulk read ring, but not when it competes for the whole pool
+	std::cout << "--------------------" << std::endl;
+	std::cout << "scanResistance" << std::endl;
+	createRelationForward();
+
+	{
+		BufMgr scanBufMgr(40);
+		BTreeIndex index(relationName, intIndexName, &scanBufMgr, offsetof(tuple,i), INTEGER);
+
+		// bring every index page into the pool
+		indexPassReads(&index, &scanBufMgr);
+
+		int ringReads = 0, normalReads = 0;
+		AccessStrategy strategies[2] = {BULK_READ, NORMAL_ACCESS};
+		for (int s = 0; s < 2; s++)
+		{
+			{
+				FileScan fscan(relationName, &scanBufMgr, strategies[s]);
+				RecordId scanRid;
+				try
+				{
+					while(1)
+						fscan.scanNext(scanRid);
+				}
+				catch(EndOfFileException e)
+				{
+				}
+			}
+
+			if (strategies[s] == BULK_READ)
+				ringReads = indexPassReads(&index, &scanBufMgr);
+			else
+				normalReads = indexPassReads(&index, &scanBufMgr);
+		}
+
+		std::cout << "Index page reads after a scan through the ring: " << ringReads
+			<< ", through the whole pool: " << normalReads << std::endl;
+		if (ringReads != 0)
+		{
+			std::cout << "Index pages were evicted by a bulk read scan" << std::endl;
+			exit(1);
+		}
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	printf("passed scanResistance()\n");
+}
+
+void test5()
+{
+	// Scan a relation and walk the leaves of an index on it, checking that the buffer
+	// manager reads ahead of both and that the pages it reads ahead get used
+	std::cout << "--------------------" << std::endl;
+	std::cout << "readAhead" << std::endl;
+	createRelationForward();
+
+	{
+		BufMgr aheadBufMgr(100);
+
+		AccessStrategy strategies[2] = {NORMAL_ACCESS, BULK_READ};
+		for (int s = 0; s < 2; s++)
+		{
+			int numRecords = 0;
+			aheadBufMgr.clearBufStats();
+			{
+				FileScan fscan(relationName, &aheadBufMgr, strategies[s]);
+				RecordId scanRid;
+				try
+				{
+					while(1)
+					{
+						fscan.scanNext(scanRid);
+						numRecords++;
+					}
+				}
+				catch(EndOfFileException e)
+				{
+				}
+			}
+
+			BufStats& stats = aheadBufMgr.getBufStats();
+			std::cout << (strategies[s] == BULK_READ ? "Bulk" : "Normal") << " file scan: " << stats.diskreads
+				<< " disk reads, " << stats.prefetches << " read ahead, " << stats.prefetchhits << " used, "
+				<< stats.prefetchwasted << " wasted" << std::endl;
+			if (numRecords != relationSize || stats.prefetchhits == 0)
+			{
+				std::cout << "File scan read " << numRecords << " records, " << stats.prefetchhits << " of them ahead" << std::endl;
+				exit(1);
+			}
+		}
+
+		BTreeIndex index(relationName, intIndexName, &aheadBufMgr, offsetof(tuple,i), INTEGER);
+		indexPassReads(&index, &aheadBufMgr);
+		BufStats& stats = aheadBufMgr.getBufStats();
+		std::cout << "Leaf chain walk: " << stats.diskreads << " disk reads, " << stats.prefetchhits
+			<< " leaves read ahead" << std::endl;
+		if (stats.prefetchhits == 0)
+		{
+			std::cout << "No leaf was read ahead" << std::endl;
+			exit(1);
+		}
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	printf("passed readAhead()\n");
+}
+
+void test6()
+{
+	// Round trip pages through the vectored multi-page calls of PageFile and BlobFile,
+	// then read one file from several threads at once through the shared handle
+	std::cout << "--------------------" << std::endl;
+	std::cout << "fileBackend" << std::endl;
+	const std::string ioName = relationName + ".io";
+	const int numPages = 64;
+	const int numThreads = 4;
+	const int numRounds = 20;
+
+	try
+	{
+		File::remove(ioName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile ioFile = PageFile::create(ioName);
+		Page* pages = new Page[numPages];
+		for (int k = 0; k < numPages; k++)
+		{
+			PageId pageNo;
+			Page newPage = ioFile.allocatePage(pageNo);
+			sprintf(record1.s, "%05d page version 0", pageNo);
+			newPage.insertRecord(std::string(record1.s, sizeof(record1.s)));
+			ioFile.writePage(pageNo, newPage);
+		}
+
+		ioFile.readPages(1, numPages, pages);
+		for (int k = 0; k < numPages; k++)
+		{
+			if (!pageHolds(pages[k], k + 1, 0))
+			{
+				std::cout << "readPages returned the wrong contents for page " << k + 1 << std::endl;
+				exit(1);
+			}
+			sprintf(record1.s, "%05d page version 1", k + 1);
+			pages[k].updateRecord(RecordId {(PageId) (k + 1), 1}, std::string(record1.s, sizeof(record1.s)));
+		}
+		ioFile.writePages(1, numPages, pages);
+
+		// the used page list must survive a vectored write
+		int numUsed = 0;
+		for (FileIterator iter = ioFile.begin(); iter != ioFile.end(); ++iter)
+			numUsed++;
+		if (numUsed != numPages)
+		{
+			std::cout << "writePages broke the page list: " << numUsed << " pages left" << std::endl;
+			exit(1);
+		}
+
+		std::atomic<int> mismatches(0);
+		std::vector<std::thread> readers;
+		for (int t = 0; t < numThreads; t++)
+		{
+			readers.push_back(std::thread([&ioFile, &mismatches, t, numPages, numRounds]() {
+				for (int r = 0; r < numRounds; r++)
+				{
+					for (int k = 0; k < numPages; k++)
+					{
+						PageId pageNo = (PageId) ((k + t * 17) % numPages + 1);
+						if (!pageHolds(ioFile.readPage(pageNo), pageNo, 1))
+							mismatches++;
+					}
+				}
+			}));
+		}
+		for (int t = 0; t < numThreads; t++)
+			readers[t].join();
+		if (mismatches != 0)
+		{
+			std::cout << mismatches << " concurrent page reads returned the wrong contents" << std::endl;
+			exit(1);
+		}
+		delete [] pages;
+	}
+	File::remove(ioName);
+
+	{
+		BlobFile blobFile = BlobFile::create(ioName);
+		Page* pages = new Page[numPages];
+		for (int k = 0; k < numPages; k++)
+		{
+			PageId pageNo;
+			blobFile.allocatePage(pageNo);
+			sprintf(record1.s, "%05d blob", pageNo);
+			pages[k].insertRecord(std::string(record1.s, sizeof(record1.s)));
+		}
+		blobFile.writePages(1, numPages, pages);
+
+		Page* copies = new Page[numPages];
+		blobFile.readPages(1, numPages, copies);
+		for (int k = 0; k < numPages; k++)
+		{
+			if (memcmp(&copies[k], &pages[k], sizeof(Page)) != 0)
+			{
+				std::cout << "BlobFile readPages returned the wrong contents for page " << k + 1 << std::endl;
+				exit(1);
+			}
+		}
+		delete [] pages;
+		delete [] copies;
+	}
+	File::remove(ioName);
+	printf("passed fileBackend()\n");
+}
+
+void test8()
+{
+	// Load the same relation through the buffer manager under each durability mode and
+	// report the load throughput; flushFile() makes the relation durable in all of them
+	std::cout << "--------------------" << std::endl;
+	std::cout << "durabilityModes" << std::endl;
+	const std::string loadName = relationName + ".load";
+	const int numRecords = 20000;
+	const DurabilityMode modes[3] = {SYNC_EACH_WRITE, SYNC_ON_FLUSH, GROUP_COMMIT};
+	const char* modeNames[3] = {"sync each write", "sync on flushFile", "group commit"};
+
+	for (int m = 0; m < 3; m++)
+	{
+		try
+		{
+			File::remove(loadName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+
+		int numPages = 0;
+		{
+			PageFile loadFile = PageFile::create(loadName);
+			loadFile.setDurability(modes[m], 10, 64);
+			BufMgr loadBufMgr(100);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			PageId pageNo;
+			Page* page;
+			loadBufMgr.allocPage(&loadFile, pageNo, page);
+			for (int i = 0; i < numRecords; i++)
+			{
+				sprintf(record1.s, "%05d string record", i);
+				record1.i = i;
+				record1.d = (double)i;
+				std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+				try
+				{
+					page->insertRecord(new_data);
+				}
+				catch(InsufficientSpaceException e)
+				{
+					loadBufMgr.unPinPage(&loadFile, pageNo, true);
+					loadBufMgr.allocPage(&loadFile, pageNo, page);
+					page->insertRecord(new_data);
+				}
+			}
+			loadBufMgr.unPinPage(&loadFile, pageNo, true);
+			loadBufMgr.flushFile(&loadFile);
+			double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			for (FileIterator iter = loadFile.begin(); iter != loadFile.end(); ++iter)
+				numPages++;
+			std::cout << modeNames[m] << ": " << (long)(numRecords / secs) << " records/sec, "
+				<< numPages << " pages" << std::endl;
+		}
+
+		int numLoaded = 0;
+		{
+			FileScan fscan(loadName, bufMgr);
+			RecordId scanRid;
+			try
+			{
+				while(1)
+				{
+					fscan.scanNext(scanRid);
+					numLoaded++;
+				}
+			}
+			catch(EndOfFileException e)
+			{
+			}
+		}
+		checkPassFail(numLoaded, numRecords)
+	}
+
+	File::remove(loadName);
+	printf("passed durabilityModes()\n");
+}
+
+void test9()
+{
+	// Dirty pages of two files share the pool; flushing one must leave the other's pages
+	// resident and refuse to write anything while one of its own pages is pinned
+	std::cout << "--------------------" << std::endl;
+	std::cout << "flushFilePerFile" << std::endl;
+	const std::string nameA = relationName + ".a";
+	const std::string nameB = relationName + ".b";
+	const int numPages = 20;
+
+	try
+	{
+		File::remove(nameA);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	try
+	{
+		File::remove(nameB);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile fileA = PageFile::create(nameA);
+		PageFile fileB = PageFile::create(nameB);
+		BufMgr flushBufMgr(100);
+		PageId pagesA[numPages];
+		PageId pagesB[numPages];
+		Page* page;
+
+		for (int i = 0; i < numPages; i++)
+		{
+			sprintf(record1.s, "%05d string record", i);
+			std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+			flushBufMgr.allocPage(&fileA, pagesA[i], page);
+			page->insertRecord(new_data);
+			flushBufMgr.unPinPage(&fileA, pagesA[i], true);
+			flushBufMgr.allocPage(&fileB, pagesB[i], page);
+			page->insertRecord(new_data);
+			flushBufMgr.unPinPage(&fileB, pagesB[i], true);
+		}
+
+		// a pinned page stops the flush before any page is written
+		flushBufMgr.clearBufStats();
+		flushBufMgr.readPage(&fileA, pagesA[numPages - 1], page);
+		bool pinned = false;
+		try
+		{
+			flushBufMgr.flushFile(&fileA);
+		}
+		catch(PagePinnedException e)
+		{
+			pinned = true;
+		}
+		checkPassFail(pinned, true)
+		const std::uint16_t emptySpace = Page().getFreeSpace();
+		bool onDisk = fileA.readPage(pagesA[0]).getFreeSpace() != emptySpace;
+		checkPassFail(onDisk, false)
+		flushBufMgr.unPinPage(&fileA, pagesA[numPages - 1], false);
+
+		flushBufMgr.flushFile(&fileA);
+		onDisk = fileA.readPage(pagesA[0]).getFreeSpace() != emptySpace;
+		checkPassFail(onDisk, true)
+
+		// the other file's pages never left the pool
+		flushBufMgr.clearBufStats();
+		for (int i = 0; i < numPages; i++)
+		{
+			flushBufMgr.readPage(&fileB, pagesB[i], page);
+			flushBufMgr.unPinPage(&fileB, pagesB[i], false);
+		}
+		checkPassFail(flushBufMgr.getBufStats().diskreads, 0)
+
+		// and the flushed file's pages come back from disk
+		for (int i = 0; i < numPages; i++)
+		{
+			flushBufMgr.readPage(&fileA, pagesA[i], page);
+			flushBufMgr.unPinPage(&fileA, pagesA[i], false);
+		}
+		checkPassFail(flushBufMgr.getBufStats().diskreads, numPages)
+		flushBufMgr.flushFile(&fileB);
+	}
+
+	File::remove(nameA);
+	File::remove(nameB);
+	printf("passed flushFilePerFile()\n");
+}
+
+void test10()
+{
+	// Build an index from a randomly ordered relation through a small pool, so dirty index
+	// pages are evicted all the time, and report how many write requests the pages written
+	// back took. The index must read back complete afterwards.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "writeBackBatching" << std::endl;
+	createRelationRandom();
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BufMgr writeBufMgr(8);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			BTreeIndex index(relationName, intIndexName, &writeBufMgr, offsetof(tuple,i), INTEGER);
+			writeBufMgr.checkpoint();
+		}
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		BufStats stats = writeBufMgr.getBufStats();
+		std::cout << "Pages written: " << stats.diskwrites << " with " << stats.writecalls
+			<< " write requests in " << secs << " s" << std::endl;
+		bool batched = stats.writecalls < stats.diskwrites;
+		checkPassFail(batched, true)
+	}
+
+	{
+		BufMgr readBufMgr(20);
+		BTreeIndex index(relationName, intIndexName, &readBufMgr, offsetof(tuple,i), INTEGER);
+		int lowVal = 0, highVal = relationSize;
+		int numEntries = 0;
+		RecordId scanRid;
+		index.startScan(&lowVal, GTE, &highVal, LT);
+		try
+		{
+			while(1)
+			{
+				index.scanNext(scanRid);
+				numEntries++;
+			}
+		}
+		catch(IndexScanCompletedException e)
+		{
+		}
+		index.endScan();
+		checkPassFail(numEntries, relationSize)
+	}
+
+	File::remove(intIndexName);
+	deleteRelation();
+	printf("passed writeBackBatching()\n");
+}
+
+void test11()
+{
+	// Index inserts pin every page through a PageHandle, which unpins by frame. Count the
+	// hash table lookups an index build makes and the ones unPinPage() would have added.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "pageHandles" << std::endl;
+	createRelationForward();
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BufMgr handleBufMgr(100);
+		{
+			BTreeIndex index(relationName, intIndexName, &handleBufMgr, offsetof(tuple,i), INTEGER);
+		}
+		BufStats stats = handleBufMgr.getBufStats();
+		std::cout << "Hash lookups per insert: " << (double) stats.lookups / relationSize
+			<< ", saved by unpinning through handles: " << (double) stats.handleunpins / relationSize << std::endl;
+		bool saved = stats.handleunpins >= relationSize;
+		checkPassFail(saved, true)
+
+		// a handle unpins when it goes away, so the file can be flushed
+		PageFile relation = PageFile::open(relationName);
+		PageId first = (*relation.begin()).page_number();
+		{
+			PageHandle page = handleBufMgr.fetch(&relation, first);
+			PageHandle moved = std::move(page);
+			bool pinned = !page.pinned() && moved.pinned();
+			checkPassFail(pinned, true)
+
+			// nor can the page be disposed of under it
+			bool refused = false;
+			try
+			{
+				handleBufMgr.disposePage(&relation, first);
+			}
+			catch(PagePinnedException e)
+			{
+				refused = true;
+			}
+			checkPassFail(refused, true)
+		}
+		handleBufMgr.flushFile(&relation);
+	}
+
+	File::remove(intIndexName);
+	deleteRelation();
+	printf("passed pageHandles()\n");
+}
+
+void test12()
+{
+	// Random point lookups on an index held by a large pool, once with the pool on
+	// ordinary pages and once on huge pages where the system has them. Every frame of
+	// the arena has to be page aligned either way.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "bufferArena" << std::endl;
+	const std::uint32_t poolSize = 4096;
+	const int numLookups = 50000;
+	const char* backingNames[] = {"small pages", "transparent huge pages", "hugetlb pages"};
+	createRelationRandom();
+
+	for (int huge = 0; huge < 2; huge++)
+	{
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+
+		BufMgr arenaBufMgr(poolSize, huge == 1);
+		bool aligned = true;
+		for (std::uint32_t i = 0; i < poolSize; i++)
+			if (reinterpret_cast<std::uintptr_t>(&arenaBufMgr.bufPool[i]) % sysconf(_SC_PAGESIZE) != 0)
+				aligned = false;
+		checkPassFail(aligned, true)
+
+		{
+			BTreeIndex index(relationName, intIndexName, &arenaBufMgr, offsetof(tuple,i), INTEGER);
+			RecordId scanRid;
+			int found = 0;
+			srand(12);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int k = 0; k < numLookups; k++)
+			{
+				int key = rand() % relationSize;
+				index.startScan(&key, GTE, &key, LTE);
+				try
+				{
+					while(1)
+					{
+						index.scanNext(scanRid);
+						found++;
+					}
+				}
+				catch(IndexScanCompletedException e)
+				{
+				}
+				index.endScan();
+			}
+			double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			checkPassFail(found, numLookups)
+			std::cout << "Pool on " << backingNames[arenaBufMgr.poolBacking()] << ": "
+				<< (long) (numLookups / secs) << " lookups/sec" << std::endl;
+		}
+		File::remove(intIndexName);
+	}
+
+	deleteRelation();
+	printf("passed bufferArena()\n");
+}
+
+void test13()
+{
+	// Pages written and read back with direct I/O, through the buffer pool and by threads
+	// writing neighbouring pages at once, once in the working directory and once on tmpfs.
+	// Where a filesystem refuses O_DIRECT the files stay buffered and must work the same.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "directIO" << std::endl;
+	const char* dirs[] = {"", "/dev/shm/"};
+	const int numPages = 100;
+	const int numThreads = 4;
+
+	for (int d = 0; d < 2; d++)
+	{
+		const std::string directName = dirs[d] + relationName + ".direct";
+		const std::string blobName = dirs[d] + relationName + ".blob";
+		try
+		{
+			File::remove(directName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		try
+		{
+			File::remove(blobName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+
+		{
+			PageFile directFile = PageFile::create(directName);
+			bool direct = directFile.setDirectIO(true);
+			checkPassFail(directFile.directIO(), direct)
+			std::cout << directName << ": " << (direct ? "direct I/O" : "no O_DIRECT, buffered") << std::endl;
+
+			bool pooledIntact = true;
+			{
+				BufMgr directBufMgr(16);
+				for (int k = 0; k < numPages; k++)
+				{
+					PageId pageNo;
+					Page* page;
+					directBufMgr.allocPage(&directFile, pageNo, page);
+					sprintf(record1.s, "%05d page version 0", pageNo);
+					page->insertRecord(std::string(record1.s, sizeof(record1.s)));
+					directBufMgr.unPinPage(&directFile, pageNo, true);
+				}
+				for (PageId pageNo = 1; pageNo <= (PageId) numPages; pageNo++)
+				{
+					Page* page;
+					directBufMgr.readPage(&directFile, pageNo, page);
+					if (!pageHolds(*page, pageNo, 0))
+						pooledIntact = false;
+					sprintf(record1.s, "%05d page version 1", pageNo);
+					page->updateRecord(RecordId {pageNo, 1}, std::string(record1.s, sizeof(record1.s)));
+					directBufMgr.unPinPage(&directFile, pageNo, true);
+				}
+				directBufMgr.flushFile(&directFile);
+			}
+			checkPassFail(pooledIntact, true)
+
+			// neighbouring pages written at once must not lose each other's writes
+			std::vector<std::thread> writers;
+			for (int t = 0; t < numThreads; t++)
+			{
+				writers.push_back(std::thread([&directFile, t, numPages, numThreads]() {
+					for (PageId pageNo = t + 1; pageNo <= (PageId) numPages; pageNo += numThreads)
+					{
+						Page page = directFile.readPage(pageNo);
+						char buf[sizeof(record1.s)];
+						sprintf(buf, "%05d page version 2", pageNo);
+						page.updateRecord(RecordId {pageNo, 1}, std::string(buf, sizeof(buf)));
+						directFile.writePage(pageNo, page);
+					}
+				}));
+			}
+			for (int t = 0; t < numThreads; t++)
+				writers[t].join();
+
+			// read back through the page cache
+			directFile.setDirectIO(false);
+			int numUsed = 0;
+			bool intact = true;
+			for (FileIterator iter = directFile.begin(); iter != directFile.end(); ++iter)
+			{
+				numUsed++;
+				if (!pageHolds(*iter, (*iter).page_number(), 2))
+					intact = false;
+			}
+			checkPassFail(numUsed, numPages)
+			checkPassFail(intact, true)
+
+			BlobFile blobFile = BlobFile::create(blobName);
+			blobFile.setDirectIO(true);
+			Page blob;
+			std::vector<PageId> blobPages(numPages);
+			for (int k = 0; k < numPages; k++)
+			{
+				blobFile.allocatePage(blobPages[k]);
+				std::fill_n(reinterpret_cast<char*>(&blob), sizeof(blob), (char) k);
+				blobFile.writePage(blobPages[k], blob);
+			}
+			bool blobsIntact = true;
+			for (int k = 0; k < numPages; k++)
+			{
+				Page read = blobFile.readPage(blobPages[k]);
+				std::fill_n(reinterpret_cast<char*>(&blob), sizeof(blob), (char) k);
+				if (memcmp(&read, &blob, sizeof(blob)) != 0)
+					blobsIntact = false;
+			}
+			checkPassFail(blobsIntact, true)
+
+			// block aligned pages, as pool frames are, skip the bounce buffer both ways
+			void* mem = NULL;
+			checkPassFail(posix_memalign(&mem, 4096, numPages * sizeof(Page)), 0)
+			Page* alignedPages = static_cast<Page*>(mem);
+			for (int k = 0; k < numPages; k++)
+				std::fill_n(reinterpret_cast<char*>(&alignedPages[k]), sizeof(Page), (char) (k + 1));
+			blobFile.writePages(blobPages[0], numPages, alignedPages);
+			std::fill_n(reinterpret_cast<char*>(alignedPages), numPages * sizeof(Page), (char) 0);
+			blobFile.readPages(blobPages[0], numPages, alignedPages);
+			bool alignedIntact = true;
+			for (int k = 0; k < numPages; k++)
+			{
+				std::fill_n(reinterpret_cast<char*>(&blob), sizeof(blob), (char) (k + 1));
+				if (memcmp(&alignedPages[k], &blob, sizeof(blob)) != 0)
+					alignedIntact = false;
+			}
+			checkPassFail(alignedIntact, true)
+			// an aligned read running past the end of the file still stops there
+			bool pastEnd = false;
+			try
+			{
+				blobFile.readPages(blobPages[1], numPages, alignedPages);
+			}
+			catch(InvalidPageException e)
+			{
+				pastEnd = true;
+			}
+			checkPassFail(pastEnd, true)
+			free(mem);
+		}
+		File::remove(directName);
+		File::remove(blobName);
+	}
+	printf("passed directIO()\n");
+}
+
+void test14()
+{
+	// Trace an index build and a scan, then read the trace back: every page pinned by
+	// readPage() or allocPage() has to be unpinned again, and both files are named.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "accessTrace" << std::endl;
+	const std::string traceName = relationName + ".trace";
+	createRelationForward();
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BufMgr traceBufMgr(100);
+		traceBufMgr.startTrace(traceName);
+		{
+			BTreeIndex index(relationName, intIndexName, &traceBufMgr, offsetof(tuple,i), INTEGER);
+			checkPassFail(intScan(&index,25,GT,40,LT), 14)
+		}
+		traceBufMgr.stopTrace();
+	}
+
+	int reads = 0, allocs = 0, unpins = 0;
+	std::size_t numFiles;
+	bool named;
+	{
+		BufTraceReader reader(traceName);
+		TraceRecord rec;
+		while (reader.next(rec))
+		{
+			if (rec.op == TRACE_READ)
+				reads++;
+			else if (rec.op == TRACE_ALLOC)
+				allocs++;
+			else if (rec.op == TRACE_UNPIN)
+				unpins++;
+		}
+		// the index file is created, and named, before the relation is scanned
+		numFiles = reader.numFiles();
+		named = numFiles == 2 && reader.fileName(0) == intIndexName && reader.fileName(1) == relationName;
+	}
+	std::cout << "Traced " << reads << " reads, " << allocs << " allocs, " << unpins << " unpins" << std::endl;
+	checkPassFail(reads + allocs, unpins)
+	checkPassFail(named, true)
+
+	File::remove(traceName);
+	File::remove(intIndexName);
+	deleteRelation();
+	printf("passed accessTrace()\n");
+}
+
+void test15()
+{
+	// Scan a relation of a million records through FileScan, once copying every record
+	// and once viewing it in place on the pinned page, and sum the keys both ways.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "recordViews" << std::endl;
+	const int numRecords = 1000000;
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile relation = PageFile::create(relationName);
+		memset(record1.s, ' ', sizeof(record1.s));
+		FileAppender appender(&relation);
+		for (int i = 0; i < numRecords; i++)
+		{
+			sprintf(record1.s, "%07d string record", i);
+			record1.i = i;
+			record1.d = (double)i;
+			appender.append(std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+		}
+		appender.flush();
+	}
+
+	long long sums[2] = {0, 0};
+	int counts[2] = {0, 0};
+	for (int inPlace = 0; inPlace < 2; inPlace++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			FileScan scan(relationName, bufMgr);
+			try
+			{
+				RecordId scanRid;
+				while (1)
+				{
+					scan.scanNext(scanRid);
+					if (inPlace)
+					{
+						RecordView view = scan.viewRecord();
+						sums[inPlace] += reinterpret_cast<const RECORD*>(view.data())->i;
+					}
+					else
+					{
+						std::string copy = scan.getRecord();
+						sums[inPlace] += reinterpret_cast<const RECORD*>(copy.data())->i;
+					}
+					counts[inPlace]++;
+				}
+			}
+			catch(EndOfFileException e)
+			{
+			}
+		}
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << (inPlace ? "Viewed in place: " : "Copied: ") << (long) (counts[inPlace] / secs) << " records/sec" << std::endl;
+	}
+	checkPassFail(counts[0], numRecords)
+	checkPassFail(counts[1], numRecords)
+	bool sameSums = sums[0] == sums[1] && sums[1] == (long long) numRecords * (numRecords - 1) / 2;
+	checkPassFail(sameSums, true)
+
+	File::remove(relationName);
+	printf("passed recordViews()\n");
+}
+
+void test16()
+{
+	// Delete-heavy churn on one page: bursts of random records are deleted and the page is
+	// refilled with records of random length, once compacting on every delete and once
+	// lazily. Both runs make the same calls and must end up with the same records.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "pageChurn" << std::endl;
+	const int numOps = 200000;
+	int numRecords[2];
+	bool intact[2];
+	for (int lazy = 0; lazy < 2; lazy++)
 	{
-		std::cout << "Expects one argument as a number between 1 to 3 to choose datatype of key.\n";
-		std::cout << "For INTEGER keys run as: ./badgerdb_main 1\n";
-		std::cout << "For DOUBLE keys run as: ./badgerdb_main 2\n";
-		std::cout << "For STRING keys run as: ./badgerdb_main 3\n";
-		return 0;
+		Page page;
+		page.setLazyCompaction(lazy == 1);
+		std::vector<RecordId> rids;
+		std::vector<std::string> records;
+		std::uint16_t maxFragmented = 0;
+		std::srand(1);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int op = 0; op < numOps; )
+		{
+			for (int burst = 1 + std::rand() % 16; burst > 0 && !rids.empty(); burst--, op++)
+			{
+				std::size_t k = std::rand() % rids.size();
+				page.deleteRecord(rids[k]);
+				rids[k] = rids.back();
+				rids.pop_back();
+				records[k] = records.back();
+				records.pop_back();
+			}
+			if (page.getFragmentedSpace() > maxFragmented)
+				maxFragmented = page.getFragmentedSpace();
+			while (1)
+			{
+				std::string data(8 + std::rand() % 120, (char) ('a' + op % 26));
+				if (!page.hasSpaceForRecord(data))
+					break;
+				rids.push_back(page.insertRecord(data));
+				records.push_back(data);
+			}
+		}
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << (lazy ? "Lazy compaction: " : "Compaction on delete: ") << (long) (numOps / secs)
+			<< " deletes/sec, up to " << maxFragmented << " bytes fragmented" << std::endl;
+
+		// compacting keeps the record ids and the free space
+		const std::uint16_t freeSpace = page.getFreeSpace();
+		page.compact();
+		intact[lazy] = page.getFreeSpace() == freeSpace && page.getFragmentedSpace() == 0
+			&& (maxFragmented > 0) == (lazy == 1);
+		for (std::size_t k = 0; k < rids.size(); k++)
+			if (page.getRecord(rids[k]) != records[k])
+				intact[lazy] = false;
+		numRecords[lazy] = rids.size();
 	}
+	checkPassFail(intact[0], true)
+	checkPassFail(intact[1], true)
+	checkPassFail(numRecords[1], numRecords[0])
+	printf("passed pageChurn()\n");
+}
 
-	sscanf(argv[1],"%d",&testNum);
+void test17()
+{
+	// Load relations record by record, catching InsufficientSpaceException for every full
+	// page as the createRelation functions do, and through FileAppender. Records appended
+	// to an existing relation, also after a flush, have to follow its records in a scan,
+	// and pages the appender hands to a buffer manager have to be read without disk reads.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "bulkLoad" << std::endl;
+	const int slowRecords = 50000;
+	const int numRecords = 600000;
 
-	switch(testNum)
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 	{
-		case 1:
-			std::cout << "leaf size:" << INTARRAYLEAFSIZE << " non-leaf size:" << INTARRAYNONLEAFSIZE << std::endl;
-			break;
-		case 2:
-			std::cout << "leaf size:" << DOUBLEARRAYLEAFSIZE << " non-leaf size:" << DOUBLEARRAYNONLEAFSIZE << std::endl;
-			break;
-		case 3:
-			std::cout << "leaf size:" << STRINGARRAYLEAFSIZE << " non-leaf size:" << STRINGARRAYNONLEAFSIZE << std::endl;
-			break;
+		try
+		{
+			File::remove(relationName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		PageFile relation = PageFile::create(relationName);
+		memset(record1.s, ' ', sizeof(record1.s));
+		PageId pageNo;
+		Page page = relation.allocatePage(pageNo);
+		for (int i = 0; i < slowRecords; i++)
+		{
+			sprintf(record1.s, "%05d string record", i);
+			record1.i = i;
+			record1.d = (double)i;
+			std::string data(reinterpret_cast<char*>(&record1), sizeof(record1));
+			try
+			{
+				page.insertRecord(data);
+			}
+			catch(InsufficientSpaceException e)
+			{
+				relation.writePage(pageNo, page);
+				page = relation.allocatePage(pageNo);
+				page.insertRecord(data);
+			}
+		}
+		relation.writePage(pageNo, page);
 	}
+	double slowSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	File::remove(relationName);
 
+	start = std::chrono::steady_clock::now();
+	createRelationAlot();
+	double bulkSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "insertRecord and allocatePage: " << (long) (slowRecords / slowSecs) << " records/sec" << std::endl;
+	std::cout << "FileAppender: " << (long) (numRecords / bulkSecs) << " records/sec" << std::endl;
 
-  // Clean up from any previous runs that crashed.
-  try
-	{
-    File::remove(relationName);
-  }
-	catch(FileNotFoundException)
+	int count = 0;
+	bool inOrder = true;
 	{
-  }
+		FileScan scan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while (1)
+			{
+				scan.scanNext(scanRid);
+				if (reinterpret_cast<const RECORD*>(scan.viewRecord().data())->i != count)
+					inOrder = false;
+				count++;
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+	}
+	checkPassFail(count, numRecords)
+	checkPassFail(inOrder, true)
+	deleteRelation();
 
+	// append behind relationSize records placed by allocatePage()
+	createRelationForward();
+	bool cached;
 	{
-		// Create a new database file.
-		PageFile new_file = PageFile::create(relationName);
-
-		// Allocate some pages and put data on them.
-		for (int i = 0; i < 20; ++i)
+		BufMgr cacheBufMgr(100);
 		{
-			PageId new_page_number;
-			Page new_page = new_file.allocatePage(new_page_number);
-
-    	sprintf(record1.s, "%05d string record", i);
-    	record1.i = i;
-    	record1.d = (double)i;
-    	std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
-
-			new_page.insertRecord(new_data);
-			new_file.writePage(new_page_number, new_page);
+			FileAppender appender(file1, &cacheBufMgr, NORMAL_ACCESS);
+			std::vector<std::string> records;
+			for (int i = relationSize; i < 2 * relationSize; i++)
+			{
+				sprintf(record1.s, "%05d string record", i);
+				record1.i = i;
+				record1.d = (double)i;
+				records.push_back(std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+			}
+			appender.append(records);
+			appender.flush();
+			// the page flushed last gets a successor
+			record1.i = 2 * relationSize;
+			RecordId last = appender.append(std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+			appender.flush();
+
+			Page* page;
+			const int diskReads = cacheBufMgr.getBufStats().diskreads;
+			cacheBufMgr.readPage(file1, last.page_number, page);
+			cached = cacheBufMgr.getBufStats().diskreads == diskReads
+				&& reinterpret_cast<const RECORD*>(page->viewRecord(last).data())->i == 2 * relationSize;
+			cacheBufMgr.unPinPage(file1, last.page_number, false);
 		}
-
+		cacheBufMgr.flushFile(file1);
 	}
-	// new_file goes out of scope here, so file is automatically closed.
+	checkPassFail(cached, true)
 
+	count = 0;
+	inOrder = true;
 	{
-		FileScan fscan(relationName, bufMgr);
-
+		FileScan scan(relationName, bufMgr);
 		try
 		{
 			RecordId scanRid;
-			while(1)
+			while (1)
 			{
-				fscan.scanNext(scanRid);
-				//Assuming RECORD.i is our key, lets extract the key, which we know is INTEGER and whose byte offset is also know inside the record. 
-				std::string recordStr = fscan.getRecord();
-				const char *record = recordStr.c_str();
-				int key = *((int *)(record + offsetof (RECORD, i)));
-				std::cout << "Extracted : " << key << std::endl;
+				scan.scanNext(scanRid);
+				if (reinterpret_cast<const RECORD*>(scan.viewRecord().data())->i != count)
+					inOrder = false;
+				count++;
 			}
 		}
 		catch(EndOfFileException e)
 		{
-			std::cout << "Read all records" << std::endl;
 		}
 	}
-	// filescan goes out of scope here, so relation file gets closed.
+	checkPassFail(count, 2 * relationSize + 1)
+	checkPassFail(inOrder, true)
+	deleteRelation();
 
+	// pages deleted while appending stay free, and a record too big for any page leaves
+	// no empty page behind
+	{
+		try
+		{
+			File::remove(relationName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		PageFile relation = PageFile::create(relationName);
+		PageId pageNo;
+		for (int k = 0; k < 3; k++)
+			relation.allocatePage(pageNo);
+		bool tooBig = false;
+		{
+			FileAppender appender(&relation);
+			relation.deletePage(2);
+			try
+			{
+				appender.append(std::string(Page::SIZE, 'x'));
+			}
+			catch(InsufficientSpaceException e)
+			{
+				tooBig = true;
+			}
+			appender.flush();
+			appender.append(std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+		}
+		checkPassFail(tooBig, true)
+		relation.allocatePage(pageNo);
+		checkPassFail(pageNo, 2)
+		relation.allocatePage(pageNo);
+		checkPassFail(pageNo, 5)
+	}
 	File::remove(relationName);
-	if (testNum == 6){
-		createRelationForward();
-		BTreeIndex index1(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
-		deleteRelation();
-		createRelationForward();
-		BTreeIndex index2(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE);
-		deleteRelation();
-		createRelationForward();
-		BTreeIndex index3(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
-		deleteRelation();
-		printf("all 3 indexes has been created\n");
-		return 1 ;
+
+	// the page filled up by a record too big for any page ends the used page list
+	{
+		PageFile relation = PageFile::create(relationName);
+		FileAppender appender(&relation);
+		RecordId first = appender.append(std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+		bool tooBig = false;
+		try
+		{
+			appender.append(std::string(Page::SIZE, 'x'));
+		}
+		catch(InsufficientSpaceException e)
+		{
+			tooBig = true;
+		}
+		appender.flush();
+		checkPassFail(tooBig, true)
+		checkPassFail(relation.readPage(first.page_number).next_page_number(), Page::INVALID_NUMBER)
+		RecordId second = appender.append(std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+		appender.flush();
+		checkPassFail(relation.readPage(first.page_number).next_page_number(), second.page_number)
+		int numUsed = 0;
+		for (FileIterator iter = relation.begin(); iter != relation.end(); ++iter)
+			numUsed++;
+		checkPassFail(numUsed, 2)
 	}
-	
-	test1();
-	test2();
-	test3();
-	//test7(); // insert a lot of entries 600000
-	errorTests();
+	File::remove(relationName);
+	printf("passed bulkLoad()\n");
+}
 
-	printf("PASSED ALL TESTS\n");
+void test18()
+{
+	// Allocate and delete pages of a file, then walk it with a FileIterator, which finds
+	// the next used page in the map of used pages, and along the next page pointers on
+	// disk; both must give the used pages in order. The map written when the file is
+	// closed is loaded when it is opened again, and rebuilt if it has been overwritten.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "pageMap" << std::endl;
+	const std::string mapName = relationName + ".map";
+	const int numPages = 20000;
+	try
+	{
+		File::remove(mapName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
 
-  return 1;
+	std::vector<PageId> expected;
+	{
+		PageFile mapFile = PageFile::create(mapName);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		PageId pageNo;
+		for (int k = 0; k < numPages; k++)
+			mapFile.allocatePage(pageNo);
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "allocatePage: " << (long) (numPages / secs) << " pages/sec" << std::endl;
+
+		// free every third page, then take some of them back, from the start of the file on
+		for (PageId p = 3; p <= (PageId) numPages; p += 3)
+			mapFile.deletePage(p);
+		for (int k = 0; k < 1000; k++)
+			mapFile.allocatePage(pageNo);
+		mapFile.deletePage(1);
+		for (PageId p = 1; p <= (PageId) numPages; p++)
+		{
+			if (p != 1 && (p % 3 != 0 || p <= 3000))
+				expected.push_back(p);
+		}
+
+		start = std::chrono::steady_clock::now();
+		std::vector<PageId> iterated;
+		for (FileIterator iter = mapFile.begin(); iter != mapFile.end(); ++iter)
+			iterated.push_back(iter.page_number());
+		secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "FileIterator: " << (long) (iterated.size() / secs) << " pages/sec" << std::endl;
+		bool iteratedInOrder = iterated == expected;
+		checkPassFail(iteratedInOrder, true)
+
+		std::vector<PageId> chained;
+		for (PageId p = mapFile.getFirstPageNo(); p != Page::INVALID_NUMBER; p = mapFile.readPage(p).next_page_number())
+			chained.push_back(p);
+		bool chainedInOrder = chained == expected;
+		checkPassFail(chainedInOrder, true)
+	}
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		if (pass == 1)
+		{
+			// the map is the last page of the file
+			std::FILE* raw = std::fopen(mapName.c_str(), "r+b");
+			std::fseek(raw, -(long) Page::SIZE, SEEK_END);
+			std::vector<char> zeros(Page::SIZE, 0);
+			std::fwrite(&zeros[0], 1, zeros.size(), raw);
+			std::fclose(raw);
+		}
+		PageFile mapFile = PageFile::open(mapName);
+		std::vector<PageId> iterated;
+		for (FileIterator iter = mapFile.begin(); iter != mapFile.end(); ++iter)
+			iterated.push_back(iter.page_number());
+		bool reopened = iterated == expected;
+		checkPassFail(reopened, true)
+
+		PageId pageNo;
+		mapFile.allocatePage(pageNo);
+		checkPassFail(pageNo, 1)
+		mapFile.deletePage(pageNo);
+	}
+	File::remove(mapName);
+
+	// A process that dies after allocating pages leaves them on disk with the header and
+	// map of the last sync. Taking back free pages only must be noticed in their headers,
+	// growing the file overwrites the stored map; either way the file must be usable.
+	for (int grow = 0; grow < 2; grow++)
+	{
+		{
+			PageFile mapFile = PageFile::create(mapName);
+			PageId pageNo;
+			for (int k = 0; k < 10; k++)
+				mapFile.allocatePage(pageNo);
+			mapFile.deletePage(2);
+			mapFile.deletePage(5);
+			mapFile.deletePage(8);
+			mapFile.sync();
+			pid_t child = fork();
+			if (child == 0)
+			{
+				for (int k = 0; k < 2 + 2 * grow; k++)
+					mapFile.allocatePage(pageNo);
+				_exit(0);
+			}
+			waitpid(child, NULL, 0);
+		}
+		std::vector<PageId> iterated;
+		std::vector<PageId> chained;
+		{
+			PageFile mapFile = PageFile::open(mapName);
+			PageId pageNo;
+			mapFile.allocatePage(pageNo);
+			mapFile.deletePage(pageNo);
+			mapFile.allocatePage(pageNo);
+
+			for (FileIterator iter = mapFile.begin(); iter != mapFile.end(); ++iter)
+				iterated.push_back(iter.page_number());
+			for (PageId p = mapFile.getFirstPageNo(); p != Page::INVALID_NUMBER; p = mapFile.readPage(p).next_page_number())
+				chained.push_back(p);
+		}
+		File::remove(mapName);
+		// the pages the child reused survive, the one it appended is dropped
+		int numUsed = (int) iterated.size();
+		checkPassFail(numUsed, 10 - 3 + 2 + grow + 1)
+		bool recovered = chained == iterated;
+		checkPassFail(recovered, true)
+	}
+	printf("passed pageMap()\n");
 }
 
-void test1()
+void test19()
 {
-	// Create a relation with tuples valued 0 to relationSize and perform index tests 
-	// on attributes of all three types (int, double, string)
-	std::cout << "---------------------" << std::endl;
-	std::cout << "createRelationForward" << std::endl;
-	createRelationForward();
-	indexTests();
-	deleteRelation();
-	printf("passed createRelationForward()\n");
+	// Churn a file and allocate pages one after the other: they must be handed out in page
+	// order, and a page allocated near another must land in the first free page behind it.
+	// Defragmenting the file renumbers its used pages 1, 2, ... in list order with their
+	// records, and refuses while the file is open.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "extents" << std::endl;
+	const std::string extName = relationName + ".ext";
+	const int numPages = 2000;
+	try
+	{
+		File::remove(extName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	std::vector<PageId> used;
+	{
+		PageFile extFile = PageFile::create(extName);
+		PageId pageNo;
+		for (int k = 0; k < numPages; k++)
+			extFile.allocatePage(pageNo);
+		struct stat st;
+		stat(extName.c_str(), &st);
+		std::cout << "Disk space of " << numPages << " pages: " << (st.st_blocks * 512 / Page::SIZE)
+			<< " pages" << std::endl;
+
+		for (PageId p = 5; p <= (PageId) numPages; p += 5)
+			extFile.deletePage(p);
+		bool ascending = true;
+		PageId last = Page::INVALID_NUMBER;
+		for (int k = 0; k < numPages / 10; k++)
+		{
+			extFile.allocatePage(pageNo);
+			if (pageNo <= last)
+				ascending = false;
+			last = pageNo;
+		}
+		checkPassFail(ascending, true)
+
+		extFile.deletePage(1003);
+		extFile.deletePage(1004);
+		extFile.allocatePage(pageNo, 999);
+		checkPassFail(pageNo, 1003)
+		extFile.allocatePage(pageNo, 1003);
+		checkPassFail(pageNo, 1004)
+		// 2000 is free, 2001 is past the end
+		extFile.allocatePage(pageNo, 1996);
+		checkPassFail(pageNo, 2000)
+		extFile.allocatePage(pageNo, 1996);
+		checkPassFail(pageNo, 2001)
+
+		// scatter the file again and tag every used page with its number
+		for (PageId p = 4; p <= (PageId) numPages; p += 4)
+		{
+			if (p % 5 != 0)
+				extFile.deletePage(p);
+		}
+		for (FileIterator iter = extFile.begin(); iter != extFile.end(); ++iter)
+		{
+			Page page = *iter;
+			sprintf(record1.s, "%05d page", (int) iter.page_number());
+			page.insertRecord(std::string(record1.s, sizeof(record1.s)));
+			extFile.writePage(iter.page_number(), page);
+			used.push_back(iter.page_number());
+		}
+
+		bool refused = false;
+		try
+		{
+			PageFile::defragment(extName);
+		}
+		catch(FileOpenException e)
+		{
+			refused = true;
+		}
+		checkPassFail(refused, true)
+	}
+
+	const std::string directName = extName + ".direct";
+	{
+		// direct writes trim the file back to its size, which must not give up the extent
+		PageFile directFile = PageFile::create(directName);
+		PageId pageNo;
+		directFile.allocatePage(pageNo);
+		struct stat st;
+		stat(directName.c_str(), &st);
+		const bool reserved = st.st_blocks * 512 >= (off_t) (File::EXTENT_PAGES * Page::SIZE);
+		if (directFile.setDirectIO(true) && reserved)
+		{
+			for (int k = 0; k < 10; k++)
+				directFile.allocatePage(pageNo);
+			stat(directName.c_str(), &st);
+			const bool stillReserved = st.st_blocks * 512 >= (off_t) (File::EXTENT_PAGES * Page::SIZE);
+			checkPassFail(stillReserved, true)
+		}
+	}
+	File::remove(directName);
+
+	std::vector<PageId> newNumbers = PageFile::defragment(extName);
+	bool renumbered = true;
+	for (std::size_t i = 0; i < used.size(); i++)
+	{
+		if (newNumbers[used[i]] != (PageId) (i + 1))
+			renumbered = false;
+	}
+	checkPassFail(renumbered, true)
+
+	{
+		PageFile extFile = PageFile::open(extName);
+		std::size_t numUsed = 0;
+		bool intact = true;
+		for (FileIterator iter = extFile.begin(); iter != extFile.end(); ++iter)
+		{
+			Page page = *iter;
+			sprintf(record1.s, "%05d page", (int) (numUsed < used.size() ? used[numUsed] : 0));
+			if (iter.page_number() != numUsed + 1 ||
+					page.getRecord(RecordId {iter.page_number(), 1}) != std::string(record1.s, sizeof(record1.s)))
+				intact = false;
+			numUsed++;
+		}
+		checkPassFail(numUsed, used.size())
+		checkPassFail(intact, true)
+
+		// new pages go on behind the last one
+		PageId pageNo;
+		extFile.allocatePage(pageNo);
+		checkPassFail(pageNo, used.size() + 1)
+	}
+	std::cout << "Defragmented " << used.size() << " pages out of " << numPages + 1 << std::endl;
+	File::remove(extName);
+	printf("passed extents()\n");
 }
 
-void test2()
+bool pageHolds(const Page& page, const PageId pageNo, const int version)
 {
-	// Create a relation with tuples valued 0 to relationSize in reverse order and perform index tests 
-	// on attributes of all three types (int, double, string)
-	std::cout << "----------------------" << std::endl;
-	std::cout << "createRelationBackward" << std::endl;
-	createRelationBackward();
-	indexTests();
-	deleteRelation();
-	printf("passed createRelationBackward()\n");
+	char expected[sizeof(record1.s)];
+	sprintf(expected, "%05d page version %d", pageNo, version);
+	RecordId rid = {pageNo, 1};
+	return page.getRecord(rid).compare(0, strlen(expected), expected) == 0;
 }
 
-void test3()
+// -----------------------------------------------------------------------------
+// indexPassReads
+// -----------------------------------------------------------------------------
+
+int indexPassReads(BTreeIndex *index, BufMgr *mgr)
 {
-	// Create a relation with tuples valued 0 to relationSize in random order and perform index tests 
-	// on attributes of all three types (int, double, string)
-	std::cout << "--------------------" << std::endl;
-	std::cout << "createRelationRandom" << std::endl;
-	createRelationRandom();
-	indexTests();
-	deleteRelation();
-	printf("passed createRelationRandom()\n");
+	// Walk every leaf of the index and return the number of pages read from disk doing so
+	int lowVal = 0, highVal = relationSize;
+	RecordId scanRid;
+
+	mgr->clearBufStats();
+	index->startScan(&lowVal, GTE, &highVal, LT);
+	try
+	{
+		while(1)
+			index->scanNext(scanRid);
+	}
+	catch(IndexScanCompletedException e)
+	{
+	}
+	index->endScan();
+	return mgr->getBufStats().diskreads;
 }
 
 void test7(){
@@ -422,7 +1896,6 @@ void createRelationRandom()
 
 void createRelationAlot()
 {
-	std::vector<RecordId> ridVec;
   // destroy any old copies of relation file
 	try
 	{
@@ -436,33 +1909,24 @@ void createRelationAlot()
 
   // initialize all of record1.s to keep purify happy
   memset(record1.s, ' ', sizeof(record1.s));
-	PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
 
-  // Insert 600000 tuples into the relation.
+  // Insert 600000 tuples into the relation, handing them to the appender in batches.
+  FileAppender appender(file1);
+  std::vector<std::string> records;
   for(int i = 0; i < 600000; i++ )
 	{
     sprintf(record1.s, "%05d string record", i);
     record1.i = i;
     record1.d = (double)i;
-    std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
-
-		while(1)
-		{
-			try
-			{
-    		new_page.insertRecord(new_data);
-				break;
-			}
-			catch(InsufficientSpaceException e)
-			{
-				file1->writePage(new_page_number, new_page);
-  			new_page = file1->allocatePage(new_page_number);
-			}
-		}
+    records.push_back(std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+    if (records.size() == 1000)
+    {
+      appender.append(records);
+      records.clear();
+    }
   }
-
-	file1->writePage(new_page_number, new_page);
+  appender.append(records);
+  appender.flush();
 }
 
 
@@ -27,6 +27,8 @@ void Page::initialize() {
   header_.free_space_upper_bound = DATA_SIZE;
   header_.num_slots = 0;
   header_.num_free_slots = 0;
+  header_.fragmented_bytes = 0;
+  header_.flags = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
   //data_.assign(DATA_SIZE, char());
@@ -38,17 +40,24 @@ RecordId Page::insertRecord(const std::string& record_data) {
     throw InsufficientSpaceException(
         page_number(), record_data.length(), getFreeSpace());
   }
+  // a new slot takes room from the free space as well, which must be contiguous
+  if (header_.num_free_slots == 0 &&
+      getContiguousFreeSpace() < record_data.length() + sizeof(PageSlot)) {
+    compact();
+  }
   const SlotId slot_number = getAvailableSlot();
   insertRecordInSlot(slot_number, record_data);
   return {page_number(), slot_number};
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  return viewRecord(record_id).str();
+}
+
+RecordView Page::viewRecord(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
-
-	return retStr;
+  return RecordView(&data_[slot.item_offset], slot.item_length);
 }
 
 void Page::updateRecord(const RecordId& record_id,
@@ -77,36 +86,28 @@ void Page::deleteRecord(const RecordId& record_id,
   validateRecordId(record_id);
   PageSlot* slot = getSlot(record_id.slot_number);
 
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = '\0';
-
-  //data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset; 
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
+  const std::uint16_t upper_bound = header_.free_space_upper_bound;
+  if (slot->item_offset == upper_bound) {
+    // The record is the first one after the free space, which simply grows.
+    memset(&data_[upper_bound], '\0', slot->item_length);
+    header_.free_space_upper_bound += slot->item_length;
+  } else if (lazyCompaction()) {
+    // Leave the hole to a later compaction.
+    header_.fragmented_bytes += slot->item_length;
+  } else {
+    // Compact the data by shifting the records before the hole to the right.
+    // An eagerly compacted page has no other holes, so they are contiguous.
+    memmove(&data_[upper_bound + slot->item_length], &data_[upper_bound],
+            slot->item_offset - upper_bound);
+    memset(&data_[upper_bound], '\0', slot->item_length);
+    for (SlotId i = 1; i <= header_.num_slots; ++i) {
+      PageSlot* other_slot = getSlot(i);
+      if (other_slot->used && other_slot->item_offset < slot->item_offset) {
+        other_slot->item_offset += slot->item_length;
       }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
     }
+    header_.free_space_upper_bound += slot->item_length;
   }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
-
-		for(std::uint16_t i = 0; i < move_bytes; i++)
-			data_[i + move_offset + slot->item_length] = data_to_move[i];
-
-    //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
-  }
-  header_.free_space_upper_bound += slot->item_length;
 
   // Mark slot as unused.
   slot->used = false;
@@ -135,6 +136,79 @@ void Page::deleteRecord(const RecordId& record_id,
   }
 }
 
+void Page::setLazyCompaction(const bool lazy) {
+  if (lazy) {
+    header_.flags |= LAZY_COMPACTION;
+  } else {
+    compact();
+    header_.flags &= ~LAZY_COMPACTION;
+  }
+}
+
+void Page::compact() {
+  if (header_.fragmented_bytes == 0) {
+    return;
+  }
+  // Pack the records into a scratch area in slot order, then copy them back in
+  // one block against the end of the page.
+  char packed[DATA_SIZE];
+  std::uint16_t next_offset = DATA_SIZE;
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    PageSlot* slot = getSlot(i);
+    if (slot->used) {
+      next_offset -= slot->item_length;
+      memcpy(&packed[next_offset], &data_[slot->item_offset], slot->item_length);
+      slot->item_offset = next_offset;
+    }
+  }
+  memcpy(&data_[next_offset], &packed[next_offset], DATA_SIZE - next_offset);
+  memset(&data_[header_.free_space_upper_bound], '\0',
+         next_offset - header_.free_space_upper_bound);
+  header_.free_space_upper_bound = next_offset;
+  header_.fragmented_bytes = 0;
+}
+
+std::size_t Page::insertRecords(const std::vector<std::string>& records,
+                                const std::size_t first,
+                                std::vector<RecordId>* record_ids) {
+  // Gather all free space once, then place the records one after the other,
+  // reusing free slots in order before growing the slot array.
+  compact();
+  SlotId free_slot = 1;
+  std::size_t k = first;
+  for (; k < records.size(); ++k) {
+    const std::size_t record_length = records[k].length();
+    SlotId slot_number;
+    if (header_.num_free_slots > 0) {
+      if (record_length > getContiguousFreeSpace()) {
+        break;
+      }
+      while (getSlot(free_slot)->used) {
+        ++free_slot;
+      }
+      slot_number = free_slot;
+      --header_.num_free_slots;
+    } else {
+      if (record_length + sizeof(PageSlot) > getContiguousFreeSpace()) {
+        break;
+      }
+      slot_number = ++header_.num_slots;
+      header_.free_space_lower_bound += sizeof(PageSlot);
+    }
+    PageSlot* slot = getSlot(slot_number);
+    slot->used = true;
+    slot->item_length = record_length;
+    slot->item_offset = header_.free_space_upper_bound - record_length;
+    header_.free_space_upper_bound = slot->item_offset;
+    memcpy(&data_[slot->item_offset], records[k].data(), record_length);
+    if (record_ids != NULL) {
+      const RecordId record_id = {page_number(), slot_number};
+      record_ids->push_back(record_id);
+    }
+  }
+  return k - first;
+}
+
 bool Page::hasSpaceForRecord(const std::string& record_data) const {
   std::size_t record_size = record_data.length();
   if (header_.num_free_slots == 0) {
@@ -186,16 +260,16 @@ void Page::insertRecordInSlot(const SlotId slot_number,
     throw SlotInUseException(page_number(), slot_number);
   }
   const int record_length = record_data.length();
+  if (getContiguousFreeSpace() < record_length) {
+    compact();
+  }
   slot->used = true;
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
   --header_.num_free_slots;
 
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = record_data[i];
-
-  //data_.replace(slot->item_offset, slot->item_length, record_data);
+  memcpy(&data_[slot->item_offset], record_data.data(), record_length);
 }
 
 void Page::validateRecordId(const RecordId& record_id) const {
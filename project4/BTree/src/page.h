@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <memory>
 #include <string>
+#include <vector>
 
 //#include <gtest/gtest.h>
 #include "types.h"
@@ -48,6 +49,18 @@ struct PageHeader {
    */
   SlotId num_free_slots;
 
+  /**
+   * Number of bytes held by deleted records between the free space upper bound
+   * and the end of the page, not yet reclaimed.  Always 0 unless the page
+   * compacts lazily.
+   */
+  std::uint16_t fragmented_bytes;
+
+  /**
+   * Page flags, see Page::LAZY_COMPACTION.
+   */
+  std::uint16_t flags;
+
   /**
    * Number of the page within the file.
    */
@@ -93,6 +106,74 @@ struct PageSlot {
   std::uint16_t item_length;
 };
 
+/**
+ * @brief Read-only view of a record's bytes where they lie on their page.
+ *
+ * A view does not own or copy the record.  It stays valid as long as the page
+ * it points into is neither changed nor evicted; for a page in the buffer
+ * pool, as long as the page is pinned.
+ */
+class RecordView {
+ public:
+  /**
+   * Constructs an empty view.
+   */
+  RecordView() : data_(NULL), length_(0) {}
+
+  /**
+   * Constructs a view of length bytes starting at data.
+   *
+   * @param data    First byte of the record.
+   * @param length  Length of the record in bytes.
+   */
+  RecordView(const char* data, const std::size_t length)
+      : data_(data), length_(length) {}
+
+  /**
+   * Returns the first byte of the record.
+   *
+   * @return  Pointer to the record's bytes.
+   */
+  const char* data() const { return data_; }
+
+  /**
+   * Returns the length of the record.
+   *
+   * @return  Length in bytes.
+   */
+  std::size_t size() const { return length_; }
+
+  /**
+   * Returns true if the record has no bytes.
+   *
+   * @return  Whether the view is empty.
+   */
+  bool empty() const { return length_ == 0; }
+
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + length_; }
+
+  char operator[](const std::size_t i) const { return data_[i]; }
+
+  /**
+   * Returns a copy of the record.
+   *
+   * @return  The record's bytes.
+   */
+  std::string str() const { return std::string(data_, length_); }
+
+ private:
+  /**
+   * First byte of the record.
+   */
+  const char* data_;
+
+  /**
+   * Length of the record in bytes.
+   */
+  std::size_t length_;
+};
+
 class PageIterator;
 
 /**
@@ -141,6 +222,21 @@ class Page {
    */
   RecordId insertRecord(const std::string& record_data);
 
+  /**
+   * Inserts records, in order, for as long as they fit, starting at
+   * records[first].  Unlike insertRecord, a record that does not fit ends the
+   * insertion instead of raising an exception.
+   *
+   * @param records     Records to insert.
+   * @param first       Index of the first record to insert.
+   * @param record_ids  If not NULL, the IDs of the inserted records are
+   *                    appended to it.
+   * @return  Number of records inserted.
+   */
+  std::size_t insertRecords(const std::vector<std::string>& records,
+                            const std::size_t first = 0,
+                            std::vector<RecordId>* record_ids = NULL);
+
   /**
    * Returns the record with the given ID.  Returned data is a copy of what is
    * stored on the page; use updateRecord to change it.
@@ -151,6 +247,16 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID in place, without copying it.  The
+   * view points into this page and is only good while the page is unchanged.
+   *
+   * @see getRecord
+   * @param record_id  ID of the record to return.
+   * @return  View of the record.
+   */
+  RecordView viewRecord(const RecordId& record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -163,13 +269,37 @@ class Page {
 
   /**
    * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * ensure that data of all records is contiguous, unless the page compacts
+   * lazily.  Slot array is compacted if the slot deleted is at the end of the
+   * slot array.
    *
    * @param record_id   ID of the record to delete.
    */
   void deleteRecord(const RecordId& record_id);
 
+  /**
+   * Sets whether the page compacts lazily.  A lazy page does not move data on
+   * delete; the space of deleted records is counted as fragmented and
+   * reclaimed in one pass when an insert or update needs it.  Turning lazy
+   * compaction off compacts the page.  The setting is stored in the page.
+   *
+   * @param lazy  True to defer compaction.
+   */
+  void setLazyCompaction(const bool lazy);
+
+  /**
+   * Returns whether the page compacts lazily.
+   *
+   * @return  True if compaction is deferred.
+   */
+  bool lazyCompaction() const { return (header_.flags & LAZY_COMPACTION) != 0; }
+
+  /**
+   * Moves all records to the end of the page, reclaiming the space of
+   * deleted records.  Record IDs do not change.
+   */
+  void compact();
+
   /**
    * Returns true if the page has enough free space to hold the given data.
    *
@@ -179,12 +309,20 @@ class Page {
   bool hasSpaceForRecord(const std::string& record_data) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes, including the space of deleted
+   * records a lazy page has not reclaimed yet.
    *
    * @return  Free space in bytes.
    */
-  std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+  std::uint16_t getFreeSpace() const { return getContiguousFreeSpace() +
+                                              header_.fragmented_bytes; }
+
+  /**
+   * Returns the number of bytes of deleted records not reclaimed yet.
+   *
+   * @return  Fragmented space in bytes.
+   */
+  std::uint16_t getFragmentedSpace() const { return header_.fragmented_bytes; }
 
   /**
    * Returns this page's number in its file.
@@ -216,11 +354,25 @@ class Page {
   PageIterator end();
 
  private:
+  /**
+   * Flag set in the header of pages that compact lazily.
+   */
+  static const std::uint16_t LAZY_COMPACTION = 1;
+
   /**
    * Initializes this page as a new page with no header information or data.
    */
   void initialize();
 
+  /**
+   * Returns the free space between the slot array and the first record.
+   *
+   * @return  Contiguous free space in bytes.
+   */
+  std::uint16_t getContiguousFreeSpace() const {
+    return header_.free_space_upper_bound - header_.free_space_lower_bound;
+  }
+
   /**
    * Sets this page's number in its file.
    *
@@ -290,7 +442,8 @@ class Page {
 
   /**
    * Inserts record data into the given slot.  The slot should not be currently
-   * in use.  <slot_number> must be less than <header_.num_slots>.
+   * in use.  <slot_number> must be less than <header_.num_slots>.  The page is
+   * compacted first if the record does not fit in the contiguous free space.
    *
    * Callers are responsible for making sure there is enough space to hold the
    * record before calling this method.
@@ -337,6 +490,7 @@ class Page {
   friend class PageFile;
   friend class BlobFile;
   friend class PageIterator;
+  friend class FileAppender;
 };
 
 static_assert(Page::SIZE > sizeof(PageHeader),
@@ -101,6 +101,16 @@ class PageIterator {
 		return page_->getRecord(current_record_); 
 	}
 
+  /**
+   * Returns the current record in place, without copying it.  The view is
+   * only good while the page is unchanged.
+   *
+   * @return  View of the record in page.
+   */
+	inline RecordView view() const {
+		return page_->viewRecord(current_record_);
+	}
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.